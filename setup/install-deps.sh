@@ -1,5 +1,5 @@
 #!/bin/bash
 
-PKGS='libgstreamer1.0-dev libgstreamer-plugins-base1.0-dev '
+PKGS='libgstreamer1.0-dev libgstreamer-plugins-base1.0-dev liburing-dev libpng-dev libjpeg-dev libzstd-dev '
 
 sudo apt install --no-install-recommends -yq $PKGS
@@ -0,0 +1,64 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include "gstzcmformat.h"
+
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_image_t.h"
+
+typedef struct
+{
+  GstVideoFormat format;
+  gint32 pixelformat;
+} GstZcmFormatMapping;
+
+// Formats without a fourcc
+static const GstZcmFormatMapping mappings[] = {
+  { GST_VIDEO_FORMAT_RGB,       ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_RGB },
+  { GST_VIDEO_FORMAT_BGR,       ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BGR },
+  { GST_VIDEO_FORMAT_RGBA,      ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_RGBA },
+  { GST_VIDEO_FORMAT_BGRA,      ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BGRA },
+  { GST_VIDEO_FORMAT_GRAY8,     ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_GRAY },
+  { GST_VIDEO_FORMAT_GRAY16_BE, ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BE_GRAY16 },
+  { GST_VIDEO_FORMAT_GRAY16_LE, ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_LE_GRAY16 },
+  { GST_VIDEO_FORMAT_RGB16,     ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_LE_RGB16 },
+};
+
+gint32
+gst_zcm_format_to_pixelformat (GstVideoFormat format)
+{
+  gint32 pixelformat = gst_video_format_to_fourcc(format);
+  if (pixelformat != 0) return pixelformat;
+
+  for (guint i = 0; i < G_N_ELEMENTS(mappings); ++i) {
+    if (mappings[i].format == format) return mappings[i].pixelformat;
+  }
+  return 0;
+}
+
+GstVideoFormat
+gst_zcm_format_from_pixelformat (gint32 pixelformat)
+{
+  GstVideoFormat format = gst_video_format_from_fourcc(pixelformat);
+  if (format != GST_VIDEO_FORMAT_UNKNOWN) return format;
+
+  for (guint i = 0; i < G_N_ELEMENTS(mappings); ++i) {
+    if (mappings[i].pixelformat == pixelformat) return mappings[i].format;
+  }
+  return GST_VIDEO_FORMAT_UNKNOWN;
+}
@@ -0,0 +1,40 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMFORMAT_H_
+#define _GST_ZCMFORMAT_H_
+
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/* Mapping between GStreamer video formats and image_t pixelformats. Formats
+ * with a fourcc use it, the others go by the V4L2 style constants of
+ * image_t.zcm. */
+
+/* The pixelformat of format, 0 if image_t has none */
+gint32 gst_zcm_format_to_pixelformat (GstVideoFormat format);
+
+/* The video format of pixelformat, GST_VIDEO_FORMAT_UNKNOWN if there is none.
+ * MJPEG is not a video format, callers handle it as image/jpeg. */
+GstVideoFormat gst_zcm_format_from_pixelformat (gint32 pixelformat);
+
+G_END_DECLS
+
+#endif
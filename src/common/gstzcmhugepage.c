@@ -0,0 +1,264 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // MAP_HUGETLB, MADV_HUGEPAGE
+#endif
+
+#include "gstzcmhugepage.h"
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define DEFAULT_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/* Size of the default huge page, from /proc/meminfo */
+static gsize
+hugepage_size (void)
+{
+  static gsize size = 0;
+  if (g_once_init_enter(&size)) {
+    gsize found = DEFAULT_HUGEPAGE_SIZE;
+    FILE* meminfo = fopen("/proc/meminfo", "r");
+    if (meminfo) {
+      char line[128];
+      unsigned long kb;
+      while (fgets(line, sizeof(line), meminfo)) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1 && kb > 0) {
+          found = (gsize) kb * 1024;
+          break;
+        }
+      }
+      fclose(meminfo);
+    }
+    g_once_init_leave(&size, found);
+  }
+  return size;
+}
+
+/* Anonymous mapping of length bytes starting on an align boundary, which
+ * transparent huge pages need to back it from the first byte */
+static gpointer
+map_aligned (gsize length, gsize align)
+{
+  guint8* mem = mmap(NULL, length + align, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) return NULL;
+
+  guint8* start = (guint8*) (((guintptr) mem + align - 1) & ~((guintptr) align - 1));
+  if (start > mem) munmap(mem, start - mem);
+  gsize tail = (mem + length + align) - (start + length);
+  if (tail > 0) munmap(start + length, tail);
+
+  return start;
+}
+
+gpointer
+gst_zcm_hugepage_alloc (gsize * size)
+{
+  gsize huge = hugepage_size();
+  gsize length = (*size + huge - 1) & ~(huge - 1);
+  if (length == 0) length = huge;
+
+  gpointer mem = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (mem == MAP_FAILED) {
+    // Most systems reserve no huge pages (vm.nr_hugepages is 0)
+    mem = map_aligned(length, huge);
+    if (!mem) return NULL;
+#ifdef MADV_HUGEPAGE
+    if (madvise(mem, length, MADV_HUGEPAGE) != 0) {
+      // THP is disabled or not built in, the mapping uses normal pages
+    }
+#endif
+  }
+
+  *size = length;
+  return mem;
+}
+
+void
+gst_zcm_hugepage_free (gpointer mem, gsize size)
+{
+  if (mem) munmap(mem, size);
+}
+
+typedef struct
+{
+  GstMemory mem;
+  guint8* data;  // start of the mapping, shared memory has its parent's
+  gsize length;  // of the mapping, 0 for shared memory
+} GstZcmHugepageMemory;
+
+typedef struct
+{
+  GstAllocator parent;
+} GstZcmHugepageAllocator;
+
+typedef struct
+{
+  GstAllocatorClass parent_class;
+} GstZcmHugepageAllocatorClass;
+
+static GType gst_zcm_hugepage_allocator_get_type (void);
+G_DEFINE_TYPE (GstZcmHugepageAllocator, gst_zcm_hugepage_allocator,
+    GST_TYPE_ALLOCATOR);
+
+static GstMemory *
+hugepage_mem_alloc (GstAllocator * allocator, gsize size,
+    GstAllocationParams * params)
+{
+  gsize maxsize = size + params->prefix + params->padding;
+
+  // Mappings are page aligned, stricter alignment is left to the system
+  // allocator, as are blocks too small to be worth a huge page
+  if (maxsize < hugepage_size() / 2 || params->align >= (gsize) getpagesize()) {
+    return gst_allocator_alloc(NULL, size, params);
+  }
+
+  gsize length = maxsize;
+  gpointer data = gst_zcm_hugepage_alloc(&length);
+  if (!data) return gst_allocator_alloc(NULL, size, params);
+
+  // Fresh anonymous memory reads as zeros
+  GstZcmHugepageMemory* mem = g_slice_new(GstZcmHugepageMemory);
+  gst_memory_init(GST_MEMORY_CAST(mem),
+      params->flags | GST_MEMORY_FLAG_ZERO_PREFIXED | GST_MEMORY_FLAG_ZERO_PADDED,
+      allocator, NULL, maxsize, params->align, params->prefix, size);
+  mem->data = data;
+  mem->length = length;
+
+  return GST_MEMORY_CAST(mem);
+}
+
+static void
+hugepage_mem_free (GstAllocator * allocator, GstMemory * memory)
+{
+  GstZcmHugepageMemory* mem = (GstZcmHugepageMemory*) memory;
+  if (mem->length > 0) gst_zcm_hugepage_free(mem->data, mem->length);
+  g_slice_free(GstZcmHugepageMemory, mem);
+}
+
+static gpointer
+hugepage_mem_map (GstMemory * memory, gsize maxsize, GstMapFlags flags)
+{
+  return ((GstZcmHugepageMemory*) memory)->data;
+}
+
+static void
+hugepage_mem_unmap (GstMemory * memory)
+{
+}
+
+static GstMemory *
+hugepage_mem_share (GstMemory * memory, gssize offset, gssize size)
+{
+  GstZcmHugepageMemory* mem = (GstZcmHugepageMemory*) memory;
+  GstMemory* parent = memory->parent ? memory->parent : memory;
+  if (size == -1) size = memory->size - offset;
+
+  GstZcmHugepageMemory* shared = g_slice_new(GstZcmHugepageMemory);
+  gst_memory_init(GST_MEMORY_CAST(shared),
+      GST_MINI_OBJECT_FLAGS(parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+      memory->allocator, parent, memory->maxsize, memory->align,
+      memory->offset + offset, size);
+  shared->data = mem->data;
+  shared->length = 0;
+
+  return GST_MEMORY_CAST(shared);
+}
+
+static void
+gst_zcm_hugepage_allocator_class_init (GstZcmHugepageAllocatorClass * klass)
+{
+  GstAllocatorClass* allocator_class = GST_ALLOCATOR_CLASS(klass);
+  allocator_class->alloc = hugepage_mem_alloc;
+  allocator_class->free = hugepage_mem_free;
+}
+
+static void
+gst_zcm_hugepage_allocator_init (GstZcmHugepageAllocator * allocator)
+{
+  GstAllocator* alloc = GST_ALLOCATOR_CAST(allocator);
+  alloc->mem_type = GST_ZCM_HUGEPAGE_ALLOCATOR_NAME;
+  alloc->mem_map = hugepage_mem_map;
+  alloc->mem_unmap = hugepage_mem_unmap;
+  alloc->mem_share = hugepage_mem_share;
+  GST_OBJECT_FLAG_SET(allocator, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+GstAllocator *
+gst_zcm_hugepage_allocator_get (void)
+{
+  static gsize registered = 0;
+  if (g_once_init_enter(&registered)) {
+    GstAllocator* allocator = g_object_new(gst_zcm_hugepage_allocator_get_type(), NULL);
+    gst_object_ref_sink(allocator);
+    gst_allocator_register(GST_ZCM_HUGEPAGE_ALLOCATOR_NAME, allocator);
+    g_once_init_leave(&registered, 1);
+  }
+  return gst_allocator_find(GST_ZCM_HUGEPAGE_ALLOCATOR_NAME);
+}
+
+typedef struct
+{
+  GstBufferPool parent;
+} GstZcmHugepagePool;
+
+typedef struct
+{
+  GstBufferPoolClass parent_class;
+} GstZcmHugepagePoolClass;
+
+G_DEFINE_TYPE (GstZcmHugepagePool, gst_zcm_hugepage_pool, GST_TYPE_BUFFER_POOL);
+
+static gboolean
+hugepage_pool_set_config (GstBufferPool * pool, GstStructure * config)
+{
+  GstAllocationParams params;
+  if (!gst_buffer_pool_config_get_allocator(config, NULL, &params)) {
+    gst_allocation_params_init(&params);
+  }
+
+  GstAllocator* allocator = gst_zcm_hugepage_allocator_get();
+  gst_buffer_pool_config_set_allocator(config, allocator, &params);
+  gst_object_unref(allocator);
+
+  return GST_BUFFER_POOL_CLASS(gst_zcm_hugepage_pool_parent_class)->set_config(pool, config);
+}
+
+static void
+gst_zcm_hugepage_pool_class_init (GstZcmHugepagePoolClass * klass)
+{
+  GST_BUFFER_POOL_CLASS(klass)->set_config = hugepage_pool_set_config;
+}
+
+static void
+gst_zcm_hugepage_pool_init (GstZcmHugepagePool * pool)
+{
+}
+
+GstBufferPool *
+gst_zcm_hugepage_pool_new (void)
+{
+  GstBufferPool* pool = g_object_new(GST_TYPE_ZCM_HUGEPAGE_POOL, NULL);
+  gst_object_ref_sink(pool);
+  return pool;
+}
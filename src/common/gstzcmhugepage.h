@@ -0,0 +1,58 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMHUGEPAGE_H_
+#define _GST_ZCMHUGEPAGE_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Memory for large frames backed by huge pages, so copying a 4K frame walks
+ * a handful of TLB entries instead of thousands and faults in megabytes at a
+ * time. Reserved huge pages (MAP_HUGETLB) are used if the system has any,
+ * otherwise the mapping is aligned to a huge page and madvised for
+ * transparent huge pages. Where neither is available the memory is ordinary
+ * anonymous memory, nothing fails because of it. */
+
+#define GST_ZCM_HUGEPAGE_ALLOCATOR_NAME "ZcmHugepageMemory"
+
+/* Maps at least *size bytes, rounding *size up to the length mapped.
+ * Returns NULL only if the mapping fails altogether. */
+gpointer gst_zcm_hugepage_alloc (gsize * size);
+
+/* Unmaps memory from gst_zcm_hugepage_alloc(), size being the rounded size */
+void gst_zcm_hugepage_free (gpointer mem, gsize size);
+
+/* Returns a reference to the process wide allocator. Blocks smaller than
+ * half a huge page, which would mostly waste theirs, come from the system
+ * allocator instead. */
+GstAllocator * gst_zcm_hugepage_allocator_get (void);
+
+#define GST_TYPE_ZCM_HUGEPAGE_POOL (gst_zcm_hugepage_pool_get_type ())
+GType gst_zcm_hugepage_pool_get_type (void);
+
+/* A buffer pool whose buffers always come from the hugepage allocator,
+ * whichever allocator its config names. Pooling keeps the mappings, so a
+ * frame's pages are faulted in once rather than on every copy. */
+GstBufferPool * gst_zcm_hugepage_pool_new (void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,43 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include "gstzcmtime.h"
+
+gint64
+gst_zcm_buffer_utime (GstBaseSink * sink, GstBuffer * buf)
+{
+  gint64 now = g_get_real_time();
+
+  if (!GST_BUFFER_PTS_IS_VALID(buf)) return now;
+
+  GstClockTime running = gst_segment_to_running_time(&sink->segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS(buf));
+  GstClock* clock = gst_element_get_clock(GST_ELEMENT(sink));
+  if (!GST_CLOCK_TIME_IS_VALID(running) || !clock) {
+    if (clock) gst_object_unref(clock);
+    return now;
+  }
+
+  GstClockTime clock_now = gst_clock_get_time(clock);
+  gst_object_unref(clock);
+
+  GstClockTime base_time = gst_element_get_base_time(GST_ELEMENT(sink));
+  GstClockTimeDiff behind = GST_CLOCK_DIFF(base_time + running, clock_now);
+  return now - behind / 1000;
+}
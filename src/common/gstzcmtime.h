@@ -0,0 +1,38 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMTIME_H_
+#define _GST_ZCMTIME_H_
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+G_BEGIN_DECLS
+
+/* Wall clock time of a buffer reaching sink, in microseconds, as published
+ * in utime fields and written as eventlog timestamps. The clock time of the
+ * buffer's running time is moved into real time by the offset between the
+ * pipeline clock and the wall clock now. Buffers without a PTS, or a sink
+ * without a clock, get the current real time, so every utime shares one
+ * time base. */
+gint64 gst_zcm_buffer_utime (GstBaseSink * sink, GstBuffer * buf);
+
+G_END_DECLS
+
+#endif
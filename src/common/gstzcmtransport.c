@@ -0,0 +1,88 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include "gstzcmtransport.h"
+
+typedef struct
+{
+  gchar* url;
+  zcm_t* zcm;
+  gint refcount;
+} GstZcmTransport;
+
+// All transports of the process, keyed by url. Transports are only created
+// and destroyed with the lock held, so they are never started twice.
+static GMutex transports_lock;
+static GHashTable* transports = NULL;
+
+zcm_t *
+gst_zcm_transport_acquire (const gchar * url)
+{
+  if (!url) url = "";
+
+  g_mutex_lock(&transports_lock);
+
+  if (!transports) transports = g_hash_table_new(g_str_hash, g_str_equal);
+
+  GstZcmTransport* transport = g_hash_table_lookup(transports, url);
+  if (transport) {
+    transport->refcount++;
+  } else {
+    zcm_t* zcm = zcm_create(*url ? url : NULL);
+    if (zcm) {
+      zcm_start(zcm);
+      transport = g_new0(GstZcmTransport, 1);
+      transport->url = g_strdup(url);
+      transport->zcm = zcm;
+      transport->refcount = 1;
+      g_hash_table_insert(transports, transport->url, transport);
+    }
+  }
+
+  g_mutex_unlock(&transports_lock);
+
+  return transport ? transport->zcm : NULL;
+}
+
+void
+gst_zcm_transport_release (zcm_t * zcm)
+{
+  if (!zcm) return;
+
+  g_mutex_lock(&transports_lock);
+
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, transports);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    GstZcmTransport* transport = value;
+    if (transport->zcm != zcm) continue;
+
+    if (--transport->refcount == 0) {
+      g_hash_table_iter_remove(&iter);
+      zcm_stop(transport->zcm);
+      zcm_destroy(transport->zcm);
+      g_free(transport->url);
+      g_free(transport);
+    }
+    break;
+  }
+
+  g_mutex_unlock(&transports_lock);
+}
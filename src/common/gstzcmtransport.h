@@ -0,0 +1,49 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMTRANSPORT_H_
+#define _GST_ZCMTRANSPORT_H_
+
+#include <glib.h>
+#include <zcm/zcm.h>
+
+G_BEGIN_DECLS
+
+/* Process wide pool of started zcm transports, one per url, shared by every
+ * element that uses the same url. A transport has a single dispatch thread
+ * that calls the handlers of all elements subscribed on it, zcm routing
+ * messages by channel as usual.
+ *
+ * Elements must not zcm_stop() or zcm_destroy() a shared transport. They
+ * subscribe and unsubscribe on it while it runs, and unsubscribe everything
+ * before releasing it, as handlers of other elements keep being dispatched.
+ * Handlers should hand work off quickly since they delay the others. */
+
+/* Returns the transport for url, creating and starting it if this is the
+ * first reference. NULL and "" both mean zcm's default url. Returns NULL if
+ * the transport could not be created. */
+zcm_t * gst_zcm_transport_acquire (const gchar * url);
+
+/* Drops a reference taken by gst_zcm_transport_acquire(). The last one stops
+ * and destroys the transport. */
+void gst_zcm_transport_release (zcm_t * zcm);
+
+G_END_DECLS
+
+#endif
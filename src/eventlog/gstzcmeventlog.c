@@ -0,0 +1,173 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include "gstzcmeventlog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+static gboolean
+write_all (int fd, const guint8 * data, gsize size)
+{
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return FALSE;
+    }
+    data += n;
+    size -= n;
+  }
+  return TRUE;
+}
+
+void
+gst_zcm_eventlog_write_header (guint8 * dest, gint64 eventnum,
+    gint64 timestamp, guint32 channellen, guint32 datalen)
+{
+  GST_WRITE_UINT32_BE(dest, GST_ZCM_EVENTLOG_MAGIC);
+  GST_WRITE_UINT64_BE(dest + 4, eventnum);
+  GST_WRITE_UINT64_BE(dest + 12, timestamp);
+  GST_WRITE_UINT32_BE(dest + 20, channellen);
+  GST_WRITE_UINT32_BE(dest + 24, datalen);
+}
+
+gboolean
+gst_zcm_eventlog_read_header (const guint8 * src, GstZcmEventLogHeader * header)
+{
+  if (GST_READ_UINT32_BE(src) != GST_ZCM_EVENTLOG_MAGIC) return FALSE;
+
+  header->eventnum = GST_READ_UINT64_BE(src + 4);
+  header->timestamp = GST_READ_UINT64_BE(src + 12);
+  header->channellen = GST_READ_UINT32_BE(src + 20);
+  header->datalen = GST_READ_UINT32_BE(src + 24);
+
+  return TRUE;
+}
+
+int
+gst_zcm_eventlog_index_create (const char * path)
+{
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return -1;
+
+  GstZcmEventLogIndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GST_ZCM_EVENTLOG_INDEX_MAGIC, sizeof(header.magic));
+  header.version = GST_ZCM_EVENTLOG_INDEX_VERSION;
+  header.entry_size = sizeof(GstZcmEventLogIndexEntry);
+  if (!write_all(fd, (const guint8*) &header, sizeof(header))) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+gboolean
+gst_zcm_eventlog_index_append (int fd, const GstZcmEventLogIndexEntry * entries,
+    guint n)
+{
+  return write_all(fd, (const guint8*) entries, n * sizeof(*entries));
+}
+
+gboolean
+gst_zcm_eventlog_index_open (GstZcmEventLogIndex * index, const char * path)
+{
+  memset(index, 0, sizeof(*index));
+
+  GMappedFile* file = g_mapped_file_new(path, FALSE, NULL);
+  if (!file) return FALSE;
+
+  const guint8* data = (const guint8*) g_mapped_file_get_contents(file);
+  gsize size = g_mapped_file_get_length(file);
+
+  GstZcmEventLogIndexHeader header;
+  if (size < sizeof(header)) {
+    g_mapped_file_unref(file);
+    return FALSE;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, GST_ZCM_EVENTLOG_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != GST_ZCM_EVENTLOG_INDEX_VERSION ||
+      header.entry_size != sizeof(GstZcmEventLogIndexEntry)) {
+    g_mapped_file_unref(file);
+    return FALSE;
+  }
+
+  index->file = file;
+  index->entries = (const GstZcmEventLogIndexEntry*) (data + sizeof(header));
+  index->n_entries = (size - sizeof(header)) / sizeof(GstZcmEventLogIndexEntry);
+
+  return TRUE;
+}
+
+void
+gst_zcm_eventlog_index_scan (GstZcmEventLogIndex * index, const guint8 * log,
+    gsize size)
+{
+  memset(index, 0, sizeof(*index));
+
+  GArray* entries = g_array_new(FALSE, FALSE, sizeof(GstZcmEventLogIndexEntry));
+
+  guint64 offset = 0;
+  GstZcmEventLogHeader header;
+  while (offset + GST_ZCM_EVENTLOG_HEADER_SIZE <= size &&
+         gst_zcm_eventlog_read_header(log + offset, &header)) {
+    guint64 end = offset + GST_ZCM_EVENTLOG_HEADER_SIZE +
+                  header.channellen + header.datalen;
+    if (end > size) break;
+
+    GstZcmEventLogIndexEntry entry;
+    entry.timestamp = header.timestamp;
+    entry.offset = offset;
+    entry.eventnum = header.eventnum;
+    g_array_append_val(entries, entry);
+
+    offset = end;
+  }
+
+  index->n_entries = entries->len;
+  index->scanned = (GstZcmEventLogIndexEntry*) g_array_free(entries, FALSE);
+  index->entries = index->scanned;
+}
+
+void
+gst_zcm_eventlog_index_clear (GstZcmEventLogIndex * index)
+{
+  if (index->file) g_mapped_file_unref(index->file);
+  g_free(index->scanned);
+  memset(index, 0, sizeof(*index));
+}
+
+gsize
+gst_zcm_eventlog_index_lookup (const GstZcmEventLogIndex * index,
+    gint64 timestamp)
+{
+  gsize lo = 0;
+  gsize hi = index->n_entries;
+  while (lo < hi) {
+    gsize mid = lo + (hi - lo) / 2;
+    if (index->entries[mid].timestamp < timestamp) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
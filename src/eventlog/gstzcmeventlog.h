@@ -0,0 +1,116 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMEVENTLOG_H_
+#define _GST_ZCMEVENTLOG_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* A zcm eventlog is a sequence of events, each a GST_ZCM_EVENTLOG_HEADER_SIZE
+ * byte header (magic, event number, timestamp in microseconds, channel
+ * length and data length, all big endian) followed by the channel name and
+ * the encoded message. This is the format zcm-logger writes and zcm's
+ * eventlog API reads.
+ *
+ * The time index sits next to the log (the log path with
+ * GST_ZCM_EVENTLOG_INDEX_SUFFIX appended). It is a GstZcmEventLogIndexHeader
+ * followed by one GstZcmEventLogIndexEntry per event, in host byte order and
+ * in log order. Entries are only written once their event is in the log. */
+
+#define GST_ZCM_EVENTLOG_MAGIC 0xEDA1DA01u
+#define GST_ZCM_EVENTLOG_HEADER_SIZE 28
+
+#define GST_ZCM_EVENTLOG_INDEX_SUFFIX ".idx"
+#define GST_ZCM_EVENTLOG_INDEX_MAGIC "ZCMLOGIX"
+#define GST_ZCM_EVENTLOG_INDEX_VERSION 1
+
+typedef struct _GstZcmEventLogHeader GstZcmEventLogHeader;
+typedef struct _GstZcmEventLogIndexHeader GstZcmEventLogIndexHeader;
+typedef struct _GstZcmEventLogIndexEntry GstZcmEventLogIndexEntry;
+typedef struct _GstZcmEventLogIndex GstZcmEventLogIndex;
+
+struct _GstZcmEventLogHeader
+{
+  gint64 eventnum;
+  gint64 timestamp;
+  guint32 channellen;
+  guint32 datalen;
+};
+
+struct _GstZcmEventLogIndexHeader
+{
+  char magic[8];
+  guint32 version;
+  guint32 entry_size;
+};
+
+struct _GstZcmEventLogIndexEntry
+{
+  gint64 timestamp;
+  guint64 offset;  // of the event header within the log
+  gint64 eventnum;
+};
+
+struct _GstZcmEventLogIndex
+{
+  GMappedFile* file;                  // when read from an index file
+  GstZcmEventLogIndexEntry* scanned;  // when built from the log itself
+  const GstZcmEventLogIndexEntry* entries;
+  gsize n_entries;
+};
+
+/* Writes an event header to dest, which must have room for
+ * GST_ZCM_EVENTLOG_HEADER_SIZE bytes */
+void gst_zcm_eventlog_write_header (guint8 * dest, gint64 eventnum,
+    gint64 timestamp, guint32 channellen, guint32 datalen);
+
+/* Reads the event header at src, which must have GST_ZCM_EVENTLOG_HEADER_SIZE
+ * bytes. Returns FALSE if there is no event there. */
+gboolean gst_zcm_eventlog_read_header (const guint8 * src,
+    GstZcmEventLogHeader * header);
+
+/* Creates (or truncates) the index at path and writes its header. Returns the
+ * file descriptor to append entries to, -1 on error. */
+int gst_zcm_eventlog_index_create (const char * path);
+
+/* Appends n entries to an index opened by gst_zcm_eventlog_index_create() */
+gboolean gst_zcm_eventlog_index_append (int fd,
+    const GstZcmEventLogIndexEntry * entries, guint n);
+
+/* Maps the index at path. Entries past the last complete one are ignored. */
+gboolean gst_zcm_eventlog_index_open (GstZcmEventLogIndex * index,
+    const char * path);
+
+/* Builds the index by walking the size bytes of log at log, for logs recorded
+ * without one. Stops at the first incomplete event. */
+void gst_zcm_eventlog_index_scan (GstZcmEventLogIndex * index,
+    const guint8 * log, gsize size);
+
+void gst_zcm_eventlog_index_clear (GstZcmEventLogIndex * index);
+
+/* Returns the first entry whose timestamp is at or after timestamp, n_entries
+ * if there is none. Timestamps are expected to increase through the log. */
+gsize gst_zcm_eventlog_index_lookup (const GstZcmEventLogIndex * index,
+    gint64 timestamp);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,563 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-gstzcmlogsink
+ * @title: zcmlogsink
+ *
+ * ZcmLogSink records frames as image_t events straight into a zcm eventlog,
+ * the same file zcm-logger would write had the frames been published with
+ * zcmimagesink, without sending them over a transport a second time.
+ *
+ * Events are serialized into a write-size chunk while the previous chunk is
+ * written out by a writer thread, so the log is written with large
+ * sequential writes. A time index (the log path with ".idx" appended) is
+ * built alongside, mapping every event's timestamp to its offset in the log.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 -v v4l2src ! videoconvert ! zcmlogsink location=camera.log channel=CAMERA
+ * ]|
+ * Records the camera into camera.log on channel CAMERA, with its index in
+ * camera.log.idx
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideosink.h>
+#include "gstzcmlogsink.h"
+#include "gstzcmformat.h"
+#include "gstzcmtime.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_zcmlogsink_debug_category);
+#define GST_CAT_DEFAULT gst_zcmlogsink_debug_category
+
+#define DEFAULT_WRITE_SIZE (8 * 1024 * 1024)
+
+/* prototypes */
+
+
+static void gst_zcmlogsink_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_zcmlogsink_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_zcmlogsink_finalize (GObject * object);
+
+static gboolean gst_zcmlogsink_start (GstBaseSink * bsink);
+static gboolean gst_zcmlogsink_stop (GstBaseSink * bsink);
+static gboolean gst_zcmlogsink_event (GstBaseSink * bsink, GstEvent * event);
+static GstFlowReturn gst_zcmlogsink_show_frame (GstVideoSink * video_sink,
+    GstBuffer * buf);
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_CHANNEL,
+  PROP_WRITE_SIZE,
+};
+
+/* pad templates */
+
+#define VIDEO_SINK_CAPS \
+    GST_VIDEO_CAPS_MAKE("{ UYVY, YUY2, IYU1, IYU2, I420, NV12, GRAY8," \
+                        " RGB, BGR, RGBA, BGRA, GRAY16_BE, GRAY16_LE," \
+                        " RGB16 }")
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+    "sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS(VIDEO_SINK_CAPS"; image/jpeg")
+);
+
+
+/* Private members */
+
+static gboolean
+write_all (int fd, const guint8 * data, gsize size)
+{
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return FALSE;
+    }
+    data += n;
+    size -= n;
+  }
+  return TRUE;
+}
+
+/* Writes out whatever chunk it is handed: the events first, then their index
+ * entries, so the index never points past the end of the log */
+static void*
+writer_thread (void* data)
+{
+  GstZcmLogSink* zcmlogsink = (GstZcmLogSink*) data;
+
+  pthread_mutex_lock(&zcmlogsink->mutex);
+  while (TRUE) {
+    while (!zcmlogsink->writing && !zcmlogsink->exit) {
+      pthread_cond_wait(&zcmlogsink->cond, &zcmlogsink->mutex);
+    }
+    if (!zcmlogsink->writing) break;
+
+    GstZcmLogSinkChunk* chunk = zcmlogsink->writing;
+    pthread_mutex_unlock(&zcmlogsink->mutex);
+
+    gboolean ok = write_all(zcmlogsink->fd, chunk->data, chunk->size) &&
+                  gst_zcm_eventlog_index_append(zcmlogsink->index_fd,
+                                                chunk->entries, chunk->n_entries);
+
+    pthread_mutex_lock(&zcmlogsink->mutex);
+    if (!ok) {
+      GST_ERROR_OBJECT(zcmlogsink, "Could not write to %s: %s",
+                       zcmlogsink->location->str, g_strerror(errno));
+      zcmlogsink->write_failed = TRUE;
+    }
+    zcmlogsink->writing = NULL;
+    pthread_cond_broadcast(&zcmlogsink->cond);
+  }
+  pthread_mutex_unlock(&zcmlogsink->mutex);
+
+  return NULL;
+}
+
+/* Hands the filling chunk to the writer once it is done with the other one,
+ * which becomes the new filling chunk */
+static gboolean
+submit_chunk (GstZcmLogSink * zcmlogsink)
+{
+  pthread_mutex_lock(&zcmlogsink->mutex);
+  while (zcmlogsink->writing) {
+    pthread_cond_wait(&zcmlogsink->cond, &zcmlogsink->mutex);
+  }
+
+  GstZcmLogSinkChunk* full = zcmlogsink->filling;
+  GstZcmLogSinkChunk* next = full == &zcmlogsink->chunks[0] ?
+                             &zcmlogsink->chunks[1] : &zcmlogsink->chunks[0];
+  next->offset = full->offset + full->size;
+  next->size = 0;
+  next->n_entries = 0;
+
+  gboolean ok = !zcmlogsink->write_failed;
+  if (ok && full->size > 0) {
+    zcmlogsink->writing = full;
+    zcmlogsink->filling = next;
+    pthread_cond_broadcast(&zcmlogsink->cond);
+  }
+  pthread_mutex_unlock(&zcmlogsink->mutex);
+
+  return ok;
+}
+
+/* Submits the filling chunk and waits until everything is written */
+static gboolean
+flush_log (GstZcmLogSink * zcmlogsink)
+{
+  if (!zcmlogsink->writer_running) return TRUE;
+
+  gboolean ok = submit_chunk(zcmlogsink);
+
+  pthread_mutex_lock(&zcmlogsink->mutex);
+  while (zcmlogsink->writing) {
+    pthread_cond_wait(&zcmlogsink->cond, &zcmlogsink->mutex);
+  }
+  ok = ok && !zcmlogsink->write_failed;
+  pthread_mutex_unlock(&zcmlogsink->mutex);
+
+  return ok;
+}
+
+/* Serializes an image_t event straight into the filling chunk, encoding the
+ * frame there rather than into a message of its own first */
+static gboolean
+append_event (GstZcmLogSink * zcmlogsink, int64_t timestamp,
+    const zcm_gstreamer_plugins_image_t * img)
+{
+  guint32 channellen = zcmlogsink->channel->len;
+  guint32 datalen = zcm_gstreamer_plugins_image_t_encoded_size(img);
+  gsize size = GST_ZCM_EVENTLOG_HEADER_SIZE + channellen + datalen;
+
+  GstZcmLogSinkChunk* chunk = zcmlogsink->filling;
+  if (chunk->size > 0 && chunk->size + size > zcmlogsink->write_size) {
+    if (!submit_chunk(zcmlogsink)) return FALSE;
+    chunk = zcmlogsink->filling;
+  }
+
+  if (chunk->size + size > chunk->capacity) {
+    // A frame larger than write-size gets a chunk of its own
+    chunk->capacity = MAX(zcmlogsink->write_size, chunk->size + size);
+    chunk->data = g_realloc(chunk->data, chunk->capacity);
+  }
+  if (chunk->n_entries == chunk->entries_capacity) {
+    chunk->entries_capacity = MAX(64, 2 * chunk->entries_capacity);
+    chunk->entries = g_renew(GstZcmEventLogIndexEntry, chunk->entries,
+                             chunk->entries_capacity);
+  }
+
+  guint8* event = chunk->data + chunk->size;
+  gst_zcm_eventlog_write_header(event, zcmlogsink->eventnum, timestamp,
+                                channellen, datalen);
+  memcpy(event + GST_ZCM_EVENTLOG_HEADER_SIZE, zcmlogsink->channel->str,
+         channellen);
+  if (zcm_gstreamer_plugins_image_t_encode(
+          event + GST_ZCM_EVENTLOG_HEADER_SIZE + channellen, 0, datalen,
+          img) != (int) datalen) {
+    GST_ERROR_OBJECT(zcmlogsink, "Could not encode frame");
+    return FALSE;
+  }
+
+  GstZcmEventLogIndexEntry* entry = &chunk->entries[chunk->n_entries++];
+  entry->timestamp = timestamp;
+  entry->offset = chunk->offset + chunk->size;
+  entry->eventnum = zcmlogsink->eventnum++;
+
+  chunk->size += size;
+
+  return TRUE;
+}
+
+static void
+chunks_free (GstZcmLogSink * zcmlogsink)
+{
+  for (size_t i = 0; i < G_N_ELEMENTS(zcmlogsink->chunks); ++i) {
+    GstZcmLogSinkChunk* chunk = &zcmlogsink->chunks[i];
+    g_free(chunk->data);
+    g_free(chunk->entries);
+    memset(chunk, 0, sizeof(*chunk));
+  }
+}
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstZcmLogSink, gst_zcmlogsink, GST_TYPE_VIDEO_SINK,
+    GST_DEBUG_CATEGORY_INIT (gst_zcmlogsink_debug_category, "zcmlogsink", 0,
+        "debug category for zcmlogsink element"));
+
+static gboolean
+gst_zcmlogsink_setcaps (GstBaseSink * bsink, GstCaps * caps)
+{
+  GstZcmLogSink *zcmlogsink = GST_ZCMLOGSINK (bsink);
+
+  GstVideoInfo info;
+  if (!gst_video_info_from_caps (&info, caps)) {
+    GST_DEBUG_OBJECT (zcmlogsink,
+        "Could not get video info from caps %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  zcmlogsink->img.width = info.width;
+  zcmlogsink->img.height = info.height;
+  zcmlogsink->info = info;
+
+  GstVideoFormat pixelformat = GST_VIDEO_INFO_FORMAT(&info);
+  if (pixelformat == GST_VIDEO_FORMAT_ENCODED) {
+      const gchar* name = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+      if (!name) {
+        GST_DEBUG_OBJECT(zcmlogsink, "Could not get name of caps %" GST_PTR_FORMAT, caps);
+        return FALSE;
+      }
+      if (g_strcmp0(name, "image/jpeg") == 0) {
+        zcmlogsink->img.pixelformat = ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_MJPEG;
+      }
+      return TRUE;
+  }
+
+  zcmlogsink->img.pixelformat = gst_zcm_format_to_pixelformat (pixelformat);
+
+  return TRUE;
+}
+
+static void
+gst_zcmlogsink_class_init (GstZcmLogSinkClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstBaseSinkClass *gstbasesink_class = GST_BASE_SINK_CLASS (klass);
+  GstVideoSinkClass *video_sink_class = GST_VIDEO_SINK_CLASS (klass);
+
+  gst_element_class_add_pad_template(GST_ELEMENT_CLASS (klass),
+          gst_static_pad_template_get(&sink_template));
+
+  gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
+      "ZcmLogSink", "Sink/File",
+      "Records frames from a pipeline into a zcm eventlog",
+      "ZeroCM Team <www.zcm-project.org>");
+
+  gstbasesink_class->set_caps = gst_zcmlogsink_setcaps;
+  gstbasesink_class->start = GST_DEBUG_FUNCPTR (gst_zcmlogsink_start);
+  gstbasesink_class->stop = GST_DEBUG_FUNCPTR (gst_zcmlogsink_stop);
+  gstbasesink_class->event = GST_DEBUG_FUNCPTR (gst_zcmlogsink_event);
+  gobject_class->set_property = gst_zcmlogsink_set_property;
+  gobject_class->get_property = gst_zcmlogsink_get_property;
+  gobject_class->finalize = gst_zcmlogsink_finalize;
+  video_sink_class->show_frame = GST_DEBUG_FUNCPTR (gst_zcmlogsink_show_frame);
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+          g_param_spec_string ("location", "Eventlog location",
+              "Path of the eventlog to record to, its time index is written "
+              "next to it with \"" GST_ZCM_EVENTLOG_INDEX_SUFFIX "\" appended",
+              "", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CHANNEL,
+          g_param_spec_string ("channel", "Zcm channel",
+              "Channel name to record the frames on",
+              "GSTREAMER_DATA", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_WRITE_SIZE,
+          g_param_spec_uint ("write-size", "Write size",
+              "Bytes of events to collect before writing them out together",
+              4096, G_MAXINT, DEFAULT_WRITE_SIZE,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_zcmlogsink_init (GstZcmLogSink * zcmlogsink)
+{
+  memset(&zcmlogsink->img, 0, sizeof(zcmlogsink->img));
+  zcmlogsink->fd = -1;
+  zcmlogsink->index_fd = -1;
+  zcmlogsink->eventnum = 0;
+  memset(zcmlogsink->chunks, 0, sizeof(zcmlogsink->chunks));
+  zcmlogsink->filling = &zcmlogsink->chunks[0];
+  zcmlogsink->writing = NULL;
+  zcmlogsink->write_failed = FALSE;
+  zcmlogsink->exit = FALSE;
+  zcmlogsink->writer_running = FALSE;
+  pthread_mutex_init(&zcmlogsink->mutex, NULL);
+  pthread_cond_init(&zcmlogsink->cond, NULL);
+
+  zcmlogsink->location = g_string_new("");
+  zcmlogsink->channel = g_string_new("GSTREAMER_DATA");
+  zcmlogsink->write_size = DEFAULT_WRITE_SIZE;
+}
+
+void
+gst_zcmlogsink_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstZcmLogSink *zcmlogsink = GST_ZCMLOGSINK (object);
+
+  GST_DEBUG_OBJECT (zcmlogsink, "set_property");
+
+  switch (property_id) {
+    case PROP_LOCATION:
+      g_string_assign (zcmlogsink->location, g_value_get_string (value));
+      break;
+    case PROP_CHANNEL:
+      g_string_assign (zcmlogsink->channel, g_value_get_string (value));
+      break;
+    case PROP_WRITE_SIZE:
+      zcmlogsink->write_size = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_zcmlogsink_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstZcmLogSink *zcmlogsink = GST_ZCMLOGSINK (object);
+
+  GST_DEBUG_OBJECT (zcmlogsink, "get_property");
+
+  switch (property_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, zcmlogsink->location->str);
+      break;
+    case PROP_CHANNEL:
+      g_value_set_string (value, zcmlogsink->channel->str);
+      break;
+    case PROP_WRITE_SIZE:
+      g_value_set_uint (value, zcmlogsink->write_size);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_zcmlogsink_finalize (GObject * object)
+{
+  GstZcmLogSink *zcmlogsink = GST_ZCMLOGSINK (object);
+
+  GST_DEBUG_OBJECT (zcmlogsink, "finalize");
+
+  chunks_free(zcmlogsink);
+  pthread_mutex_destroy(&zcmlogsink->mutex);
+  pthread_cond_destroy(&zcmlogsink->cond);
+
+  g_string_free(zcmlogsink->location, TRUE);
+  g_string_free(zcmlogsink->channel, TRUE);
+
+  G_OBJECT_CLASS (gst_zcmlogsink_parent_class)->finalize (object);
+}
+
+static gboolean
+gst_zcmlogsink_start (GstBaseSink * bsink)
+{
+  GstZcmLogSink *zcmlogsink = GST_ZCMLOGSINK (bsink);
+
+  GST_DEBUG_OBJECT (zcmlogsink, "start");
+
+  if (zcmlogsink->location->len == 0) {
+    GST_ERROR_OBJECT (zcmlogsink, "No location set");
+    return FALSE;
+  }
+
+  zcmlogsink->fd = open(zcmlogsink->location->str,
+                        O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (zcmlogsink->fd < 0) {
+    GST_ERROR_OBJECT (zcmlogsink, "Could not open %s: %s",
+                      zcmlogsink->location->str, g_strerror(errno));
+    return FALSE;
+  }
+
+  char* index_path = g_strconcat(zcmlogsink->location->str,
+                                 GST_ZCM_EVENTLOG_INDEX_SUFFIX, NULL);
+  zcmlogsink->index_fd = gst_zcm_eventlog_index_create(index_path);
+  if (zcmlogsink->index_fd < 0) {
+    GST_ERROR_OBJECT (zcmlogsink, "Could not create index %s: %s",
+                      index_path, g_strerror(errno));
+    g_free(index_path);
+    close(zcmlogsink->fd);
+    zcmlogsink->fd = -1;
+    return FALSE;
+  }
+  g_free(index_path);
+
+  zcmlogsink->eventnum = 0;
+  zcmlogsink->filling = &zcmlogsink->chunks[0];
+  zcmlogsink->filling->offset = 0;
+  zcmlogsink->filling->size = 0;
+  zcmlogsink->filling->n_entries = 0;
+  zcmlogsink->writing = NULL;
+  zcmlogsink->write_failed = FALSE;
+  zcmlogsink->exit = FALSE;
+  pthread_create(&zcmlogsink->writer_thr, NULL, writer_thread, zcmlogsink);
+  zcmlogsink->writer_running = TRUE;
+
+  return TRUE;
+}
+
+static gboolean
+gst_zcmlogsink_stop (GstBaseSink * bsink)
+{
+  GstZcmLogSink *zcmlogsink = GST_ZCMLOGSINK (bsink);
+
+  GST_DEBUG_OBJECT (zcmlogsink, "stop");
+
+  gboolean ok = flush_log(zcmlogsink);
+
+  if (zcmlogsink->writer_running) {
+    pthread_mutex_lock(&zcmlogsink->mutex);
+    zcmlogsink->exit = TRUE;
+    pthread_cond_broadcast(&zcmlogsink->cond);
+    pthread_mutex_unlock(&zcmlogsink->mutex);
+    pthread_join(zcmlogsink->writer_thr, NULL);
+    zcmlogsink->writer_running = FALSE;
+  }
+
+  if (zcmlogsink->fd >= 0) close(zcmlogsink->fd);
+  if (zcmlogsink->index_fd >= 0) close(zcmlogsink->index_fd);
+  zcmlogsink->fd = -1;
+  zcmlogsink->index_fd = -1;
+
+  chunks_free(zcmlogsink);
+  zcmlogsink->filling = &zcmlogsink->chunks[0];
+
+  return ok;
+}
+
+static gboolean
+gst_zcmlogsink_event (GstBaseSink * bsink, GstEvent * event)
+{
+  GstZcmLogSink *zcmlogsink = GST_ZCMLOGSINK (bsink);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_EOS) {
+    if (!flush_log (zcmlogsink)) {
+      GST_ELEMENT_ERROR (zcmlogsink, RESOURCE, WRITE,
+          ("Could not write to %s", zcmlogsink->location->str), (NULL));
+    }
+  }
+
+  return GST_BASE_SINK_CLASS (gst_zcmlogsink_parent_class)->event (bsink, event);
+}
+
+static GstFlowReturn
+gst_zcmlogsink_show_frame (GstVideoSink * sink, GstBuffer * buf)
+{
+  GstZcmLogSink *zcmlogsink = GST_ZCMLOGSINK (sink);
+
+  GST_DEBUG_OBJECT (zcmlogsink, "show_frame");
+
+  if (gst_buffer_n_memory (buf) != 1) {
+    GST_ERROR_OBJECT (zcmlogsink, "Support only 1 memory per buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  // Strides as gst_video_frame_map would report them, without mapping here
+  GstVideoMeta* meta = gst_buffer_get_video_meta (buf);
+  zcm_gstreamer_plugins_image_t* img = &zcmlogsink->img;
+  img->num_strides = meta ? meta->n_planes : GST_VIDEO_INFO_N_PLANES (&zcmlogsink->info);
+  img->stride = zcmlogsink->stride;
+  for (size_t i = 0; i < img->num_strides; ++i) {
+    img->stride[i] = meta ? meta->stride[i] :
+                     GST_VIDEO_INFO_PLANE_STRIDE (&zcmlogsink->info, i);
+  }
+
+  GstMapInfo info;
+  if (!gst_buffer_map (buf, &info, GST_MAP_READ)) {
+    GST_WARNING_OBJECT (zcmlogsink, "could not map buffer info");
+    return GST_FLOW_OK;
+  }
+
+  img->utime = gst_zcm_buffer_utime (GST_BASE_SINK (zcmlogsink), buf);
+  img->size = info.size;
+  img->data = info.data;
+
+  gboolean ok = append_event (zcmlogsink, img->utime, img);
+
+  img->data = NULL;
+  gst_buffer_unmap (buf, &info);
+
+  if (!ok) {
+    GST_ELEMENT_ERROR (zcmlogsink, RESOURCE, WRITE,
+        ("Could not write to %s", zcmlogsink->location->str), (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  return GST_FLOW_OK;
+}
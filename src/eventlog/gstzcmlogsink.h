@@ -0,0 +1,94 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMLOGSINK_H_
+#define _GST_ZCMLOGSINK_H_
+
+#include <gst/video/video.h>
+#include <gst/video/gstvideosink.h>
+
+#include <pthread.h>
+
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_image_t.h"
+
+#include "gstzcmeventlog.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ZCMLOGSINK (gst_zcmlogsink_get_type())
+#define GST_ZCMLOGSINK(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ZCMLOGSINK,GstZcmLogSink))
+#define GST_ZCMLOGSINK_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ZCMLOGSINK,GstZcmLogSinkClass))
+#define GST_IS_ZCMLOGSINK(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ZCMLOGSINK))
+#define GST_IS_ZCMLOGSINK_CLASS(obj) (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ZCMLOGSINK))
+
+typedef struct _GstZcmLogSink GstZcmLogSink;
+typedef struct _GstZcmLogSinkClass GstZcmLogSinkClass;
+
+// Events are serialized into one chunk while the other is being written
+typedef struct _GstZcmLogSinkChunk
+{
+  guint8* data;
+  gsize size;
+  gsize capacity;
+  guint64 offset;  // of data[0] within the log
+
+  GstZcmEventLogIndexEntry* entries;
+  guint n_entries;
+  guint entries_capacity;
+} GstZcmLogSinkChunk;
+
+struct _GstZcmLogSink
+{
+  GstVideoSink base_zcmlogsink;
+
+  // Privates
+  GstVideoInfo info;
+  zcm_gstreamer_plugins_image_t img;
+  int32_t stride[GST_VIDEO_MAX_PLANES];
+
+  int fd;
+  int index_fd;
+  gint64 eventnum;
+
+  GstZcmLogSinkChunk chunks[2];
+  GstZcmLogSinkChunk* filling;
+  GstZcmLogSinkChunk* writing;  // NULL while the writer is idle
+  gboolean write_failed;
+  gboolean exit;
+  gboolean writer_running;
+  pthread_t writer_thr;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  // Properties
+  GString* location;
+  GString* channel;
+  guint write_size;
+};
+
+struct _GstZcmLogSinkClass
+{
+  GstVideoSinkClass base_zcmlogsink_class;
+};
+
+GType gst_zcmlogsink_get_type (void);
+
+G_END_DECLS
+
+#endif
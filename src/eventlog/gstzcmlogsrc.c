@@ -0,0 +1,716 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-gstzcmlogsrc
+ * @title: zcmlogsrc
+ *
+ * ZcmLogSrc plays the image_t events of a zcm eventlog back into a pipeline,
+ * such as a log recorded by zcmlogsink or zcm-logger.
+ *
+ * The log is memory mapped and read ahead of playback, frames are copied
+ * into buffers from the pool negotiated downstream. Buffers are timestamped
+ * with the spacing the events were logged with, divided by rate, so a
+ * synchronizing sink plays the log back in its original or a scaled timing.
+ * With rate=0 buffers carry no timestamps and the log is played as fast as
+ * downstream takes it. Every buffer carries the event's log time as a
+ * "timestamp/x-unix" reference timestamp meta, and its event number as its
+ * offset.
+ *
+ * Seeks are answered through the time index zcmlogsink writes next to the
+ * log. For logs without one the index is built when the log is opened.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 -v zcmlogsrc location=camera.log channel=CAMERA ! videoconvert ! autovideosink
+ * ]|
+ * Plays back the CAMERA frames of camera.log as they were recorded
+ * |[
+ * gst-launch-1.0 -v zcmlogsrc location=camera.log channel=CAMERA rate=4 ! videoconvert ! autovideosink
+ * ]|
+ * Plays them back four times faster
+ * |[
+ * gst-launch-1.0 -v zcmlogsrc location=camera.log channel=CAMERA rate=0 ! videoconvert ! fakesink
+ * ]|
+ * Reprocesses the log as fast as the pipeline can
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesrc.h>
+#include <gst/video/video.h>
+#include "gstzcmlogsrc.h"
+#include "gstzcmformat.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_zcmlogsrc_debug_category);
+#define GST_CAT_DEFAULT gst_zcmlogsrc_debug_category
+
+#define DEFAULT_RATE 1.0
+#define DEFAULT_READAHEAD (64 * 1024 * 1024)
+
+/* prototypes */
+
+
+static void gst_zcmlogsrc_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_zcmlogsrc_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_zcmlogsrc_finalize (GObject * object);
+
+static gboolean gst_zcmlogsrc_start (GstBaseSrc * bsrc);
+static gboolean gst_zcmlogsrc_stop (GstBaseSrc * bsrc);
+static gboolean gst_zcmlogsrc_negotiate (GstBaseSrc * bsrc);
+static gboolean gst_zcmlogsrc_decide_allocation (GstBaseSrc * bsrc,
+    GstQuery * query);
+static gboolean gst_zcmlogsrc_is_seekable (GstBaseSrc * bsrc);
+static gboolean gst_zcmlogsrc_do_seek (GstBaseSrc * bsrc, GstSegment * segment);
+static gboolean gst_zcmlogsrc_query (GstBaseSrc * bsrc, GstQuery * query);
+static GstFlowReturn gst_zcmlogsrc_create (GstBaseSrc * bsrc, guint64 offset,
+    guint length, GstBuffer ** buf);
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_CHANNEL,
+  PROP_RATE,
+  PROP_READAHEAD,
+};
+
+/* pad templates */
+
+#define VIDEO_SRC_CAPS \
+    GST_VIDEO_CAPS_MAKE("{ UYVY, YUY2, IYU1, IYU2, I420, NV12, GRAY8," \
+                        " RGB, BGR, RGBA, BGRA, GRAY16_BE, GRAY16_LE," \
+                        " RGB16 }")
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+    "src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS(VIDEO_SRC_CAPS"; image/jpeg")
+);
+
+static GstStaticCaps unix_time_caps = GST_STATIC_CAPS("timestamp/x-unix");
+
+
+/* Private members */
+
+/* Points img at the image_t encoded in the datalen bytes at data, without
+ * copying the frame. img->stride must have room for GST_VIDEO_MAX_PLANES. */
+static gboolean
+decode_image (const guint8 * data, guint32 datalen,
+    zcm_gstreamer_plugins_image_t * img)
+{
+  const guint8* end = data + datalen;
+
+  // hash, utime, width, height, num_strides
+  if (datalen < 8 + 8 + 4 + 4 + 1) return FALSE;
+  if ((int64_t) GST_READ_UINT64_BE(data) != __zcm_gstreamer_plugins_image_t_get_hash()) {
+    return FALSE;
+  }
+  const guint8* p = data + 8;
+
+  img->utime = GST_READ_UINT64_BE(p);
+  img->width = GST_READ_UINT32_BE(p + 8);
+  img->height = GST_READ_UINT32_BE(p + 12);
+  img->num_strides = (int8_t) p[16];
+  p += 17;
+
+  if (img->num_strides < 0 || img->num_strides > GST_VIDEO_MAX_PLANES) return FALSE;
+  if (end - p < 4 * img->num_strides + 8) return FALSE;
+  for (size_t i = 0; i < img->num_strides; ++i) {
+    img->stride[i] = GST_READ_UINT32_BE(p);
+    p += 4;
+  }
+
+  img->pixelformat = GST_READ_UINT32_BE(p);
+  img->size = GST_READ_UINT32_BE(p + 4);
+  p += 8;
+
+  if (img->size < 0 || end - p < img->size) return FALSE;
+  img->data = (uint8_t*) p;
+
+  return TRUE;
+}
+
+/* Finds the first image_t event on the channel at or after offset and sets
+ * *next to the offset of the event following it */
+static gboolean
+find_image (GstZcmLogSrc * zcmlogsrc, guint64 offset,
+    GstZcmEventLogHeader * header, zcm_gstreamer_plugins_image_t * img,
+    guint64 * next)
+{
+  while (offset + GST_ZCM_EVENTLOG_HEADER_SIZE <= zcmlogsrc->log_size) {
+    if (!gst_zcm_eventlog_read_header(zcmlogsrc->log + offset, header)) {
+      GST_WARNING_OBJECT(zcmlogsrc, "No event at offset %" G_GUINT64_FORMAT,
+                         offset);
+      return FALSE;
+    }
+
+    const guint8* channel = zcmlogsrc->log + offset + GST_ZCM_EVENTLOG_HEADER_SIZE;
+    guint64 end = offset + GST_ZCM_EVENTLOG_HEADER_SIZE +
+                  header->channellen + header->datalen;
+    if (end > zcmlogsrc->log_size) return FALSE;  // cut short while recording
+    offset = end;
+
+    if (zcmlogsrc->channel->len > 0 &&
+        (header->channellen != zcmlogsrc->channel->len ||
+         memcmp(channel, zcmlogsrc->channel->str, header->channellen) != 0)) {
+      continue;
+    }
+    if (!decode_image(channel + header->channellen, header->datalen, img)) {
+      continue;
+    }
+
+    *next = offset;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Asks for the next readahead bytes of the log once half of what was asked
+ * for before has been played */
+static void
+readahead (GstZcmLogSrc * zcmlogsrc)
+{
+  if (zcmlogsrc->readahead == 0) return;
+  if (zcmlogsrc->offset + zcmlogsrc->readahead / 2 < zcmlogsrc->advised) return;
+
+  guint64 start = MAX(zcmlogsrc->advised, zcmlogsrc->offset) &
+                  ~((guint64) zcmlogsrc->page_size - 1);
+  guint64 end = MIN(zcmlogsrc->offset + zcmlogsrc->readahead,
+                    zcmlogsrc->log_size);
+  if (end <= start) return;
+
+  madvise((void*) (zcmlogsrc->log + start), end - start, MADV_WILLNEED);
+  zcmlogsrc->advised = end;
+}
+
+static gdouble
+time_scale (GstZcmLogSrc * zcmlogsrc)
+{
+  return zcmlogsrc->rate > 0 ? zcmlogsrc->rate : 1.0;
+}
+
+/* Playback time of a log timestamp, in nanoseconds from the first event */
+static GstClockTime
+playback_time (GstZcmLogSrc * zcmlogsrc, gint64 timestamp)
+{
+  if (timestamp <= zcmlogsrc->first_timestamp) return 0;
+  return (GstClockTime) ((timestamp - zcmlogsrc->first_timestamp) *
+                         GST_USECOND / time_scale(zcmlogsrc));
+}
+
+static gint64
+log_timestamp (GstZcmLogSrc * zcmlogsrc, GstClockTime playback)
+{
+  return zcmlogsrc->first_timestamp +
+         (gint64) (playback * time_scale(zcmlogsrc) / GST_USECOND);
+}
+
+static GstCaps *
+caps_for_image (const zcm_gstreamer_plugins_image_t * img, GstVideoInfo * info)
+{
+  if (img->pixelformat == ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_MJPEG) {
+    return gst_caps_new_simple("image/jpeg",
+                               "width", G_TYPE_INT, img->width,
+                               "height", G_TYPE_INT, img->height,
+                               "framerate", GST_TYPE_FRACTION, 0, 1, NULL);
+  }
+
+  GstVideoFormat format = gst_zcm_format_from_pixelformat(img->pixelformat);
+  if (format == GST_VIDEO_FORMAT_UNKNOWN) return NULL;
+
+  gst_video_info_set_format(info, format, img->width, img->height);
+  info->fps_n = 0;
+  info->fps_d = 1;
+  return gst_video_info_to_caps(info);
+}
+
+/* Sets the caps of img's format on the source pad, unless they are set
+ * already */
+static gboolean
+update_caps (GstZcmLogSrc * zcmlogsrc, const zcm_gstreamer_plugins_image_t * img)
+{
+  if (img->width == zcmlogsrc->width && img->height == zcmlogsrc->height &&
+      img->pixelformat == zcmlogsrc->pixelformat) {
+    return TRUE;
+  }
+
+  GstVideoInfo info;
+  gst_video_info_init(&info);
+  GstCaps* caps = caps_for_image(img, &info);
+  if (!caps) {
+    GST_ELEMENT_ERROR (zcmlogsrc, STREAM, FORMAT,
+        ("Unsupported pixel format 0x%08x", img->pixelformat), (NULL));
+    return FALSE;
+  }
+
+  gboolean ok = gst_base_src_set_caps(GST_BASE_SRC(zcmlogsrc), caps);
+  gst_caps_unref(caps);
+  if (!ok) return FALSE;
+
+  zcmlogsrc->width = img->width;
+  zcmlogsrc->height = img->height;
+  zcmlogsrc->pixelformat = img->pixelformat;
+  zcmlogsrc->info = info;
+  zcmlogsrc->raw = img->pixelformat != ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_MJPEG;
+
+  return TRUE;
+}
+
+/* Describes the recorded strides when they are not the ones the caps imply */
+static void
+add_video_meta (GstZcmLogSrc * zcmlogsrc, GstBuffer * buf,
+    const zcm_gstreamer_plugins_image_t * img)
+{
+  GstVideoInfo* info = &zcmlogsrc->info;
+  if (!zcmlogsrc->raw || img->num_strides != GST_VIDEO_INFO_N_PLANES(info)) return;
+
+  gboolean same = TRUE;
+  for (size_t i = 0; i < img->num_strides; ++i) {
+    if (img->stride[i] != GST_VIDEO_INFO_PLANE_STRIDE(info, i)) same = FALSE;
+  }
+  if (same) return;
+
+  gsize offset[GST_VIDEO_MAX_PLANES];
+  gint stride[GST_VIDEO_MAX_PLANES];
+  gsize plane = 0;
+  for (size_t i = 0; i < img->num_strides; ++i) {
+    offset[i] = plane;
+    stride[i] = img->stride[i];
+    plane += (gsize) stride[i] *
+             GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT(info->finfo, i, img->height);
+  }
+
+  gst_buffer_add_video_meta_full(buf, GST_VIDEO_FRAME_FLAG_NONE,
+                                 GST_VIDEO_INFO_FORMAT(info),
+                                 img->width, img->height, img->num_strides,
+                                 offset, stride);
+}
+
+static void
+close_log (GstZcmLogSrc * zcmlogsrc)
+{
+  if (zcmlogsrc->log) munmap((void*) zcmlogsrc->log, zcmlogsrc->log_size);
+  zcmlogsrc->log = NULL;
+  zcmlogsrc->log_size = 0;
+  gst_zcm_eventlog_index_clear(&zcmlogsrc->index);
+}
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstZcmLogSrc, gst_zcmlogsrc, GST_TYPE_BASE_SRC,
+    GST_DEBUG_CATEGORY_INIT (gst_zcmlogsrc_debug_category, "zcmlogsrc", 0,
+        "debug category for zcmlogsrc element"));
+
+static void
+gst_zcmlogsrc_class_init (GstZcmLogSrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstBaseSrcClass *gstbasesrc_class = GST_BASE_SRC_CLASS (klass);
+
+  gst_element_class_add_pad_template(GST_ELEMENT_CLASS (klass),
+          gst_static_pad_template_get(&src_template));
+
+  gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
+      "ZcmLogSrc", "Source/File",
+      "Plays frames from a zcm eventlog back into a pipeline",
+      "ZeroCM Team <www.zcm-project.org>");
+
+  gstbasesrc_class->start = GST_DEBUG_FUNCPTR (gst_zcmlogsrc_start);
+  gstbasesrc_class->stop = GST_DEBUG_FUNCPTR (gst_zcmlogsrc_stop);
+  gstbasesrc_class->negotiate = GST_DEBUG_FUNCPTR (gst_zcmlogsrc_negotiate);
+  gstbasesrc_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_zcmlogsrc_decide_allocation);
+  gstbasesrc_class->is_seekable = GST_DEBUG_FUNCPTR (gst_zcmlogsrc_is_seekable);
+  gstbasesrc_class->do_seek = GST_DEBUG_FUNCPTR (gst_zcmlogsrc_do_seek);
+  gstbasesrc_class->query = GST_DEBUG_FUNCPTR (gst_zcmlogsrc_query);
+  gstbasesrc_class->create = GST_DEBUG_FUNCPTR (gst_zcmlogsrc_create);
+  gobject_class->set_property = gst_zcmlogsrc_set_property;
+  gobject_class->get_property = gst_zcmlogsrc_get_property;
+  gobject_class->finalize = gst_zcmlogsrc_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+          g_param_spec_string ("location", "Eventlog location",
+              "Path of the eventlog to play back",
+              "", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CHANNEL,
+          g_param_spec_string ("channel", "Zcm channel",
+              "Channel to play the image_t events of (empty plays the image_t "
+              "events of every channel)",
+              "GSTREAMER_DATA", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RATE,
+          g_param_spec_double ("rate", "Playback rate",
+              "Speed up (or slow down) the logged timing by this factor, 0 "
+              "leaves buffers untimestamped to play as fast as possible",
+              0, G_MAXDOUBLE, DEFAULT_RATE,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_READAHEAD,
+          g_param_spec_uint64 ("readahead", "Readahead",
+              "Bytes of the log to have read in ahead of playback (0 leaves "
+              "it to the kernel)",
+              0, G_MAXUINT64, DEFAULT_READAHEAD,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_zcmlogsrc_init (GstZcmLogSrc * zcmlogsrc)
+{
+  zcmlogsrc->log = NULL;
+  zcmlogsrc->log_size = 0;
+  memset(&zcmlogsrc->index, 0, sizeof(zcmlogsrc->index));
+  zcmlogsrc->offset = 0;
+  zcmlogsrc->advised = 0;
+  zcmlogsrc->width = -1;
+  zcmlogsrc->height = -1;
+  zcmlogsrc->pixelformat = -1;
+  zcmlogsrc->raw = FALSE;
+
+  zcmlogsrc->location = g_string_new("");
+  zcmlogsrc->channel = g_string_new("GSTREAMER_DATA");
+  zcmlogsrc->rate = DEFAULT_RATE;
+  zcmlogsrc->readahead = DEFAULT_READAHEAD;
+
+  gst_base_src_set_format (GST_BASE_SRC (zcmlogsrc), GST_FORMAT_TIME);
+}
+
+void
+gst_zcmlogsrc_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstZcmLogSrc *zcmlogsrc = GST_ZCMLOGSRC (object);
+
+  GST_DEBUG_OBJECT (zcmlogsrc, "set_property");
+
+  switch (property_id) {
+    case PROP_LOCATION:
+      g_string_assign (zcmlogsrc->location, g_value_get_string (value));
+      break;
+    case PROP_CHANNEL:
+      g_string_assign (zcmlogsrc->channel, g_value_get_string (value));
+      break;
+    case PROP_RATE:
+      zcmlogsrc->rate = g_value_get_double (value);
+      break;
+    case PROP_READAHEAD:
+      zcmlogsrc->readahead = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_zcmlogsrc_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstZcmLogSrc *zcmlogsrc = GST_ZCMLOGSRC (object);
+
+  GST_DEBUG_OBJECT (zcmlogsrc, "get_property");
+
+  switch (property_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, zcmlogsrc->location->str);
+      break;
+    case PROP_CHANNEL:
+      g_value_set_string (value, zcmlogsrc->channel->str);
+      break;
+    case PROP_RATE:
+      g_value_set_double (value, zcmlogsrc->rate);
+      break;
+    case PROP_READAHEAD:
+      g_value_set_uint64 (value, zcmlogsrc->readahead);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_zcmlogsrc_finalize (GObject * object)
+{
+  GstZcmLogSrc *zcmlogsrc = GST_ZCMLOGSRC (object);
+
+  GST_DEBUG_OBJECT (zcmlogsrc, "finalize");
+
+  close_log(zcmlogsrc);
+  g_string_free(zcmlogsrc->location, TRUE);
+  g_string_free(zcmlogsrc->channel, TRUE);
+
+  G_OBJECT_CLASS (gst_zcmlogsrc_parent_class)->finalize (object);
+}
+
+static gboolean
+gst_zcmlogsrc_start (GstBaseSrc * bsrc)
+{
+  GstZcmLogSrc *zcmlogsrc = GST_ZCMLOGSRC (bsrc);
+
+  GST_DEBUG_OBJECT (zcmlogsrc, "start");
+
+  int fd = open(zcmlogsrc->location->str, O_RDONLY);
+  if (fd < 0) {
+    GST_ELEMENT_ERROR (zcmlogsrc, RESOURCE, OPEN_READ,
+        ("Could not open %s", zcmlogsrc->location->str), GST_ERROR_SYSTEM);
+    return FALSE;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    GST_ELEMENT_ERROR (zcmlogsrc, RESOURCE, OPEN_READ,
+        ("Could not stat %s", zcmlogsrc->location->str), GST_ERROR_SYSTEM);
+    close(fd);
+    return FALSE;
+  }
+
+  zcmlogsrc->log_size = st.st_size;
+  if (zcmlogsrc->log_size > 0) {
+    void* log = mmap(NULL, zcmlogsrc->log_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (log == MAP_FAILED) {
+      GST_ELEMENT_ERROR (zcmlogsrc, RESOURCE, OPEN_READ,
+          ("Could not map %s", zcmlogsrc->location->str), GST_ERROR_SYSTEM);
+      close(fd);
+      zcmlogsrc->log_size = 0;
+      return FALSE;
+    }
+    zcmlogsrc->log = log;
+    madvise(log, zcmlogsrc->log_size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  char* index_path = g_strconcat(zcmlogsrc->location->str,
+                                 GST_ZCM_EVENTLOG_INDEX_SUFFIX, NULL);
+  if (!gst_zcm_eventlog_index_open(&zcmlogsrc->index, index_path)) {
+    GST_INFO_OBJECT (zcmlogsrc, "No index at %s, scanning the log", index_path);
+    gst_zcm_eventlog_index_scan(&zcmlogsrc->index, zcmlogsrc->log,
+                                zcmlogsrc->log_size);
+  }
+  g_free(index_path);
+
+  if (zcmlogsrc->index.n_entries > 0) {
+    zcmlogsrc->first_timestamp = zcmlogsrc->index.entries[0].timestamp;
+    zcmlogsrc->last_timestamp =
+        zcmlogsrc->index.entries[zcmlogsrc->index.n_entries - 1].timestamp;
+  } else {
+    zcmlogsrc->first_timestamp = 0;
+    zcmlogsrc->last_timestamp = 0;
+  }
+
+  zcmlogsrc->page_size = sysconf(_SC_PAGESIZE);
+  zcmlogsrc->offset = 0;
+  zcmlogsrc->advised = 0;
+  zcmlogsrc->width = -1;
+  zcmlogsrc->height = -1;
+  zcmlogsrc->pixelformat = -1;
+  readahead(zcmlogsrc);
+
+  return TRUE;
+}
+
+static gboolean
+gst_zcmlogsrc_stop (GstBaseSrc * bsrc)
+{
+  GstZcmLogSrc *zcmlogsrc = GST_ZCMLOGSRC (bsrc);
+
+  GST_DEBUG_OBJECT (zcmlogsrc, "stop");
+
+  close_log(zcmlogsrc);
+
+  return TRUE;
+}
+
+/* The caps come from the next frame to be played rather than from a caps
+ * query, allocation is then decided for them */
+static gboolean
+gst_zcmlogsrc_negotiate (GstBaseSrc * bsrc)
+{
+  GstZcmLogSrc *zcmlogsrc = GST_ZCMLOGSRC (bsrc);
+
+  GstZcmEventLogHeader header;
+  zcm_gstreamer_plugins_image_t img;
+  int32_t stride[GST_VIDEO_MAX_PLANES];
+  img.stride = stride;
+  guint64 next;
+
+  // Nothing left to play, create() reports EOS
+  if (!find_image(zcmlogsrc, zcmlogsrc->offset, &header, &img, &next)) return TRUE;
+
+  return update_caps(zcmlogsrc, &img);
+}
+
+static gboolean
+gst_zcmlogsrc_decide_allocation (GstBaseSrc * bsrc, GstQuery * query)
+{
+  GstZcmLogSrc *zcmlogsrc = GST_ZCMLOGSRC (bsrc);
+
+  GstCaps* caps;
+  gst_query_parse_allocation(query, &caps, NULL);
+
+  // Raw frames are all the same size, pool them. JPEG frames are not.
+  GstVideoInfo info;
+  if (caps && zcmlogsrc->raw && gst_video_info_from_caps(&info, caps)) {
+    GstBufferPool* pool = NULL;
+    guint size = 0, min = 0, max = 0;
+    gboolean update = gst_query_get_n_allocation_pools(query) > 0;
+    if (update) {
+      gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &min, &max);
+    }
+    if (!pool) pool = gst_video_buffer_pool_new();
+    size = MAX(size, info.size);
+
+    GstStructure* config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, caps, size, min, max);
+    gst_buffer_pool_set_config(pool, config);
+
+    if (update) gst_query_set_nth_allocation_pool(query, 0, pool, size, min, max);
+    else gst_query_add_allocation_pool(query, pool, size, min, max);
+    gst_object_unref(pool);
+  }
+
+  return GST_BASE_SRC_CLASS (gst_zcmlogsrc_parent_class)->decide_allocation (bsrc, query);
+}
+
+static gboolean
+gst_zcmlogsrc_is_seekable (GstBaseSrc * bsrc)
+{
+  return TRUE;
+}
+
+/* Seek positions are playback times, scaled by rate like the timestamps */
+static gboolean
+gst_zcmlogsrc_do_seek (GstBaseSrc * bsrc, GstSegment * segment)
+{
+  GstZcmLogSrc *zcmlogsrc = GST_ZCMLOGSRC (bsrc);
+
+  if (segment->rate < 0) {
+    GST_WARNING_OBJECT (zcmlogsrc, "Reverse playback is not supported");
+    return FALSE;
+  }
+
+  gint64 timestamp = log_timestamp(zcmlogsrc, segment->start);
+  gsize entry = gst_zcm_eventlog_index_lookup(&zcmlogsrc->index, timestamp);
+  zcmlogsrc->offset = entry < zcmlogsrc->index.n_entries ?
+                      zcmlogsrc->index.entries[entry].offset : zcmlogsrc->log_size;
+  zcmlogsrc->advised = zcmlogsrc->offset;
+  readahead(zcmlogsrc);
+
+  GST_DEBUG_OBJECT (zcmlogsrc, "Seeked to %" GST_TIME_FORMAT ", event %" G_GSIZE_FORMAT,
+                    GST_TIME_ARGS (segment->start), entry);
+
+  segment->time = segment->start;
+  segment->position = segment->start;
+
+  return TRUE;
+}
+
+static gboolean
+gst_zcmlogsrc_query (GstBaseSrc * bsrc, GstQuery * query)
+{
+  GstZcmLogSrc *zcmlogsrc = GST_ZCMLOGSRC (bsrc);
+
+  if (GST_QUERY_TYPE (query) == GST_QUERY_DURATION &&
+      zcmlogsrc->index.n_entries > 0) {
+    GstFormat format;
+    gst_query_parse_duration (query, &format, NULL);
+    if (format == GST_FORMAT_TIME) {
+      gst_query_set_duration (query, format,
+          playback_time (zcmlogsrc, zcmlogsrc->last_timestamp));
+      return TRUE;
+    }
+  }
+
+  return GST_BASE_SRC_CLASS (gst_zcmlogsrc_parent_class)->query (bsrc, query);
+}
+
+static GstFlowReturn
+gst_zcmlogsrc_create (GstBaseSrc * bsrc, guint64 offset, guint length,
+    GstBuffer ** buf)
+{
+  GstZcmLogSrc *zcmlogsrc = GST_ZCMLOGSRC (bsrc);
+
+  GstZcmEventLogHeader header;
+  zcm_gstreamer_plugins_image_t img;
+  int32_t stride[GST_VIDEO_MAX_PLANES];
+  img.stride = stride;
+  guint64 next;
+
+  if (!find_image(zcmlogsrc, zcmlogsrc->offset, &header, &img, &next)) {
+    return GST_FLOW_EOS;
+  }
+
+  GstClockTime position = playback_time(zcmlogsrc, header.timestamp);
+  if (GST_CLOCK_TIME_IS_VALID (bsrc->segment.stop) &&
+      position >= bsrc->segment.stop) {
+    return GST_FLOW_EOS;
+  }
+
+  zcmlogsrc->offset = next;
+  readahead(zcmlogsrc);
+
+  // The log changed format, allocation is decided again for the next frame
+  if (img.width != zcmlogsrc->width || img.height != zcmlogsrc->height ||
+      img.pixelformat != zcmlogsrc->pixelformat) {
+    if (!update_caps(zcmlogsrc, &img)) return GST_FLOW_NOT_NEGOTIATED;
+    gst_pad_mark_reconfigure(GST_BASE_SRC_PAD (bsrc));
+  }
+
+  // Pool buffers fit the negotiated format, anything else gets its own
+  GstBuffer* out = NULL;
+  GstFlowReturn ret = GST_BASE_SRC_CLASS (gst_zcmlogsrc_parent_class)->alloc (
+      bsrc, -1, img.size, &out);
+  if (ret != GST_FLOW_OK) return ret;
+  if (gst_buffer_get_size(out) < img.size) {
+    gst_buffer_unref(out);
+    out = gst_buffer_new_allocate(NULL, img.size, NULL);
+  }
+  gst_buffer_set_size(out, img.size);
+  gst_buffer_fill(out, 0, img.data, img.size);
+  add_video_meta(zcmlogsrc, out, &img);
+
+  GST_BUFFER_OFFSET (out) = header.eventnum;
+  if (zcmlogsrc->rate > 0) {
+    GST_BUFFER_PTS (out) = position;
+  }
+
+  GstCaps* unix_time = gst_static_caps_get(&unix_time_caps);
+  gst_buffer_add_reference_timestamp_meta(out, unix_time,
+      header.timestamp * GST_USECOND, GST_CLOCK_TIME_NONE);
+  gst_caps_unref(unix_time);
+
+  *buf = out;
+  return GST_FLOW_OK;
+}
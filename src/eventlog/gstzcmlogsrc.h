@@ -0,0 +1,80 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMLOGSRC_H_
+#define _GST_ZCMLOGSRC_H_
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesrc.h>
+#include <gst/video/video.h>
+
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_image_t.h"
+
+#include "gstzcmeventlog.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ZCMLOGSRC (gst_zcmlogsrc_get_type())
+#define GST_ZCMLOGSRC(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ZCMLOGSRC,GstZcmLogSrc))
+#define GST_ZCMLOGSRC_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ZCMLOGSRC,GstZcmLogSrcClass))
+#define GST_IS_ZCMLOGSRC(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ZCMLOGSRC))
+#define GST_IS_ZCMLOGSRC_CLASS(obj) (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ZCMLOGSRC))
+
+typedef struct _GstZcmLogSrc GstZcmLogSrc;
+typedef struct _GstZcmLogSrcClass GstZcmLogSrcClass;
+
+struct _GstZcmLogSrc
+{
+  GstBaseSrc base_zcmlogsrc;
+
+  // Privates
+  const guint8* log;
+  gsize log_size;
+  gsize page_size;
+  GstZcmEventLogIndex index;
+  gint64 first_timestamp;
+  gint64 last_timestamp;
+
+  guint64 offset;   // of the next event to read
+  guint64 advised;  // end of what readahead was requested for
+
+  // Of the caps last set on the source pad
+  gint32 width;
+  gint32 height;
+  gint32 pixelformat;
+  GstVideoInfo info;
+  gboolean raw;
+
+  // Properties
+  GString* location;
+  GString* channel;
+  gdouble rate;
+  guint64 readahead;
+};
+
+struct _GstZcmLogSrcClass
+{
+  GstBaseSrcClass base_zcmlogsrc_class;
+};
+
+GType gst_zcmlogsrc_get_type (void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,73 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:plugin-zcm
+ *
+ * A single plugin registering every zcm element, so they are scanned and
+ * loaded once and share the transport pool and format tables in src/common.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+
+#include "imagesink/gstzcmimagesink.h"
+#include "imagesrc/gstzcmimagesrc.h"
+#include "snap/gstzcmsnap.h"
+#include "multifilesink/gstzcmmultifilesink.h"
+#include "eventlog/gstzcmlogsink.h"
+#include "eventlog/gstzcmlogsrc.h"
+
+static gboolean
+plugin_init (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, "zcmimagesink", GST_RANK_NONE,
+          GST_TYPE_ZCMIMAGESINK) &&
+      gst_element_register (plugin, "zcmimagesrc", GST_RANK_NONE,
+          GST_TYPE_ZCMIMAGESRC) &&
+      gst_element_register (plugin, "zcmsnap", GST_RANK_NONE,
+          GST_TYPE_ZCM_SNAP) &&
+      gst_element_register (plugin, "zcmmultifilesink", GST_RANK_NONE,
+          GST_TYPE_ZCM_MULTIFILESINK) &&
+      gst_element_register (plugin, "zcmlogsink", GST_RANK_NONE,
+          GST_TYPE_ZCMLOGSINK) &&
+      gst_element_register (plugin, "zcmlogsrc", GST_RANK_NONE,
+          GST_TYPE_ZCMLOGSRC);
+}
+
+#ifndef VERSION
+#define VERSION "1.0.0"
+#endif
+#ifndef PACKAGE
+#define PACKAGE "ZeroCM"
+#endif
+#ifndef PACKAGE_NAME
+#define PACKAGE_NAME "zcm-gstreamer-plugins"
+#endif
+#ifndef GST_PACKAGE_ORIGIN
+#define GST_PACKAGE_ORIGIN "https://github.com/ZeroCM/zcm-gstreamer-plugins"
+#endif
+
+GST_PLUGIN_DEFINE (GST_VERSION_MAJOR,
+    GST_VERSION_MINOR,
+    zcm,
+    "Moves frames between pipelines over zcm transports, files and eventlogs",
+    plugin_init, VERSION, "LGPL", PACKAGE_NAME, GST_PACKAGE_ORIGIN)
@@ -28,6 +28,33 @@
  * gst-launch-1.0 -v fakesrc ! zcmimagesink
  * ]|
  * Sinks fake data into the zcm transport defined by ZCM_DEFAULT_URL
+ * |[
+ * gst-launch-1.0 -v videotestsrc ! video/x-raw,width=160,height=120,framerate=400/1 ! zcmimagesink batch-frames=8
+ * ]|
+ * Publishes image_batch_t messages holding 8 frames each, pair with zcmimagesrc batched=true
+ * |[
+ * gst-launch-1.0 -v v4l2src ! videoconvert ! zcmimagesink stats-channel=CAMERA_STATS
+ * ]|
+ * Also publishes an image_stats_t (histograms, mean / min / max, sharpness)
+ * for every frame on CAMERA_STATS
+ * |[
+ * gst-launch-1.0 -v v4l2src ! videoconvert ! x264enc tune=zerolatency ! h264parse ! zcmimagesink channel=CAMERA_H264
+ * ]|
+ * Publishes the compressed stream as encoded_image_t messages, one access
+ * unit each. keyframe_request_t messages for CAMERA_H264 received on
+ * keyframe-channel (from a zcmimagesrc with encoded=true that joined late)
+ * have the encoder produce a keyframe.
+ * |[
+ * gst-launch-1.0 -v v4l2src ! videoconvert ! zcmimagesink channel=CAMERA latched=true
+ * ]|
+ * Keeps the last frame and publishes it to any zcmimagesrc that starts
+ * listening to CAMERA (via a latest_request_t on latest-channel), so the
+ * receiver prerolls at once however slowly frames are published.
+ * |[
+ * gst-launch-1.0 -v videotestsrc ! video/x-raw,width=3840,height=2160 ! zcmimagesink hugepages=true
+ * ]|
+ * Offers upstream a pool of huge page backed buffers to render frames into,
+ * so publishing 4K frames out of them takes fewer TLB misses and page faults
  * </refsect2>
  */
 
@@ -39,6 +66,10 @@
 #include <gst/video/video.h>
 #include <gst/video/gstvideosink.h>
 #include "gstzcmimagesink.h"
+#include "gstzcmtransport.h"
+#include "gstzcmformat.h"
+#include "gstzcmhugepage.h"
+#include "gstzcmtime.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_zcmimagesink_debug_category);
 #define GST_CAT_DEFAULT gst_zcmimagesink_debug_category
@@ -53,6 +84,10 @@ static void gst_zcmimagesink_get_property (GObject * object,
 static void gst_zcmimagesink_dispose (GObject * object);
 static void gst_zcmimagesink_finalize (GObject * object);
 
+static gboolean gst_zcmimagesink_stop (GstBaseSink * bsink);
+static gboolean gst_zcmimagesink_event (GstBaseSink * bsink, GstEvent * event);
+static gboolean gst_zcmimagesink_propose_allocation (GstBaseSink * bsink,
+    GstQuery * query);
 static GstFlowReturn gst_zcmimagesink_show_frame (GstVideoSink * video_sink,
     GstBuffer * buf);
 
@@ -61,8 +96,18 @@ enum
   PROP_0,
   PROP_CHANNEL,
   PROP_ZCM_URL,
+  PROP_BATCH_FRAMES,
+  PROP_BATCH_US,
+  PROP_STATS_CHANNEL,
+  PROP_KEYFRAME_CHANNEL,
+  PROP_LATCHED,
+  PROP_LATEST_CHANNEL,
+  PROP_HUGEPAGES,
 };
 
+// Keyframe requests arriving closer together than this are answered once
+#define KEYFRAME_REQUEST_INTERVAL_US (500 * 1000)
+
 /* pad templates */
 /*
     UYVY
@@ -89,21 +134,436 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
     "sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS(VIDEO_SINK_CAPS"; image/jpeg")
+    GST_STATIC_CAPS(VIDEO_SINK_CAPS"; image/jpeg; "
+        "video/x-h264, stream-format = (string) { byte-stream, avc }, "
+        "alignment = (string) au; "
+        "video/x-h265, stream-format = (string) { byte-stream, hvc1 }, "
+        "alignment = (string) au")
 );
 
 
 /* Private members */
 
+/* Asks upstream (the encoder) for a keyframe on behalf of a receiver */
+static void
+keyframe_request_handler (const zcm_recv_buf_t * rbuf, const char * channel,
+    const zcm_gstreamer_plugins_keyframe_request_t * req, void * user)
+{
+  GstZcmImageSink *zcmimagesink = (GstZcmImageSink *) user;
+
+  if (g_strcmp0 (req->channel, zcmimagesink->channel->str) != 0) return;
+
+  gint64 now = g_get_monotonic_time ();
+  GST_OBJECT_LOCK (zcmimagesink);
+  gboolean request = zcmimagesink->encoded &&
+      now - zcmimagesink->last_keyframe_request >= KEYFRAME_REQUEST_INTERVAL_US;
+  if (request) zcmimagesink->last_keyframe_request = now;
+  GST_OBJECT_UNLOCK (zcmimagesink);
+  if (!request) return;
+
+  GST_DEBUG_OBJECT (zcmimagesink, "requesting a keyframe");
+  gst_pad_push_event (GST_BASE_SINK_PAD (zcmimagesink),
+      gst_video_event_new_upstream_force_key_unit (GST_CLOCK_TIME_NONE, TRUE, 0));
+}
+
+static void
+subscribe_keyframe_requests (GstZcmImageSink * zcmimagesink)
+{
+  if (!zcmimagesink->zcm) return;
+
+  if (zcmimagesink->keyframe_sub) {
+    zcm_gstreamer_plugins_keyframe_request_t_unsubscribe (zcmimagesink->zcm,
+        zcmimagesink->keyframe_sub);
+    zcmimagesink->keyframe_sub = NULL;
+  }
+
+  if (zcmimagesink->keyframe_channel->len > 0) {
+    zcmimagesink->keyframe_sub = zcm_gstreamer_plugins_keyframe_request_t_subscribe (
+        zcmimagesink->zcm, zcmimagesink->keyframe_channel->str,
+        &keyframe_request_handler, zcmimagesink);
+  }
+}
+
+/* Sends the latched frame to a receiver that just started */
+static void
+latest_request_handler (const zcm_recv_buf_t * rbuf, const char * channel,
+    const zcm_gstreamer_plugins_latest_request_t * req, void * user)
+{
+  GstZcmImageSink *zcmimagesink = (GstZcmImageSink *) user;
+
+  if (g_strcmp0 (req->channel, zcmimagesink->channel->str) != 0) return;
+
+  g_mutex_lock (&zcmimagesink->latch_lock);
+  if (zcmimagesink->latched_img.data) {
+    GST_DEBUG_OBJECT (zcmimagesink, "sending the latched frame to %s",
+        req->reply_channel);
+    zcm_gstreamer_plugins_image_t_publish (zcmimagesink->zcm,
+        req->reply_channel, &zcmimagesink->latched_img);
+  }
+  g_mutex_unlock (&zcmimagesink->latch_lock);
+}
+
+static void
+subscribe_latest_requests (GstZcmImageSink * zcmimagesink)
+{
+  if (!zcmimagesink->zcm) return;
+
+  if (zcmimagesink->latest_sub) {
+    zcm_gstreamer_plugins_latest_request_t_unsubscribe (zcmimagesink->zcm,
+        zcmimagesink->latest_sub);
+    zcmimagesink->latest_sub = NULL;
+  }
+
+  if (zcmimagesink->latched && zcmimagesink->latest_channel->len > 0) {
+    zcmimagesink->latest_sub = zcm_gstreamer_plugins_latest_request_t_subscribe (
+        zcmimagesink->zcm, zcmimagesink->latest_channel->str,
+        &latest_request_handler, zcmimagesink);
+  }
+}
+
+/* The transport is shared with other elements on the same url, so our
+ * subscriptions go before our reference to it */
+static void
+release_zcm (GstZcmImageSink * zcmimagesink)
+{
+  if (!zcmimagesink->zcm) return;
+
+  if (zcmimagesink->keyframe_sub) {
+    zcm_gstreamer_plugins_keyframe_request_t_unsubscribe (zcmimagesink->zcm,
+        zcmimagesink->keyframe_sub);
+    zcmimagesink->keyframe_sub = NULL;
+  }
+  if (zcmimagesink->latest_sub) {
+    zcm_gstreamer_plugins_latest_request_t_unsubscribe (zcmimagesink->zcm,
+        zcmimagesink->latest_sub);
+    zcmimagesink->latest_sub = NULL;
+  }
+
+  gst_zcm_transport_release (zcmimagesink->zcm);
+  zcmimagesink->zcm = NULL;
+}
+
 static void
 reinit_zcm (GstZcmImageSink * zcmimagesink)
 {
+  release_zcm (zcmimagesink);
+  zcmimagesink->zcm = gst_zcm_transport_acquire (zcmimagesink->url->str);
+  subscribe_keyframe_requests (zcmimagesink);
+  subscribe_latest_requests (zcmimagesink);
+}
+
+static inline gboolean
+batching_enabled (GstZcmImageSink * zcmimagesink)
+{
+  return zcmimagesink->batch_frames > 1 || zcmimagesink->batch_us > 0;
+}
+
+/* Copies frame as the one to answer latest requests with */
+static void
+latch_frame (GstZcmImageSink * zcmimagesink, GstBuffer * buf,
+    GstVideoFrame * frame)
+{
+  GstMapInfo info;
+  if (!gst_buffer_map (buf, &info, GST_MAP_READ)) {
+    GST_WARNING_OBJECT (zcmimagesink, "could not map buffer info");
+    return;
+  }
+
+  g_mutex_lock (&zcmimagesink->latch_lock);
+
+  if (zcmimagesink->latched_capacity < info.size) {
+    g_free (zcmimagesink->latched_data);
+    zcmimagesink->latched_data = g_malloc (info.size);
+    zcmimagesink->latched_capacity = info.size;
+  }
+  memcpy (zcmimagesink->latched_data, info.data, info.size);
+
+  zcm_gstreamer_plugins_image_t *img = &zcmimagesink->latched_img;
+  *img = zcmimagesink->img;
+  img->utime = gst_zcm_buffer_utime (GST_BASE_SINK (zcmimagesink), buf);
+  img->num_strides = GST_VIDEO_FRAME_N_PLANES (frame);
+  img->stride = zcmimagesink->latched_stride;
+  for (size_t i = 0; i < img->num_strides; ++i) {
+    img->stride[i] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, i);
+  }
+  img->size = info.size;
+  img->data = zcmimagesink->latched_data;
+
+  g_mutex_unlock (&zcmimagesink->latch_lock);
+
+  gst_buffer_unmap (buf, &info);
+}
+
+static void
+drop_latched_frame (GstZcmImageSink * zcmimagesink)
+{
+  g_mutex_lock (&zcmimagesink->latch_lock);
+  g_free (zcmimagesink->latched_data);
+  zcmimagesink->latched_data = NULL;
+  zcmimagesink->latched_capacity = 0;
+  zcmimagesink->latched_img.size = 0;
+  zcmimagesink->latched_img.data = NULL;
+  g_mutex_unlock (&zcmimagesink->latch_lock);
+}
+
+/* Called with batch_lock held */
+static void
+publish_batch (GstZcmImageSink * zcmimagesink)
+{
+  if (zcmimagesink->batch_len == 0) return;
+
   if (zcmimagesink->zcm) {
-      zcm_stop(zcmimagesink->zcm);
-      zcm_destroy(zcmimagesink->zcm);
+    zcm_gstreamer_plugins_image_batch_t batch;
+    batch.utime = g_get_real_time ();
+    batch.num_images = zcmimagesink->batch_len;
+    batch.images = zcmimagesink->batch_imgs;
+    zcm_gstreamer_plugins_image_batch_t_publish (zcmimagesink->zcm,
+        zcmimagesink->channel->str, &batch);
+  }
+
+  zcmimagesink->batch_len = 0;
+  zcmimagesink->batch_deadline = 0;
+}
+
+static void
+flush_batch (GstZcmImageSink * zcmimagesink)
+{
+  g_mutex_lock (&zcmimagesink->batch_lock);
+  publish_batch (zcmimagesink);
+  g_mutex_unlock (&zcmimagesink->batch_lock);
+}
+
+/* Publishes a batch once it is batch-us old, whether or not another frame
+ * comes along to notice */
+static gpointer
+batch_timer_thread (gpointer user)
+{
+  GstZcmImageSink *zcmimagesink = (GstZcmImageSink *) user;
+
+  g_mutex_lock (&zcmimagesink->batch_lock);
+  while (!zcmimagesink->batch_timer_stop) {
+    gint64 deadline = zcmimagesink->batch_deadline;
+    if (deadline == 0) {
+      g_cond_wait (&zcmimagesink->batch_cond, &zcmimagesink->batch_lock);
+    } else if (g_get_monotonic_time () >= deadline) {
+      GST_LOG_OBJECT (zcmimagesink, "batch window expired");
+      publish_batch (zcmimagesink);
+    } else {
+      g_cond_wait_until (&zcmimagesink->batch_cond, &zcmimagesink->batch_lock,
+          deadline);
+    }
+  }
+  g_mutex_unlock (&zcmimagesink->batch_lock);
+
+  return NULL;
+}
+
+static void
+stop_batch_timer (GstZcmImageSink * zcmimagesink)
+{
+  if (!zcmimagesink->batch_timer) return;
+
+  g_mutex_lock (&zcmimagesink->batch_lock);
+  zcmimagesink->batch_timer_stop = TRUE;
+  g_cond_signal (&zcmimagesink->batch_cond);
+  g_mutex_unlock (&zcmimagesink->batch_lock);
+
+  g_thread_join (zcmimagesink->batch_timer);
+  zcmimagesink->batch_timer = NULL;
+  zcmimagesink->batch_timer_stop = FALSE;
+}
+
+static void
+free_batch (GstZcmImageSink * zcmimagesink)
+{
+  for (gint i = 0; i < zcmimagesink->batch_capacity; ++i) {
+    g_free (zcmimagesink->batch_entries[i].data);
+  }
+  g_free (zcmimagesink->batch_entries);
+  g_free (zcmimagesink->batch_imgs);
+  zcmimagesink->batch_entries = NULL;
+  zcmimagesink->batch_imgs = NULL;
+  zcmimagesink->batch_capacity = 0;
+}
+
+static void
+publish_stats (GstZcmImageSink * zcmimagesink, GstVideoFrame * frame,
+    int64_t frame_utime)
+{
+  GstZcmImageStats *stats = &zcmimagesink->stats;
+  if (!gst_zcm_image_stats_compute (frame, stats)) {
+    GST_DEBUG_OBJECT (zcmimagesink, "no statistics for this format");
+    return;
+  }
+
+  zcm_gstreamer_plugins_image_stats_t msg;
+  msg.utime = frame_utime;
+  msg.width = zcmimagesink->img.width;
+  msg.height = zcmimagesink->img.height;
+  msg.pixelformat = zcmimagesink->img.pixelformat;
+  msg.num_channels = stats->num_channels;
+  msg.hist_size = stats->num_channels * GST_ZCM_IMAGE_STATS_BINS;
+  msg.histogram = stats->histogram;
+  msg.mean = stats->mean;
+  msg.min = stats->min;
+  msg.max = stats->max;
+  msg.sharpness = stats->sharpness;
+
+  zcm_gstreamer_plugins_image_stats_t_publish (zcmimagesink->zcm,
+      zcmimagesink->stats_channel->str, &msg);
+}
+
+/* Takes codec, stream format and codec_data of H.264 / H.265 caps */
+static gboolean
+set_encoded_caps (GstZcmImageSink * zcmimagesink, const GstStructure * s)
+{
+  zcm_gstreamer_plugins_encoded_image_t *enc = &zcmimagesink->enc;
+
+  enc->codec = gst_structure_has_name (s, "video/x-h265") ?
+      ZCM_GSTREAMER_PLUGINS_ENCODED_IMAGE_T_CODEC_H265 :
+      ZCM_GSTREAMER_PLUGINS_ENCODED_IMAGE_T_CODEC_H264;
+  enc->stream_format =
+      g_strcmp0 (gst_structure_get_string (s, "stream-format"), "byte-stream") == 0 ?
+      ZCM_GSTREAMER_PLUGINS_ENCODED_IMAGE_T_STREAM_FORMAT_BYTE_STREAM :
+      ZCM_GSTREAMER_PLUGINS_ENCODED_IMAGE_T_STREAM_FORMAT_PACKETIZED;
+  enc->width = zcmimagesink->img.width;
+  enc->height = zcmimagesink->img.height;
+
+  g_free (enc->codec_data);
+  enc->codec_data = NULL;
+  enc->codec_data_size = 0;
+
+  const GValue *value = gst_structure_get_value (s, "codec_data");
+  if (value && G_VALUE_HOLDS (value, GST_TYPE_BUFFER)) {
+    GstBuffer *codec_data = gst_value_get_buffer (value);
+    enc->codec_data_size = gst_buffer_get_size (codec_data);
+    enc->codec_data = g_malloc (enc->codec_data_size);
+    gst_buffer_extract (codec_data, 0, enc->codec_data, enc->codec_data_size);
+  }
+
+  if (enc->stream_format == ZCM_GSTREAMER_PLUGINS_ENCODED_IMAGE_T_STREAM_FORMAT_PACKETIZED &&
+      enc->codec_data_size == 0) {
+    GST_DEBUG_OBJECT (zcmimagesink, "packetized stream without codec_data");
+    return FALSE;
+  }
+
+  GST_OBJECT_LOCK (zcmimagesink);
+  zcmimagesink->encoded = TRUE;
+  GST_OBJECT_UNLOCK (zcmimagesink);
+  return TRUE;
+}
+
+static int64_t
+clock_time (GstZcmImageSink * zcmimagesink, GstClockTime ts)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (ts)) return -1;
+
+  GstBaseSink *bsink = GST_BASE_SINK (zcmimagesink);
+  GstClockTime running = gst_segment_to_running_time (&bsink->segment,
+      GST_FORMAT_TIME, ts);
+  if (!GST_CLOCK_TIME_IS_VALID (running)) return -1;
+
+  return gst_element_get_base_time (GST_ELEMENT (bsink)) + running;
+}
+
+/* Publishes buf, one access unit, straight from its mapping */
+static void
+publish_encoded (GstZcmImageSink * zcmimagesink, GstBuffer * buf)
+{
+  GstMapInfo info;
+  if (!gst_buffer_map (buf, &info, GST_MAP_READ)) {
+    GST_WARNING_OBJECT (zcmimagesink, "could not map buffer info");
+    return;
+  }
+
+  zcm_gstreamer_plugins_encoded_image_t *enc = &zcmimagesink->enc;
+  enc->utime = gst_zcm_buffer_utime (GST_BASE_SINK (zcmimagesink), buf);
+  enc->keyframe = !GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+  enc->pts = clock_time (zcmimagesink, GST_BUFFER_PTS (buf));
+  enc->dts = clock_time (zcmimagesink, GST_BUFFER_DTS (buf));
+  enc->size = info.size;
+  enc->data = info.data;
+
+  zcm_gstreamer_plugins_encoded_image_t_publish (zcmimagesink->zcm,
+      zcmimagesink->channel->str, enc);
+
+  enc->data = NULL;
+  gst_buffer_unmap (buf, &info);
+}
+
+/* Copies frame into the batch. Batched frames are small, copying them
+ * lets upstream reuse its buffers while the batch fills up. */
+static void
+append_to_batch (GstZcmImageSink * zcmimagesink, GstBuffer * buf,
+    GstVideoFrame * frame)
+{
+  int64_t frame_utime = gst_zcm_buffer_utime (GST_BASE_SINK (zcmimagesink), buf);
+
+  GstMapInfo info;
+  if (!gst_buffer_map (buf, &info, GST_MAP_READ)) {
+    GST_WARNING_OBJECT (zcmimagesink, "could not map buffer info");
+    return;
+  }
+
+  if (zcmimagesink->batch_us > 0 && !zcmimagesink->batch_timer) {
+    zcmimagesink->batch_timer = g_thread_new ("zcmimagesink-batch",
+        batch_timer_thread, zcmimagesink);
+  }
+
+  g_mutex_lock (&zcmimagesink->batch_lock);
+
+  if (zcmimagesink->batch_len > 0 && zcmimagesink->batch_us > 0 &&
+      frame_utime - zcmimagesink->batch_imgs[0].utime >=
+          (int64_t) zcmimagesink->batch_us) {
+    publish_batch (zcmimagesink);
+  }
+
+  gint capacity = zcmimagesink->batch_frames > 1 ?
+      zcmimagesink->batch_frames : GST_ZCMIMAGESINK_MAX_BATCH;
+  if (capacity != zcmimagesink->batch_capacity) {
+    publish_batch (zcmimagesink);
+    free_batch (zcmimagesink);
+    zcmimagesink->batch_entries = g_new0 (GstZcmImageSinkBatchEntry, capacity);
+    zcmimagesink->batch_imgs = g_new (zcm_gstreamer_plugins_image_t, capacity);
+    zcmimagesink->batch_capacity = capacity;
+  }
+
+  GstZcmImageSinkBatchEntry *entry =
+      &zcmimagesink->batch_entries[zcmimagesink->batch_len];
+  if (entry->capacity < info.size) {
+    g_free (entry->data);
+    entry->data = g_malloc (info.size);
+    entry->capacity = info.size;
   }
-  zcmimagesink->zcm = zcm_create(zcmimagesink->url->str);
-  zcm_start(zcmimagesink->zcm);
+  memcpy (entry->data, info.data, info.size);
+
+  gint num_strides = GST_VIDEO_FRAME_N_PLANES (frame);
+  for (size_t i = 0; i < num_strides; ++i) {
+    entry->stride[i] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, i);
+  }
+
+  zcm_gstreamer_plugins_image_t *img =
+      &zcmimagesink->batch_imgs[zcmimagesink->batch_len];
+  *img = zcmimagesink->img;
+  img->utime = frame_utime;
+  img->num_strides = num_strides;
+  img->stride = entry->stride;
+  img->size = info.size;
+  img->data = entry->data;
+
+  if (zcmimagesink->batch_len++ == 0 && zcmimagesink->batch_us > 0) {
+    zcmimagesink->batch_deadline =
+        g_get_monotonic_time () + (gint64) zcmimagesink->batch_us;
+    g_cond_signal (&zcmimagesink->batch_cond);
+  }
+
+  if (zcmimagesink->batch_len >= zcmimagesink->batch_capacity) {
+    publish_batch (zcmimagesink);
+  }
+
+  g_mutex_unlock (&zcmimagesink->batch_lock);
+
+  gst_buffer_unmap (buf, &info);
 }
 
 
@@ -128,6 +588,9 @@ gst_zcmimagesink_setcaps (GstBaseSink * bsink, GstCaps * caps)
   zcmimagesink->img.width = info.width;
   zcmimagesink->img.height = info.height;
   zcmimagesink->info = info;
+  GST_OBJECT_LOCK (zcmimagesink);
+  zcmimagesink->encoded = FALSE;
+  GST_OBJECT_UNLOCK (zcmimagesink);
 
   GstVideoFormat pixelformat = GST_VIDEO_INFO_FORMAT(&info);
   if (pixelformat == GST_VIDEO_FORMAT_ENCODED) {
@@ -136,6 +599,9 @@ gst_zcmimagesink_setcaps (GstBaseSink * bsink, GstCaps * caps)
         GST_DEBUG_OBJECT(zcmimagesink, "Could not get name of caps %" GST_PTR_FORMAT, caps);
         return FALSE;
       }
+      if (g_strcmp0(name, "video/x-h264") == 0 || g_strcmp0(name, "video/x-h265") == 0) {
+        return set_encoded_caps(zcmimagesink, gst_caps_get_structure(caps, 0));
+      }
       if (g_strcmp0(name, "image/jpeg") == 0) {
         zcmimagesink->img.pixelformat = ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_MJPEG;
       }
@@ -143,18 +609,45 @@ gst_zcmimagesink_setcaps (GstBaseSink * bsink, GstCaps * caps)
       return TRUE;
   }
 
-  zcmimagesink->img.pixelformat = gst_video_format_to_fourcc (GST_VIDEO_INFO_FORMAT(&info));
-  if (zcmimagesink->img.pixelformat == 0) {
-    switch (pixelformat) {
-      case GST_VIDEO_FORMAT_RGB:
-        zcmimagesink->img.pixelformat = ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_RGB;
-        break;
-      case GST_VIDEO_FORMAT_RGBA:
-        zcmimagesink->img.pixelformat = ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_RGBA;
-        break;
-      default:
-        break;
+  zcmimagesink->img.pixelformat = gst_zcm_format_to_pixelformat (pixelformat);
+
+  return TRUE;
+}
+
+static gboolean
+gst_zcmimagesink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
+{
+  GstZcmImageSink *zcmimagesink = GST_ZCMIMAGESINK (bsink);
+
+  if (!zcmimagesink->hugepages) return FALSE;
+
+  GstCaps *caps;
+  gboolean need_pool;
+  gst_query_parse_allocation (query, &caps, &need_pool);
+
+  // Encoded access units are small, only raw frames are worth huge pages
+  GstVideoInfo info;
+  if (!caps || !gst_video_info_from_caps (&info, caps) ||
+      GST_VIDEO_INFO_FORMAT (&info) == GST_VIDEO_FORMAT_ENCODED) {
+    return FALSE;
+  }
+
+  GstAllocator *allocator = gst_zcm_hugepage_allocator_get ();
+  GstAllocationParams params;
+  gst_allocation_params_init (&params);
+  gst_query_add_allocation_param (query, allocator, &params);
+  gst_object_unref (allocator);
+
+  if (need_pool) {
+    GstBufferPool *pool = gst_zcm_hugepage_pool_new ();
+    GstStructure *config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_set_params (config, caps, info.size, 0, 0);
+    if (!gst_buffer_pool_set_config (pool, config)) {
+      gst_object_unref (pool);
+      return FALSE;
     }
+    gst_query_add_allocation_pool (query, pool, info.size, 0, 0);
+    gst_object_unref (pool);
   }
 
   return TRUE;
@@ -178,6 +671,10 @@ gst_zcmimagesink_class_init (GstZcmImageSinkClass * klass)
       "ZeroCM Team <www.zcm-project.org>");
 
   gstbasesink_class->set_caps = gst_zcmimagesink_setcaps;
+  gstbasesink_class->stop = GST_DEBUG_FUNCPTR (gst_zcmimagesink_stop);
+  gstbasesink_class->event = GST_DEBUG_FUNCPTR (gst_zcmimagesink_event);
+  gstbasesink_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_zcmimagesink_propose_allocation);
   gobject_class->set_property = gst_zcmimagesink_set_property;
   gobject_class->get_property = gst_zcmimagesink_get_property;
   gobject_class->dispose = gst_zcmimagesink_dispose;
@@ -193,6 +690,50 @@ gst_zcmimagesink_class_init (GstZcmImageSinkClass * klass)
           g_param_spec_string ("url", "Zcm transport url",
               "The full zcm url specifying the zcm transport to be used",
               "", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BATCH_FRAMES,
+          g_param_spec_uint ("batch-frames", "Frames per batch",
+              "Publish up to this many frames together in one image_batch_t "
+              "message (1 publishes each frame as an image_t)",
+              1, GST_ZCMIMAGESINK_MAX_BATCH, 1,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BATCH_US,
+          g_param_spec_uint64 ("batch-us", "Batch window us",
+              "Publish all frames within this many microseconds together in "
+              "one image_batch_t message, which is published once the window "
+              "is up even if no further frame arrives (0 disables the time "
+              "window)",
+              0, G_MAXUINT64, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_CHANNEL,
+          g_param_spec_string ("stats-channel", "Zcm statistics channel",
+              "Channel name to publish per frame image_stats_t messages to "
+              "(empty disables statistics)",
+              "", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_KEYFRAME_CHANNEL,
+          g_param_spec_string ("keyframe-channel", "Zcm keyframe request channel",
+              "Channel to receive keyframe_request_t messages for an encoded "
+              "stream on (empty ignores requests)",
+              "GSTREAMER_KEYFRAME", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATCHED,
+          g_param_spec_boolean ("latched", "Latched",
+              "Keep the last frame and send it to receivers asking for it with "
+              "a latest_request_t on latest-channel (raw and JPEG frames only)",
+              FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATEST_CHANNEL,
+          g_param_spec_string ("latest-channel", "Zcm latest frame request channel",
+              "Channel to receive latest_request_t messages on when latched",
+              "GSTREAMER_LATEST", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_HUGEPAGES,
+          g_param_spec_boolean ("hugepages", "Huge pages",
+              "Offer upstream buffers backed by huge pages for raw frames, "
+              "falling back to normal pages where there are none",
+              FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -202,6 +743,31 @@ gst_zcmimagesink_init (GstZcmImageSink * zcmimagesink)
   zcmimagesink->channel = g_string_new("GSTREAMER_DATA");
   zcmimagesink->zcm = NULL;
   memset(&zcmimagesink->img, 0, sizeof(zcmimagesink->img));
+  zcmimagesink->batch_entries = NULL;
+  zcmimagesink->batch_imgs = NULL;
+  zcmimagesink->batch_len = 0;
+  zcmimagesink->batch_capacity = 0;
+  g_mutex_init(&zcmimagesink->batch_lock);
+  g_cond_init(&zcmimagesink->batch_cond);
+  zcmimagesink->batch_timer = NULL;
+  zcmimagesink->batch_timer_stop = FALSE;
+  zcmimagesink->batch_deadline = 0;
+  zcmimagesink->batch_frames = 1;
+  zcmimagesink->batch_us = 0;
+  zcmimagesink->stats_channel = g_string_new("");
+  zcmimagesink->encoded = FALSE;
+  memset(&zcmimagesink->enc, 0, sizeof(zcmimagesink->enc));
+  zcmimagesink->keyframe_sub = NULL;
+  zcmimagesink->last_keyframe_request = 0;
+  zcmimagesink->keyframe_channel = g_string_new("GSTREAMER_KEYFRAME");
+  g_mutex_init(&zcmimagesink->latch_lock);
+  zcmimagesink->latched_data = NULL;
+  zcmimagesink->latched_capacity = 0;
+  memset(&zcmimagesink->latched_img, 0, sizeof(zcmimagesink->latched_img));
+  zcmimagesink->latest_sub = NULL;
+  zcmimagesink->latched = FALSE;
+  zcmimagesink->latest_channel = g_string_new("GSTREAMER_LATEST");
+  zcmimagesink->hugepages = FALSE;
 }
 
 void
@@ -220,6 +786,31 @@ gst_zcmimagesink_set_property (GObject * object, guint property_id,
       g_string_assign (zcmimagesink->url, g_value_get_string (value));
       reinit_zcm(zcmimagesink);
       break;
+    case PROP_BATCH_FRAMES:
+      zcmimagesink->batch_frames = g_value_get_uint (value);
+      break;
+    case PROP_BATCH_US:
+      zcmimagesink->batch_us = g_value_get_uint64 (value);
+      break;
+    case PROP_STATS_CHANNEL:
+      g_string_assign (zcmimagesink->stats_channel, g_value_get_string (value));
+      break;
+    case PROP_KEYFRAME_CHANNEL:
+      g_string_assign (zcmimagesink->keyframe_channel, g_value_get_string (value));
+      subscribe_keyframe_requests (zcmimagesink);
+      break;
+    case PROP_LATCHED:
+      zcmimagesink->latched = g_value_get_boolean (value);
+      if (!zcmimagesink->latched) drop_latched_frame (zcmimagesink);
+      subscribe_latest_requests (zcmimagesink);
+      break;
+    case PROP_LATEST_CHANNEL:
+      g_string_assign (zcmimagesink->latest_channel, g_value_get_string (value));
+      subscribe_latest_requests (zcmimagesink);
+      break;
+    case PROP_HUGEPAGES:
+      zcmimagesink->hugepages = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -241,6 +832,27 @@ gst_zcmimagesink_get_property (GObject * object, guint property_id,
     case PROP_CHANNEL:
       g_value_set_string (value, zcmimagesink->channel->str);
       break;
+    case PROP_BATCH_FRAMES:
+      g_value_set_uint (value, zcmimagesink->batch_frames);
+      break;
+    case PROP_BATCH_US:
+      g_value_set_uint64 (value, zcmimagesink->batch_us);
+      break;
+    case PROP_STATS_CHANNEL:
+      g_value_set_string (value, zcmimagesink->stats_channel->str);
+      break;
+    case PROP_KEYFRAME_CHANNEL:
+      g_value_set_string (value, zcmimagesink->keyframe_channel->str);
+      break;
+    case PROP_LATCHED:
+      g_value_set_boolean (value, zcmimagesink->latched);
+      break;
+    case PROP_LATEST_CHANNEL:
+      g_value_set_string (value, zcmimagesink->latest_channel->str);
+      break;
+    case PROP_HUGEPAGES:
+      g_value_set_boolean (value, zcmimagesink->hugepages);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -268,9 +880,19 @@ gst_zcmimagesink_finalize (GObject * object)
 
   /* clean up object here */
 
-  zcm_stop(zcmimagesink->zcm);
-  zcm_destroy(zcmimagesink->zcm);
-  zcmimagesink->zcm = NULL;
+  stop_batch_timer (zcmimagesink);
+  flush_batch (zcmimagesink);
+  free_batch (zcmimagesink);
+  g_cond_clear (&zcmimagesink->batch_cond);
+  g_mutex_clear (&zcmimagesink->batch_lock);
+
+  release_zcm (zcmimagesink);
+
+  drop_latched_frame (zcmimagesink);
+  g_mutex_clear (&zcmimagesink->latch_lock);
+
+  g_free (zcmimagesink->enc.codec_data);
+  zcmimagesink->enc.codec_data = NULL;
 
   if (zcmimagesink->img.stride) {
     free (zcmimagesink->img.stride);
@@ -280,6 +902,32 @@ gst_zcmimagesink_finalize (GObject * object)
   G_OBJECT_CLASS (gst_zcmimagesink_parent_class)->finalize (object);
 }
 
+static gboolean
+gst_zcmimagesink_stop (GstBaseSink * bsink)
+{
+  GstZcmImageSink *zcmimagesink = GST_ZCMIMAGESINK (bsink);
+
+  GST_DEBUG_OBJECT (zcmimagesink, "stop");
+
+  stop_batch_timer (zcmimagesink);
+  flush_batch (zcmimagesink);
+  drop_latched_frame (zcmimagesink);
+
+  return TRUE;
+}
+
+static gboolean
+gst_zcmimagesink_event (GstBaseSink * bsink, GstEvent * event)
+{
+  GstZcmImageSink *zcmimagesink = GST_ZCMIMAGESINK (bsink);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_EOS) {
+    flush_batch (zcmimagesink);
+  }
+
+  return GST_BASE_SINK_CLASS (gst_zcmimagesink_parent_class)->event (bsink, event);
+}
+
 static GstFlowReturn
 gst_zcmimagesink_show_frame (GstVideoSink * sink, GstBuffer * buf)
 {
@@ -289,6 +937,11 @@ gst_zcmimagesink_show_frame (GstVideoSink * sink, GstBuffer * buf)
 
   if (!zcmimagesink->zcm) reinit_zcm(zcmimagesink);
 
+  if (zcmimagesink->encoded) {
+    if (zcmimagesink->zcm) publish_encoded (zcmimagesink, buf);
+    return GST_FLOW_OK;
+  }
+
   if (gst_buffer_n_memory (buf) != 1) {
     GST_ERROR_OBJECT (zcmimagesink, "Support only 1 memory per buffer");
     return GST_FLOW_ERROR;
@@ -302,6 +955,23 @@ gst_zcmimagesink_show_frame (GstVideoSink * sink, GstBuffer * buf)
       return GST_FLOW_OK;
     }
 
+    if (zcmimagesink->stats_channel->len > 0) {
+      publish_stats (zcmimagesink, &src,
+          gst_zcm_buffer_utime (GST_BASE_SINK (zcmimagesink), buf));
+    }
+
+    if (zcmimagesink->latched) {
+      latch_frame (zcmimagesink, buf, &src);
+    }
+
+    if (batching_enabled (zcmimagesink)) {
+      append_to_batch (zcmimagesink, buf, &src);
+      gst_video_frame_unmap (&src);
+      return GST_FLOW_OK;
+    }
+
+    flush_batch (zcmimagesink);
+
     gint num_strides = GST_VIDEO_FRAME_N_PLANES (&src);
     if (num_strides != zcmimagesink->img.num_strides) {
       if (zcmimagesink->img.num_strides != 0) {
@@ -322,6 +992,7 @@ gst_zcmimagesink_show_frame (GstVideoSink * sink, GstBuffer * buf)
       return GST_FLOW_OK;
     }
 
+    zcmimagesink->img.utime = gst_zcm_buffer_utime (GST_BASE_SINK (zcmimagesink), buf);
     zcmimagesink->img.size = info.size;
     zcmimagesink->img.data = info.data;
 
@@ -333,30 +1004,3 @@ gst_zcmimagesink_show_frame (GstVideoSink * sink, GstBuffer * buf)
 
   return GST_FLOW_OK;
 }
-
-static gboolean
-plugin_init (GstPlugin * plugin)
-{
-  return gst_element_register (plugin, "zcmimagesink", GST_RANK_NONE,
-      GST_TYPE_ZCMIMAGESINK);
-}
-
-#ifndef VERSION
-#define VERSION "1.0.0"
-#endif
-#ifndef PACKAGE
-#define PACKAGE "ZeroCM"
-#endif
-#ifndef PACKAGE_NAME
-#define PACKAGE_NAME "zcm-gstreamer-plugins"
-#endif
-#ifndef GST_PACKAGE_ORIGIN
-#define GST_PACKAGE_ORIGIN "https://github.com/ZeroCM/zcm-gstreamer-plugins"
-#endif
-
-GST_PLUGIN_DEFINE (GST_VERSION_MAJOR,
-    GST_VERSION_MINOR,
-    zcmimagesink,
-    "Sinks data from a pipeline into a zcm transport",
-    plugin_init, VERSION, "LGPL", PACKAGE_NAME, GST_PACKAGE_ORIGIN)
-
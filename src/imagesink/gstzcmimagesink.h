@@ -25,6 +25,13 @@
 
 #include <zcm/zcm.h>
 #include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_image_t.h"
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_image_batch_t.h"
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_image_stats_t.h"
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_encoded_image_t.h"
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_keyframe_request_t.h"
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_latest_request_t.h"
+
+#include "gstzcmimagestats.h"
 
 G_BEGIN_DECLS
 
@@ -34,9 +41,21 @@ G_BEGIN_DECLS
 #define GST_IS_ZCMIMAGESINK(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ZCMIMAGESINK))
 #define GST_IS_ZCMIMAGESINK_CLASS(obj) (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ZCMIMAGESINK))
 
+#define GST_ZCMIMAGESINK_MAX_BATCH 256
+
 typedef struct _GstZcmImageSink GstZcmImageSink;
 typedef struct _GstZcmImageSinkClass GstZcmImageSinkClass;
 
+// A copy of a frame until its batch is published. Upstream buffers are
+// released right away, so sources with small pools never run dry, and data
+// is reused for the frame in the same slot of the next batch.
+typedef struct _GstZcmImageSinkBatchEntry
+{
+  guint8* data;
+  gsize capacity;
+  int32_t stride[GST_VIDEO_MAX_PLANES];
+} GstZcmImageSinkBatchEntry;
+
 struct _GstZcmImageSink
 {
   GstVideoSink base_zcmimagesink;
@@ -46,9 +65,47 @@ struct _GstZcmImageSink
   GstVideoInfo info;
   zcm_gstreamer_plugins_image_t img;
 
+  GstZcmImageSinkBatchEntry* batch_entries;
+  zcm_gstreamer_plugins_image_t* batch_imgs;
+  gint batch_len;
+  gint batch_capacity;
+  // Guards the batch, which the timer thread publishes once batch-us is up
+  GMutex batch_lock;
+  GCond batch_cond;
+  GThread* batch_timer;
+  gboolean batch_timer_stop;
+  gint64 batch_deadline;  // monotonic, 0 while the batch is empty
+
+  GstZcmImageStats stats;
+
+  // H.264 / H.265 caps are published as encoded_image_t. encoded and
+  // last_keyframe_request are also read by keyframe_request_handler on the
+  // zcm thread, they are written under the object lock.
+  gboolean encoded;
+  zcm_gstreamer_plugins_encoded_image_t enc;
+  zcm_gstreamer_plugins_keyframe_request_t_subscription_t* keyframe_sub;
+  gint64 last_keyframe_request;
+
+  // Copy of the last frame for answering latest_request_t, like the batch
+  // entries it lets upstream reuse its buffer. latched_img.data is NULL
+  // until a frame has been latched.
+  GMutex latch_lock;
+  guint8* latched_data;
+  gsize latched_capacity;
+  zcm_gstreamer_plugins_image_t latched_img;
+  int32_t latched_stride[GST_VIDEO_MAX_PLANES];
+  zcm_gstreamer_plugins_latest_request_t_subscription_t* latest_sub;
+
   // Properties
   GString* url;
   GString* channel;
+  guint batch_frames;
+  guint64 batch_us;
+  GString* stats_channel;
+  GString* keyframe_channel;
+  gboolean latched;
+  GString* latest_channel;
+  gboolean hugepages;
 };
 
 struct _GstZcmImageSinkClass
@@ -0,0 +1,200 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Frame statistics kernels for zcmimagesink.
+ *
+ * These run on the streaming thread while the frame is mapped, so they are
+ * written to be cheap: a single pass per component builds the histogram (into
+ * four interleaved sub-histograms to avoid store-to-load stalls on repeated
+ * values) and mean / min / max are derived from it afterwards. The row loops
+ * are kept free of aliasing and branches so the compiler can vectorize them.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstzcmimagestats.h"
+
+#include <string.h>
+
+typedef struct
+{
+  const guint8* data;
+  gint stride;
+  gint pstride;
+  gint width;
+  gint height;
+} Component;
+
+static gboolean
+get_component (const GstVideoFrame * frame, gint c, Component * comp)
+{
+  gint depth = GST_VIDEO_FRAME_COMP_DEPTH (frame, c);
+  gint pstride = GST_VIDEO_FRAME_COMP_PSTRIDE (frame, c);
+
+  if (pstride <= 0) return FALSE;
+
+  comp->data = GST_VIDEO_FRAME_COMP_DATA (frame, c);
+  if (depth == 16) {
+    // Only the most significant byte of 16 bit samples is looked at
+    if (GST_VIDEO_FORMAT_INFO_IS_LE (frame->info.finfo)) comp->data += 1;
+  } else if (depth != 8) {
+    return FALSE;
+  }
+
+  comp->stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, c);
+  comp->pstride = pstride;
+  comp->width = GST_VIDEO_FRAME_COMP_WIDTH (frame, c);
+  comp->height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, c);
+  return TRUE;
+}
+
+static void
+histogram_component (const Component * comp, int32_t * restrict hist)
+{
+  uint32_t sub[4][GST_ZCM_IMAGE_STATS_BINS];
+  memset (sub, 0, sizeof (sub));
+
+  const gint ps = comp->pstride;
+  for (gint y = 0; y < comp->height; ++y) {
+    const guint8* restrict p = comp->data + (gsize) y * comp->stride;
+    gint x = 0;
+    for (; x + 4 <= comp->width; x += 4, p += 4 * ps) {
+      sub[0][p[0]]++;
+      sub[1][p[ps]]++;
+      sub[2][p[2 * ps]]++;
+      sub[3][p[3 * ps]]++;
+    }
+    for (; x < comp->width; ++x, p += ps) {
+      sub[0][p[0]]++;
+    }
+  }
+
+  for (gint i = 0; i < GST_ZCM_IMAGE_STATS_BINS; ++i) {
+    hist[i] = sub[0][i] + sub[1][i] + sub[2][i] + sub[3][i];
+  }
+}
+
+static void
+summarize_histogram (const int32_t * hist, float * mean, int16_t * min,
+    int16_t * max)
+{
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  for (gint i = 0; i < GST_ZCM_IMAGE_STATS_BINS; ++i) {
+    count += hist[i];
+    sum += (uint64_t) hist[i] * i;
+  }
+
+  *min = 0;
+  *max = 0;
+  *mean = count ? (float) ((double) sum / count) : 0.f;
+  if (!count) return;
+
+  gint lo = 0;
+  while (hist[lo] == 0) ++lo;
+  gint hi = GST_ZCM_IMAGE_STATS_BINS - 1;
+  while (hist[hi] == 0) --hi;
+  *min = lo;
+  *max = hi;
+}
+
+static inline void
+laplacian_row_packed (const guint8* restrict up, const guint8* restrict mid,
+    const guint8* restrict down, gint width, int64_t * sum, int64_t * sumsq)
+{
+  int64_t s = 0, ss = 0;
+  for (gint x = 1; x < width - 1; ++x) {
+    int32_t l = up[x] + down[x] + mid[x - 1] + mid[x + 1] - 4 * mid[x];
+    s += l;
+    ss += l * l;
+  }
+  *sum += s;
+  *sumsq += ss;
+}
+
+static inline void
+laplacian_row_strided (const guint8* up, const guint8* mid,
+    const guint8* down, gint width, gint ps, int64_t * sum, int64_t * sumsq)
+{
+  int64_t s = 0, ss = 0;
+  for (gint x = 1; x < width - 1; ++x) {
+    gint o = x * ps;
+    int32_t l = up[o] + down[o] + mid[o - ps] + mid[o + ps] - 4 * mid[o];
+    s += l;
+    ss += l * l;
+  }
+  *sum += s;
+  *sumsq += ss;
+}
+
+static double
+laplacian_variance (const Component * comp)
+{
+  if (comp->width < 3 || comp->height < 3) return 0.0;
+
+  int64_t sum = 0, sumsq = 0;
+  for (gint y = 1; y < comp->height - 1; ++y) {
+    const guint8* mid = comp->data + (gsize) y * comp->stride;
+    const guint8* up = mid - comp->stride;
+    const guint8* down = mid + comp->stride;
+    if (comp->pstride == 1)
+      laplacian_row_packed (up, mid, down, comp->width, &sum, &sumsq);
+    else
+      laplacian_row_strided (up, mid, down, comp->width, comp->pstride,
+          &sum, &sumsq);
+  }
+
+  double n = (double) (comp->width - 2) * (comp->height - 2);
+  double m = sum / n;
+  return sumsq / n - m * m;
+}
+
+gboolean
+gst_zcm_image_stats_compute (const GstVideoFrame * frame,
+    GstZcmImageStats * stats)
+{
+  const GstVideoFormatInfo *finfo = frame->info.finfo;
+
+  if (GST_VIDEO_FRAME_FORMAT (frame) == GST_VIDEO_FORMAT_ENCODED ||
+      GST_VIDEO_FRAME_FORMAT (frame) == GST_VIDEO_FORMAT_UNKNOWN) {
+    return FALSE;
+  }
+
+  gint n = GST_VIDEO_FORMAT_INFO_N_COMPONENTS (finfo);
+  Component comps[GST_VIDEO_MAX_COMPONENTS];
+  for (gint c = 0; c < n; ++c) {
+    if (!get_component (frame, c, &comps[c])) return FALSE;
+  }
+
+  stats->num_channels = n;
+  for (gint c = 0; c < n; ++c) {
+    int32_t *hist = &stats->histogram[c * GST_ZCM_IMAGE_STATS_BINS];
+    histogram_component (&comps[c], hist);
+    summarize_histogram (hist, &stats->mean[c], &stats->min[c],
+        &stats->max[c]);
+  }
+
+  // Focus is judged on luma, or on green for RGB formats
+  gint focus = (GST_VIDEO_FORMAT_INFO_IS_RGB (finfo) && n > 1) ? 1 : 0;
+  stats->sharpness = laplacian_variance (&comps[focus]);
+
+  return TRUE;
+}
@@ -0,0 +1,53 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMIMAGESTATS_H_
+#define _GST_ZCMIMAGESTATS_H_
+
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+#define GST_ZCM_IMAGE_STATS_BINS 256
+
+typedef struct _GstZcmImageStats GstZcmImageStats;
+
+struct _GstZcmImageStats
+{
+  gint num_channels;
+
+  // GST_ZCM_IMAGE_STATS_BINS bins per channel, channels back to back
+  int32_t histogram[GST_VIDEO_MAX_COMPONENTS * GST_ZCM_IMAGE_STATS_BINS];
+
+  float mean[GST_VIDEO_MAX_COMPONENTS];
+  int16_t min[GST_VIDEO_MAX_COMPONENTS];
+  int16_t max[GST_VIDEO_MAX_COMPONENTS];
+
+  double sharpness;
+};
+
+/* Computes per channel histograms, mean / min / max and the Laplacian
+ * variance sharpness score of a mapped frame. Returns FALSE for formats whose
+ * components are not stored as whole 8 or 16 bit samples. */
+gboolean gst_zcm_image_stats_compute (const GstVideoFrame * frame,
+    GstZcmImageStats * stats);
+
+G_END_DECLS
+
+#endif
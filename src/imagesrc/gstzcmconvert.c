@@ -0,0 +1,358 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Format conversion kernels for zcmimagesrc.
+ *
+ * They replace the plain copy of a received frame into its output buffer, so
+ * a videoconvert and its extra pass over the frame is not needed downstream.
+ * Every kernel reads the source and writes the destination once, row by row.
+ * The inner loops are free of aliasing and branches, and the pixel layout is
+ * passed as constants to inlined helpers, so the compiler can vectorize them
+ * on any target.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstzcmconvert.h"
+
+#include <string.h>
+
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_image_t.h"
+
+enum { RED, GREEN, BLUE };
+
+/* BT.601 limited range, the colorimetry zcmimagesrc puts on its YUV caps */
+static inline void
+luma_row (const guint8 * restrict s, gint ps, gint r, gint g, gint b,
+    guint8 * restrict d, gint width)
+{
+  for (gint x = 0; x < width; ++x) {
+    const guint8* p = s + x * ps;
+    d[x] = ((66 * p[r] + 129 * p[g] + 25 * p[b] + 128) >> 8) + 16;
+  }
+}
+
+/* One chroma sample per 2x2 block of rows s0 and s1, written step bytes
+ * apart: 1 for I420 planes, 2 for the interleaved NV12 plane */
+static inline void
+chroma_row (const guint8 * restrict s0, const guint8 * restrict s1, gint ps,
+    gint r, gint g, gint b, guint8 * restrict u, guint8 * restrict v,
+    gint step, gint width)
+{
+  gint x = 0;
+  for (; x < width / 2; ++x) {
+    const guint8* p = s0 + 2 * x * ps;
+    const guint8* q = s1 + 2 * x * ps;
+    gint rs = p[r] + p[ps + r] + q[r] + q[ps + r];
+    gint gs = p[g] + p[ps + g] + q[g] + q[ps + g];
+    gint bs = p[b] + p[ps + b] + q[b] + q[ps + b];
+    u[x * step] = ((-38 * rs - 74 * gs + 112 * bs + 512) >> 10) + 128;
+    v[x * step] = ((112 * rs - 94 * gs - 18 * bs + 512) >> 10) + 128;
+  }
+  if (width & 1) {
+    const guint8* p = s0 + 2 * x * ps;
+    const guint8* q = s1 + 2 * x * ps;
+    gint rs = p[r] + q[r], gs = p[g] + q[g], bs = p[b] + q[b];
+    u[x * step] = ((-38 * rs - 74 * gs + 112 * bs + 256) >> 9) + 128;
+    v[x * step] = ((112 * rs - 94 * gs - 18 * bs + 256) >> 9) + 128;
+  }
+}
+
+static inline void
+rgb_to_yuv420 (const guint8 * src, gint src_stride, gint ps, gint r, gint g,
+    gint b, const GstVideoInfo * info, guint8 * dst)
+{
+  gint width = GST_VIDEO_INFO_WIDTH (info);
+  gint height = GST_VIDEO_INFO_HEIGHT (info);
+  gboolean nv12 = GST_VIDEO_INFO_FORMAT (info) == GST_VIDEO_FORMAT_NV12;
+
+  guint8* y_plane = dst + GST_VIDEO_INFO_PLANE_OFFSET (info, 0);
+  guint8* u_plane = dst + GST_VIDEO_INFO_PLANE_OFFSET (info, 1);
+  guint8* v_plane = nv12 ? u_plane + 1 : dst + GST_VIDEO_INFO_PLANE_OFFSET (info, 2);
+  gint y_stride = GST_VIDEO_INFO_PLANE_STRIDE (info, 0);
+  gint u_stride = GST_VIDEO_INFO_PLANE_STRIDE (info, 1);
+  gint v_stride = nv12 ? u_stride : GST_VIDEO_INFO_PLANE_STRIDE (info, 2);
+  gint step = nv12 ? 2 : 1;
+
+  for (gint y = 0; y < height; y += 2) {
+    const guint8* s0 = src + (gsize) y * src_stride;
+    const guint8* s1 = y + 1 < height ? s0 + src_stride : s0;
+
+    luma_row (s0, ps, r, g, b, y_plane + (gsize) y * y_stride, width);
+    if (y + 1 < height)
+      luma_row (s1, ps, r, g, b, y_plane + (gsize) (y + 1) * y_stride, width);
+    chroma_row (s0, s1, ps, r, g, b, u_plane + (gsize) (y / 2) * u_stride,
+        v_plane + (gsize) (y / 2) * v_stride, step, width);
+  }
+}
+
+/* Bilinear demosaicing of one output pixel at a site of colour site, in a
+ * row whose other colour is row_colour. up and down are the neighbouring rows
+ * (mirrored at the edges so they keep the pattern's parity), l and rt the
+ * neighbouring columns. Writes red, green and blue at r, g and b of out, and
+ * alpha at a unless a is negative. */
+static inline void
+bayer_pixel (const guint8 * up, const guint8 * cur, const guint8 * down,
+    gint l, gint x, gint rt, gint site, gint row_colour, guint8 * out,
+    gint r, gint g, gint b, gint a)
+{
+  gint rgb[3];
+  if (site == GREEN) {
+    rgb[GREEN] = cur[x];
+    rgb[row_colour] = (cur[l] + cur[rt] + 1) >> 1;
+    rgb[2 - row_colour] = (up[x] + down[x] + 1) >> 1;
+  } else {
+    rgb[site] = cur[x];
+    rgb[GREEN] = (up[x] + down[x] + cur[l] + cur[rt] + 2) >> 2;
+    rgb[2 - site] = (up[l] + up[rt] + down[l] + down[rt] + 2) >> 2;
+  }
+  out[r] = rgb[RED];
+  out[g] = rgb[GREEN];
+  out[b] = rgb[BLUE];
+  if (a >= 0) out[a] = 255;
+}
+
+/* The interior of a row, two sites at a time: a red or blue one (colour
+ * at byte xo of the output pixel, the other at yo) then a green one */
+static inline void
+bayer_pairs (const guint8 * restrict up, const guint8 * restrict cur,
+    const guint8 * restrict down, guint8 * restrict out, gint first,
+    gint n, gint ps, gint xo, gint g, gint yo, gint a)
+{
+  for (gint i = 0; i < n; ++i) {
+    gint x = first + 2 * i;
+    guint8* p = out + x * ps;
+    p[xo] = cur[x];
+    p[g] = (up[x] + down[x] + cur[x - 1] + cur[x + 1] + 2) >> 2;
+    p[yo] = (up[x - 1] + up[x + 1] + down[x - 1] + down[x + 1] + 2) >> 2;
+    p[ps + xo] = (cur[x] + cur[x + 2] + 1) >> 1;
+    p[ps + g] = cur[x + 1];
+    p[ps + yo] = (up[x + 1] + down[x + 1] + 1) >> 1;
+    if (a >= 0) {
+      p[a] = 255;
+      p[ps + a] = 255;
+    }
+  }
+}
+
+static inline void
+bayer_row (const guint8 * up, const guint8 * cur, const guint8 * down,
+    guint8 * out, gint width, gint c0, gint c1, gint ps, gint r, gint g,
+    gint b, gint a)
+{
+  gint row_colour = c0 == GREEN ? c1 : c0;
+  gint xo = row_colour == RED ? r : b;
+  gint yo = row_colour == RED ? b : r;
+
+  // Pairs start at the first red or blue site that has a left neighbour
+  gint first = c0 == GREEN ? 1 : 2;
+  gint n = (width - 2 - first) / 2;
+  if (n < 0) n = 0;
+
+  for (gint x = 0; x < first; ++x) {
+    bayer_pixel (up, cur, down, x > 0 ? x - 1 : 1, x, x + 1,
+        (x & 1) ? c1 : c0, row_colour, out + x * ps, r, g, b, a);
+  }
+  bayer_pairs (up, cur, down, out, first, n, ps, xo, g, yo, a);
+  for (gint x = first + 2 * n; x < width; ++x) {
+    gint rt = x + 1 < width ? x + 1 : x - 1;
+    bayer_pixel (up, cur, down, x - 1, x, rt, (x & 1) ? c1 : c0, row_colour,
+        out + x * ps, r, g, b, a);
+  }
+}
+
+/* pattern holds the colours of the top left 2x2 block in raster order */
+static inline void
+bayer_to_rgb (const guint8 * src, gint src_stride, const gint pattern[4],
+    gint ps, gint r, gint g, gint b, gint a, const GstVideoInfo * info,
+    guint8 * dst)
+{
+  gint width = GST_VIDEO_INFO_WIDTH (info);
+  gint height = GST_VIDEO_INFO_HEIGHT (info);
+  gint dst_stride = GST_VIDEO_INFO_PLANE_STRIDE (info, 0);
+  dst += GST_VIDEO_INFO_PLANE_OFFSET (info, 0);
+
+  for (gint y = 0; y < height; ++y) {
+    gint yu = y > 0 ? y - 1 : 1;
+    gint yd = y + 1 < height ? y + 1 : y - 1;
+    bayer_row (src + (gsize) yu * src_stride, src + (gsize) y * src_stride,
+        src + (gsize) yd * src_stride, dst + (gsize) y * dst_stride, width,
+        pattern[(y & 1) * 2], pattern[(y & 1) * 2 + 1], ps, r, g, b, a);
+  }
+}
+
+static void
+swap16 (const guint8 * src, gint src_stride, const GstVideoInfo * info,
+    guint8 * dst)
+{
+  gint width = GST_VIDEO_INFO_WIDTH (info);
+  gint height = GST_VIDEO_INFO_HEIGHT (info);
+  gint dst_stride = GST_VIDEO_INFO_PLANE_STRIDE (info, 0);
+  dst += GST_VIDEO_INFO_PLANE_OFFSET (info, 0);
+
+  for (gint y = 0; y < height; ++y) {
+    const guint8* restrict s = src + (gsize) y * src_stride;
+    guint8* restrict d = dst + (gsize) y * dst_stride;
+    for (gint x = 0; x < width; ++x) {
+      d[2 * x] = s[2 * x + 1];
+      d[2 * x + 1] = s[2 * x];
+    }
+  }
+}
+
+static const gint *
+bayer_pattern (gint32 pixelformat)
+{
+  static const gint rggb[4] = { RED, GREEN, GREEN, BLUE };
+  static const gint bggr[4] = { BLUE, GREEN, GREEN, RED };
+  static const gint grbg[4] = { GREEN, RED, BLUE, GREEN };
+  static const gint gbrg[4] = { GREEN, BLUE, RED, GREEN };
+
+  switch (pixelformat) {
+    case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BAYER_RGGB8: return rggb;
+    case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BAYER_BGGR8: return bggr;
+    case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BAYER_GRBG8: return grbg;
+    case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BAYER_GBRG8: return gbrg;
+    default: return NULL;
+  }
+}
+
+/* Bytes per pixel of the packed RGB pixelformats, 0 for the others */
+static gint
+rgb_pstride (gint32 pixelformat)
+{
+  switch (pixelformat) {
+    case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_RGB:
+    case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BGR:
+      return 3;
+    case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_RGBA:
+    case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BGRA:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+static gboolean
+is_gray16 (gint32 pixelformat, gboolean * le)
+{
+  switch (pixelformat) {
+    case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_GRAY16:
+    case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_LE_GRAY16:
+      *le = TRUE;
+      return TRUE;
+    case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BE_GRAY16:
+      *le = FALSE;
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+gboolean
+gst_zcm_convert_supported (gint32 pixelformat, GstVideoFormat format)
+{
+  gboolean le;
+
+  if (rgb_pstride (pixelformat) > 0)
+    return format == GST_VIDEO_FORMAT_I420 || format == GST_VIDEO_FORMAT_NV12;
+
+  if (bayer_pattern (pixelformat))
+    return format == GST_VIDEO_FORMAT_RGB || format == GST_VIDEO_FORMAT_BGR ||
+        format == GST_VIDEO_FORMAT_RGBA || format == GST_VIDEO_FORMAT_BGRA ||
+        format == GST_VIDEO_FORMAT_RGBx || format == GST_VIDEO_FORMAT_BGRx;
+
+  if (is_gray16 (pixelformat, &le))
+    return format == (le ? GST_VIDEO_FORMAT_GRAY16_BE : GST_VIDEO_FORMAT_GRAY16_LE);
+
+  return FALSE;
+}
+
+/* Bytes per pixel of the source pixelformats gst_zcm_convert() reads */
+static gint
+src_pstride (gint32 pixelformat)
+{
+  gboolean le;
+  if (rgb_pstride (pixelformat) > 0) return rgb_pstride (pixelformat);
+  if (bayer_pattern (pixelformat)) return 1;
+  if (is_gray16 (pixelformat, &le)) return 2;
+  return 0;
+}
+
+gboolean
+gst_zcm_convert (gint32 pixelformat, const guint8 * src, gsize src_size,
+    gint src_stride, const GstVideoInfo * info, guint8 * dst)
+{
+  if (!gst_zcm_convert_supported (pixelformat, GST_VIDEO_INFO_FORMAT (info)))
+    return FALSE;
+
+  gint width = GST_VIDEO_INFO_WIDTH (info);
+  gint height = GST_VIDEO_INFO_HEIGHT (info);
+  if (height <= 0 || width <= 0) return TRUE;
+
+  gint row = width * src_pstride (pixelformat);
+  if (src_stride == 0) src_stride = row;
+  if (src_stride < row ||
+      src_size < (gsize) src_stride * (height - 1) + row) return FALSE;
+
+  const gint* pattern = bayer_pattern (pixelformat);
+  gint ps = rgb_pstride (pixelformat);
+
+  if (ps > 0) {
+    // Each call gets its layout as constants so it is specialized
+    switch (pixelformat) {
+      case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_RGB:
+        rgb_to_yuv420 (src, src_stride, 3, 0, 1, 2, info, dst);
+        break;
+      case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BGR:
+        rgb_to_yuv420 (src, src_stride, 3, 2, 1, 0, info, dst);
+        break;
+      case ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_RGBA:
+        rgb_to_yuv420 (src, src_stride, 4, 0, 1, 2, info, dst);
+        break;
+      default:
+        rgb_to_yuv420 (src, src_stride, 4, 2, 1, 0, info, dst);
+        break;
+    }
+  } else if (pattern) {
+    // Mirroring the neighbours needs two rows and columns
+    if (width < 2 || height < 2) return FALSE;
+    switch (GST_VIDEO_INFO_FORMAT (info)) {
+      case GST_VIDEO_FORMAT_RGB:
+        bayer_to_rgb (src, src_stride, pattern, 3, 0, 1, 2, -1, info, dst);
+        break;
+      case GST_VIDEO_FORMAT_BGR:
+        bayer_to_rgb (src, src_stride, pattern, 3, 2, 1, 0, -1, info, dst);
+        break;
+      case GST_VIDEO_FORMAT_RGBA:
+      case GST_VIDEO_FORMAT_RGBx:
+        bayer_to_rgb (src, src_stride, pattern, 4, 0, 1, 2, 3, info, dst);
+        break;
+      default:
+        bayer_to_rgb (src, src_stride, pattern, 4, 2, 1, 0, 3, info, dst);
+        break;
+    }
+  } else {
+    swap16 (src, src_stride, info, dst);
+  }
+
+  return TRUE;
+}
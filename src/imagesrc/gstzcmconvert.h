@@ -0,0 +1,39 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMCONVERT_H_
+#define _GST_ZCMCONVERT_H_
+
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/* Whether image_t frames of pixelformat can be converted to format */
+gboolean gst_zcm_convert_supported (gint32 pixelformat, GstVideoFormat format);
+
+/* Converts the frame src of pixelformat, src_size bytes whose rows are
+ * src_stride bytes apart (0 for tightly packed rows), into dst laid out as
+ * info describes. Width and height come from info. Returns FALSE if the
+ * conversion is not supported or src is too small for the frame. */
+gboolean gst_zcm_convert (gint32 pixelformat, const guint8 * src,
+    gsize src_size, gint src_stride, const GstVideoInfo * info, guint8 * dst);
+
+G_END_DECLS
+
+#endif
@@ -28,6 +28,36 @@
  * gst-launch-1.0 zcmimagesrc channel=GSTREAMER_DATA url=ipc verbose=true do-timestamp=true ! videoconvert ! autovideosink
  * ]|
  * Receives frame over GSTREAMER_DATA channel
+ * |[
+ * gst-launch-1.0 zcmimagesrc channel=GSTREAMER_DATA batched=true ! videoconvert ! autovideosink
+ * ]|
+ * Receives image_batch_t messages from a zcmimagesink with batching enabled
+ * and pushes their frames downstream as buffer lists
+ * |[
+ * gst-launch-1.0 zcmimagesrc channel=CAMERA_H264 encoded=true ! h264parse ! avdec_h264 ! videoconvert ! autovideosink
+ * ]|
+ * Receives the encoded_image_t stream of a zcmimagesink fed H.264. Frames up
+ * to the first keyframe are dropped, and keyframe_request_t messages are
+ * published on keyframe-channel meanwhile so the sender's encoder produces
+ * one right away.
+ * |[
+ * gst-launch-1.0 zcmimagesrc channel=CAMERA latest-channel=GSTREAMER_LATEST ! videoconvert ! autovideosink
+ * ]|
+ * Asks a zcmimagesink with latched=true for its last frame on start, so the
+ * pipeline prerolls without waiting for the next published frame.
+ * |[
+ * gst-launch-1.0 zcmimagesrc channel=CAMERA output-format=I420 ! x264enc ! mp4mux ! filesink location=camera.mp4
+ * ]|
+ * Converts BGRA / RGB frames to I420 while copying them out of the received
+ * message, instead of in a separate videoconvert. RGB, BGR, RGBA and BGRA
+ * convert to I420 and NV12, 8 bit Bayer to RGB, BGR, RGBA, BGRA, RGBx and
+ * BGRx, and 16 bit gray to the other byte order.
+ * |[
+ * gst-launch-1.0 zcmimagesrc channel=CAMERA_4K hugepages=true ! videoconvert ! autovideosink
+ * ]|
+ * Keeps the received frame and the buffers it is copied into on huge pages,
+ * which pays off from 4K frames up. Falls back to normal pages where the
+ * system has no huge pages.
  * </refsect2>
  */
 
@@ -47,10 +77,16 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include "gstzcmimagesrc.h"
+#include "gstzcmtransport.h"
+#include "gstzcmformat.h"
+#include "gstzcmconvert.h"
+#include "gstzcmhugepage.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_zcmimagesrc_debug);
 #define GST_CAT_DEFAULT gst_zcmimagesrc_debug
 #define DEFAULT_BLOCKSIZE       40*1024*1024
+#define MAX_PENDING_BUFFERS     1024
+#define KEYFRAME_REQUEST_INTERVAL_US (1000 * 1000)
 
 /* Filter signals and args */
 enum
@@ -59,6 +95,12 @@ enum
     PROP_CHANNEL,
     PROP_ZCM_URL,
     PROP_VERBOSE,
+    PROP_BATCHED,
+    PROP_ENCODED,
+    PROP_KEYFRAME_CHANNEL,
+    PROP_LATEST_CHANNEL,
+    PROP_OUTPUT_FORMAT,
+    PROP_HUGEPAGES,
 };
 
 static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
@@ -68,7 +110,9 @@ static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
     );
 
 #define gst_zcmimagesrc_parent_class parent_class
-G_DEFINE_TYPE (GstZcmImageSrc, gst_zcmimagesrc, GST_TYPE_BASE_SRC);
+G_DEFINE_TYPE_WITH_CODE (GstZcmImageSrc, gst_zcmimagesrc, GST_TYPE_BASE_SRC,
+    GST_DEBUG_CATEGORY_INIT (gst_zcmimagesrc_debug, "zcmimagesrc",
+        0, "zcmimagesrc element"));
 
 static void gst_zcmimagesrc_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
@@ -81,6 +125,9 @@ static gboolean gst_zcmimagesrc_start (GstBaseSrc * basesrc);
 static gboolean gst_zcmimagesrc_stop (GstBaseSrc * basesrc);
 static GstFlowReturn gst_zcmimagesrc_fill (GstBaseSrc * src, guint64 offset,
     guint length, GstBuffer * buf);
+static GstFlowReturn gst_zcmimagesrc_create (GstBaseSrc * src, guint64 offset,
+    guint length, GstBuffer ** buf);
+static gboolean gst_zcmimagesrc_decide_allocation (GstBaseSrc * src, GstQuery * query);
 
 static void gst_zcmimagesrc_finalize (GObject * object);
 static int  gst_update_src_caps (GstBaseSrc * src, GstZcmImageSrc *filter, GstBuffer *buffer);
@@ -117,6 +164,40 @@ gst_zcmimagesrc_class_init (GstZcmImageSrcClass * klass)
             g_param_spec_boolean ("verbose", "Verbose", "Produce verbose output",
                 FALSE, G_PARAM_READWRITE));
 
+    g_object_class_install_property (gobject_class, PROP_BATCHED,
+            g_param_spec_boolean ("batched", "Batched",
+                "Subscribe to image_batch_t messages and push their frames as buffer lists",
+                FALSE, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, PROP_ENCODED,
+            g_param_spec_boolean ("encoded", "Encoded",
+                "Subscribe to encoded_image_t messages and push H.264 / H.265 access units",
+                FALSE, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, PROP_KEYFRAME_CHANNEL,
+          g_param_spec_string ("keyframe-channel", "Zcm keyframe request channel",
+              "Channel to publish keyframe_request_t messages to while waiting "
+              "for a keyframe of an encoded stream (empty disables requests)",
+              "GSTREAMER_KEYFRAME", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (gobject_class, PROP_LATEST_CHANNEL,
+          g_param_spec_string ("latest-channel", "Zcm latest frame request channel",
+              "Channel to publish a latest_request_t to on start, answered by "
+              "latched zcmimagesinks with their last frame (empty disables)",
+              "GSTREAMER_LATEST", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (gobject_class, PROP_OUTPUT_FORMAT,
+          g_param_spec_string ("output-format", "Output format",
+              "Video format to convert raw frames to while copying them out, "
+              "e.g. I420 or NV12 (empty pushes frames as received)",
+              "", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (gobject_class, PROP_HUGEPAGES,
+            g_param_spec_boolean ("hugepages", "Huge pages",
+                "Back received frames and output buffers with huge pages, "
+                "falling back to normal pages where there are none",
+                FALSE, G_PARAM_READWRITE));
+
     gst_element_class_set_details_simple(gstelement_class,
             "zcmimagesrc",
             "ZCM SOURCE",
@@ -129,6 +210,8 @@ gst_zcmimagesrc_class_init (GstZcmImageSrcClass * klass)
     gstbasesrc_class->start = GST_DEBUG_FUNCPTR (gst_zcmimagesrc_start);
     gstbasesrc_class->stop = GST_DEBUG_FUNCPTR (gst_zcmimagesrc_stop);
     gstbasesrc_class->fill = GST_DEBUG_FUNCPTR (gst_zcmimagesrc_fill);
+    gstbasesrc_class->create = GST_DEBUG_FUNCPTR (gst_zcmimagesrc_create);
+    gstbasesrc_class->decide_allocation = GST_DEBUG_FUNCPTR (gst_zcmimagesrc_decide_allocation);
     gobject_class->finalize = gst_zcmimagesrc_finalize;
 
     gstelement_class->change_state =  GST_DEBUG_FUNCPTR (gst_zcmimagesrc_change_state);
@@ -139,6 +222,54 @@ static void gst_zcmimagesrc_finalize (GObject * object)
     G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+/* Whether frames of pixelformat are converted to output-format */
+static gboolean needs_conversion (GstZcmImageSrc *zcmimagesrc, gint32 pixelformat)
+{
+    return zcmimagesrc->output_format != GST_VIDEO_FORMAT_UNKNOWN &&
+           zcmimagesrc->output_format != gst_zcm_format_from_pixelformat (pixelformat);
+}
+
+/* Makes image_info->buf hold size bytes, on huge pages if asked to. Called
+ * with mutx held. */
+static void reserve_image_buf (GstZcmImageSrc *zcmimagesrc, gsize size)
+{
+    ZcmImageInfo *info = zcmimagesrc->image_info;
+
+    if (zcmimagesrc->hugepages)
+    {
+        if (info->capacity >= size)
+            return;
+        if (info->capacity == 0)
+            free (info->buf);
+        else
+            gst_zcm_hugepage_free (info->buf, info->capacity);
+        info->capacity = size;
+        info->buf = gst_zcm_hugepage_alloc (&info->capacity);
+        if (info->buf)
+            return;
+        info->capacity = 0;
+    }
+    else if (info->capacity > 0)
+    {
+        gst_zcm_hugepage_free (info->buf, info->capacity);
+        info->buf = NULL;
+        info->capacity = 0;
+    }
+    info->buf = realloc (info->buf, size);
+}
+
+/* A new buffer for a frame of size bytes from the batch handler */
+static GstBuffer *new_frame_buffer (GstZcmImageSrc *zcmimagesrc, gsize size)
+{
+    if (!zcmimagesrc->hugepages)
+        return gst_buffer_new_allocate (NULL, size, NULL);
+
+    GstAllocator *allocator = gst_zcm_hugepage_allocator_get ();
+    GstBuffer *buf = gst_buffer_new_allocate (allocator, size, NULL);
+    gst_object_unref (allocator);
+    return buf;
+}
+
 static void zcm_image_handler(const zcm_recv_buf_t *rbuf, const char *channel,
                        const zcm_gstreamer_plugins_image_t *img, void *user)
 {
@@ -160,9 +291,11 @@ static void zcm_image_handler(const zcm_recv_buf_t *rbuf, const char *channel,
 
         zcmimagesrc->image_info->width  = img->width;
         zcmimagesrc->image_info->height = img->height;
+        zcmimagesrc->image_info->stride = img->num_strides > 0 ? img->stride[0] : 0;
 
-        if (img->size != zcmimagesrc->image_info->size) {
-            zcmimagesrc->image_info->buf = realloc(zcmimagesrc->image_info->buf, img->size);
+        if (img->size != zcmimagesrc->image_info->size ||
+            zcmimagesrc->hugepages != (zcmimagesrc->image_info->capacity > 0)) {
+            reserve_image_buf (zcmimagesrc, img->size);
             zcmimagesrc->image_info->size = img->size;
         }
         memcpy(zcmimagesrc->image_info->buf, img->data, img->size);
@@ -171,28 +304,317 @@ static void zcm_image_handler(const zcm_recv_buf_t *rbuf, const char *channel,
         zcmimagesrc->image_info->framerate_den = 1;
 
         zcmimagesrc->image_info->frame_type = img->pixelformat;
+        zcmimagesrc->frame_ready = TRUE;
+        zcmimagesrc->got_frame = TRUE;
 
         g_cond_broadcast(zcmimagesrc->cond);
     }
     g_mutex_unlock (zcmimagesrc->mutx);
 }
 
+static void zcm_image_batch_handler(const zcm_recv_buf_t *rbuf, const char *channel,
+                       const zcm_gstreamer_plugins_image_batch_t *batch, void *user)
+{
+    GstZcmImageSrc *zcmimagesrc = (GstZcmImageSrc *)user;
+    g_mutex_lock (zcmimagesrc->mutx);
+    if (zcmimagesrc->verbose == TRUE)
+    {
+        g_print ("got image batch %p\n", batch);
+        g_print ("batch time %ld\n", batch->utime);
+        g_print ("batch images %d\n", batch->num_images);
+    }
+
+    if (gst_buffer_list_length (zcmimagesrc->pending) + batch->num_images > MAX_PENDING_BUFFERS)
+    {
+        GST_WARNING_OBJECT (zcmimagesrc, "dropping %u pending frames",
+                            gst_buffer_list_length (zcmimagesrc->pending));
+        gst_buffer_list_remove (zcmimagesrc->pending, 0,
+                                gst_buffer_list_length (zcmimagesrc->pending));
+        g_array_set_size (zcmimagesrc->pending_utime, 0);
+    }
+
+    if (batch->num_images > 0)
+        zcmimagesrc->got_frame = TRUE;
+
+    for (int i = 0; i < batch->num_images; ++i)
+    {
+        const zcm_gstreamer_plugins_image_t *img = &batch->images[i];
+        if (img->data == NULL) continue;
+
+        if (!zcmimagesrc->image_info) {
+            zcmimagesrc->image_info = (ZcmImageInfo*) calloc(1, sizeof(ZcmImageInfo));
+        }
+
+        /* Pending frames all go out under the caps of the last one */
+        if ((img->width != zcmimagesrc->image_info->width ||
+             img->height != zcmimagesrc->image_info->height ||
+             img->pixelformat != zcmimagesrc->image_info->frame_type) &&
+            gst_buffer_list_length (zcmimagesrc->pending) > 0)
+        {
+            GST_WARNING_OBJECT (zcmimagesrc, "dropping %u pending frames of the previous format",
+                                gst_buffer_list_length (zcmimagesrc->pending));
+            gst_buffer_list_remove (zcmimagesrc->pending, 0,
+                                    gst_buffer_list_length (zcmimagesrc->pending));
+            g_array_set_size (zcmimagesrc->pending_utime, 0);
+        }
+
+        zcmimagesrc->image_info->width  = img->width;
+        zcmimagesrc->image_info->height = img->height;
+        zcmimagesrc->image_info->stride = img->num_strides > 0 ? img->stride[0] : 0;
+        zcmimagesrc->image_info->framerate_num = 0;
+        zcmimagesrc->image_info->framerate_den = 1;
+        zcmimagesrc->image_info->frame_type = img->pixelformat;
+
+        GstBuffer *buf = NULL;
+        if (needs_conversion (zcmimagesrc, img->pixelformat) &&
+            gst_zcm_convert_supported (img->pixelformat, zcmimagesrc->output_format))
+        {
+            /* Converted straight out of the message, in place of the copy */
+            GstVideoInfo out;
+            gst_video_info_set_format (&out, zcmimagesrc->output_format, img->width, img->height);
+            buf = new_frame_buffer (zcmimagesrc, GST_VIDEO_INFO_SIZE (&out));
+            GstMapInfo map;
+            if (!gst_buffer_map (buf, &map, GST_MAP_WRITE))
+            {
+                GST_WARNING_OBJECT (zcmimagesrc, "dropping a frame that could not be mapped");
+                gst_buffer_unref (buf);
+                continue;
+            }
+            gboolean converted = gst_zcm_convert (img->pixelformat, img->data, img->size,
+                                                  zcmimagesrc->image_info->stride, &out, map.data);
+            gst_buffer_unmap (buf, &map);
+            if (!converted)
+            {
+                GST_WARNING_OBJECT (zcmimagesrc, "dropping a frame that could not be converted");
+                gst_buffer_unref (buf);
+                continue;
+            }
+        }
+        else
+        {
+            buf = new_frame_buffer (zcmimagesrc, img->size);
+            gst_buffer_fill (buf, 0, img->data, img->size);
+        }
+        gst_buffer_list_add (zcmimagesrc->pending, buf);
+        g_array_append_val (zcmimagesrc->pending_utime, img->utime);
+    }
+
+    if (gst_buffer_list_length (zcmimagesrc->pending) > 0)
+        g_cond_broadcast(zcmimagesrc->cond);
+    g_mutex_unlock (zcmimagesrc->mutx);
+}
+
+/* Last frame of a latched sender, in reply to our latest_request_t. Once a
+ * live frame is in, the reply is older than it and only sends time backwards.
+ * Both handlers run on the zcm dispatch thread, so got_frame cannot change
+ * between the check and the handling. */
+static void zcm_latest_image_handler(const zcm_recv_buf_t *rbuf, const char *channel,
+                       const zcm_gstreamer_plugins_image_t *img, void *user)
+{
+    GstZcmImageSrc *zcmimagesrc = (GstZcmImageSrc *)user;
+    g_mutex_lock (zcmimagesrc->mutx);
+    gboolean stale = zcmimagesrc->got_frame;
+    g_mutex_unlock (zcmimagesrc->mutx);
+    if (stale)
+    {
+        GST_DEBUG_OBJECT (zcmimagesrc, "ignoring a latched frame older than the live ones");
+        return;
+    }
+
+    if (zcmimagesrc->batched)
+    {
+        zcm_gstreamer_plugins_image_batch_t batch;
+        batch.utime = img->utime;
+        batch.num_images = 1;
+        batch.images = (zcm_gstreamer_plugins_image_t *)img;
+        zcm_image_batch_handler(rbuf, channel, &batch, user);
+    }
+    else
+    {
+        zcm_image_handler(rbuf, channel, img, user);
+    }
+}
+
+/* Asks the sender for a keyframe, at most once per
+ * KEYFRAME_REQUEST_INTERVAL_US. Called with mutx held. */
+static void request_keyframe (GstZcmImageSrc *zcmimagesrc)
+{
+    if (!zcmimagesrc->keyframe_channel || !*zcmimagesrc->keyframe_channel)
+        return;
+
+    gint64 now = g_get_monotonic_time ();
+    if (zcmimagesrc->last_keyframe_request != 0 &&
+        now - zcmimagesrc->last_keyframe_request < KEYFRAME_REQUEST_INTERVAL_US)
+        return;
+    zcmimagesrc->last_keyframe_request = now;
+
+    zcm_gstreamer_plugins_keyframe_request_t req;
+    req.utime = g_get_real_time ();
+    req.channel = zcmimagesrc->channel;
+    zcm_gstreamer_plugins_keyframe_request_t_publish (zcmimagesrc->zcm,
+                                                      zcmimagesrc->keyframe_channel, &req);
+}
+
+/* Caps of the stream an encoded_image_t belongs to, NULL for unknown codecs */
+static GstCaps *encoded_caps (const zcm_gstreamer_plugins_encoded_image_t *img)
+{
+    gboolean h265 = img->codec == ZCM_GSTREAMER_PLUGINS_ENCODED_IMAGE_T_CODEC_H265;
+    if (!h265 && img->codec != ZCM_GSTREAMER_PLUGINS_ENCODED_IMAGE_T_CODEC_H264)
+        return NULL;
+
+    const gchar *format = "byte-stream";
+    if (img->stream_format == ZCM_GSTREAMER_PLUGINS_ENCODED_IMAGE_T_STREAM_FORMAT_PACKETIZED)
+        format = h265 ? "hvc1" : "avc";
+
+    GstCaps *caps = gst_caps_new_simple (h265 ? "video/x-h265" : "video/x-h264",
+                                         "stream-format", G_TYPE_STRING, format,
+                                         "alignment", G_TYPE_STRING, "au", NULL);
+    if (img->width > 0 && img->height > 0)
+        gst_caps_set_simple (caps, "width", G_TYPE_INT, img->width,
+                             "height", G_TYPE_INT, img->height, NULL);
+
+    if (img->codec_data_size > 0)
+    {
+        GstBuffer *codec_data = gst_buffer_new_allocate (NULL, img->codec_data_size, NULL);
+        gst_buffer_fill (codec_data, 0, img->codec_data, img->codec_data_size);
+        gst_caps_set_simple (caps, "codec_data", GST_TYPE_BUFFER, codec_data, NULL);
+        gst_buffer_unref (codec_data);
+    }
+
+    return caps;
+}
+
+static void zcm_encoded_image_handler(const zcm_recv_buf_t *rbuf, const char *channel,
+                       const zcm_gstreamer_plugins_encoded_image_t *img, void *user)
+{
+    GstZcmImageSrc *zcmimagesrc = (GstZcmImageSrc *)user;
+    g_mutex_lock (zcmimagesrc->mutx);
+    if (zcmimagesrc->verbose == TRUE)
+    {
+        g_print ("got encoded image %p\n", img);
+        g_print ("image time %ld\n", img->utime);
+        g_print ("image size %d keyframe %d\n", img->size, img->keyframe);
+    }
+
+    // Frames after a dropped one can't be decoded until the next keyframe
+    if (gst_buffer_list_length (zcmimagesrc->pending) >= MAX_PENDING_BUFFERS)
+    {
+        GST_WARNING_OBJECT (zcmimagesrc, "dropping %u pending frames",
+                            gst_buffer_list_length (zcmimagesrc->pending));
+        gst_buffer_list_remove (zcmimagesrc->pending, 0,
+                                gst_buffer_list_length (zcmimagesrc->pending));
+        zcmimagesrc->need_keyframe = TRUE;
+    }
+
+    if (!img->keyframe && zcmimagesrc->need_keyframe)
+    {
+        request_keyframe (zcmimagesrc);
+        g_mutex_unlock (zcmimagesrc->mutx);
+        return;
+    }
+
+    // Only a keyframe can start a stream with different caps
+    if (img->keyframe)
+    {
+        GstCaps *caps = encoded_caps (img);
+        if (!caps)
+        {
+            GST_WARNING_OBJECT (zcmimagesrc, "unknown codec 0x%08x", img->codec);
+            g_mutex_unlock (zcmimagesrc->mutx);
+            return;
+        }
+        if (!zcmimagesrc->encoded_caps || !gst_caps_is_equal (caps, zcmimagesrc->encoded_caps))
+        {
+            // Pending frames belong to the previous stream
+            gst_buffer_list_remove (zcmimagesrc->pending, 0,
+                                    gst_buffer_list_length (zcmimagesrc->pending));
+            gst_caps_replace (&zcmimagesrc->encoded_caps, caps);
+            zcmimagesrc->update_caps = TRUE;
+            zcmimagesrc->have_ts_offset = FALSE;
+        }
+        gst_caps_unref (caps);
+        zcmimagesrc->need_keyframe = FALSE;
+    }
+
+    GstBuffer *buf = gst_buffer_new_allocate (NULL, img->size, NULL);
+    gst_buffer_fill (buf, 0, img->data, img->size);
+    GST_BUFFER_PTS (buf) = img->pts >= 0 ? (GstClockTime) img->pts : GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DTS (buf) = img->dts >= 0 ? (GstClockTime) img->dts : GST_CLOCK_TIME_NONE;
+    if (!img->keyframe)
+        GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+    gst_buffer_list_add (zcmimagesrc->pending, buf);
+
+    g_cond_broadcast(zcmimagesrc->cond);
+    g_mutex_unlock (zcmimagesrc->mutx);
+}
+
 static gboolean zcm_source_init (GstZcmImageSrc *zcmimagesrc)
 {
     zcmimagesrc->update_caps = TRUE;
+    zcmimagesrc->got_frame = FALSE;
     zcmimagesrc->cond = g_new(GCond,1);
     zcmimagesrc->mutx = g_new(GMutex,1);
     g_mutex_init(zcmimagesrc->mutx);
     g_cond_init(zcmimagesrc->cond);
     const char *channel = zcmimagesrc->channel;
-    zcmimagesrc->zcm = zcm_create(zcmimagesrc->zcm_url);
+    zcmimagesrc->zcm = gst_zcm_transport_acquire(zcmimagesrc->zcm_url);
     if (!zcmimagesrc->zcm)
     {
         g_print ("Initialization failed\n");
         return FALSE;
     }
-    zcm_gstreamer_plugins_image_t_subscribe(zcmimagesrc->zcm, channel, &zcm_image_handler, zcmimagesrc);
-    zcm_start(zcmimagesrc->zcm);
+    if (zcmimagesrc->encoded)
+    {
+        zcmimagesrc->pending = gst_buffer_list_new ();
+        zcmimagesrc->need_keyframe = TRUE;
+        zcmimagesrc->have_ts_offset = FALSE;
+        zcmimagesrc->encoded_sub =
+            zcm_gstreamer_plugins_encoded_image_t_subscribe(zcmimagesrc->zcm, channel,
+                                                            &zcm_encoded_image_handler, zcmimagesrc);
+    }
+    else if (zcmimagesrc->batched)
+    {
+        zcmimagesrc->pending = gst_buffer_list_new ();
+        zcmimagesrc->pending_utime = g_array_new (FALSE, FALSE, sizeof(int64_t));
+        zcmimagesrc->batch_sub =
+            zcm_gstreamer_plugins_image_batch_t_subscribe(zcmimagesrc->zcm, channel,
+                                                          &zcm_image_batch_handler, zcmimagesrc);
+    }
+    else
+    {
+        zcmimagesrc->image_sub =
+            zcm_gstreamer_plugins_image_t_subscribe(zcmimagesrc->zcm, channel, &zcm_image_handler, zcmimagesrc);
+    }
+
+    // Encoded streams can only start on a keyframe, which request_keyframe()
+    // takes care of, so only raw and JPEG frames are latched by the sender
+    gboolean want_latest = !zcmimagesrc->encoded && zcmimagesrc->latest_channel &&
+                           *zcmimagesrc->latest_channel;
+    if (want_latest)
+    {
+        g_free (zcmimagesrc->latest_reply_channel);
+        zcmimagesrc->latest_reply_channel = g_strdup_printf ("%s_LATEST_%d_%p",
+                                                             channel, getpid (), zcmimagesrc);
+        zcmimagesrc->latest_sub =
+            zcm_gstreamer_plugins_image_t_subscribe(zcmimagesrc->zcm, zcmimagesrc->latest_reply_channel,
+                                                    &zcm_latest_image_handler, zcmimagesrc);
+    }
+
+    if (zcmimagesrc->encoded)
+    {
+        g_mutex_lock (zcmimagesrc->mutx);
+        request_keyframe (zcmimagesrc);
+        g_mutex_unlock (zcmimagesrc->mutx);
+    }
+    else if (want_latest)
+    {
+        zcm_gstreamer_plugins_latest_request_t req;
+        req.utime = g_get_real_time ();
+        req.channel = (char *)channel;
+        req.reply_channel = zcmimagesrc->latest_reply_channel;
+        zcm_gstreamer_plugins_latest_request_t_publish (zcmimagesrc->zcm,
+                                                        zcmimagesrc->latest_channel, &req);
+    }
     return TRUE;
 }
 
@@ -205,6 +627,27 @@ static gboolean gst_zcmimagesrc_start (GstBaseSrc * basesrc)
 
 static void zcm_source_stop (GstZcmImageSrc *filter)
 {
+    if (filter->zcm)
+    {
+        /* The transport is shared with other elements on the same url, only
+           our subscriptions go away with us */
+        if (filter->image_sub)
+            zcm_gstreamer_plugins_image_t_unsubscribe(filter->zcm, filter->image_sub);
+        if (filter->batch_sub)
+            zcm_gstreamer_plugins_image_batch_t_unsubscribe(filter->zcm, filter->batch_sub);
+        if (filter->encoded_sub)
+            zcm_gstreamer_plugins_encoded_image_t_unsubscribe(filter->zcm, filter->encoded_sub);
+        if (filter->latest_sub)
+            zcm_gstreamer_plugins_image_t_unsubscribe(filter->zcm, filter->latest_sub);
+        filter->image_sub = NULL;
+        filter->batch_sub = NULL;
+        filter->encoded_sub = NULL;
+        filter->latest_sub = NULL;
+
+        gst_zcm_transport_release(filter->zcm);
+        filter->zcm = NULL;
+    }
+
 // Putting this in causes a deadlock on a failed pipeline
 /*
     g_mutex_lock (filter->mutx);
@@ -220,8 +663,6 @@ static void zcm_source_stop (GstZcmImageSrc *filter)
     g_mutex_clear (filter->mutx);
     g_free (filter->mutx);
     g_free (filter->cond);
-    zcm_stop(filter->zcm);
-    zcm_destroy(filter->zcm);
 */
 }
 
@@ -237,6 +678,29 @@ gst_update_src_caps (GstBaseSrc * src, GstZcmImageSrc *filter, GstBuffer *buffer
 {
     GstCaps *caps = NULL;
 
+    filter->convert = needs_conversion (filter, filter->frame_info.frame_type);
+    if (filter->convert)
+    {
+        if (!gst_zcm_convert_supported (filter->frame_info.frame_type, filter->output_format))
+        {
+            g_print ("cannot convert frametype %d to %s\n", filter->frame_info.frame_type,
+                     gst_video_format_to_string (filter->output_format));
+            return -1;
+        }
+
+        gst_video_info_set_format (&filter->output_info, filter->output_format,
+                                   filter->frame_info.width, filter->frame_info.height);
+        filter->output_info.fps_n = 25;
+        filter->output_info.fps_d = 1;
+        caps = gst_video_info_to_caps (&filter->output_info);
+        /* The colorimetry the conversion kernels implement */
+        if (GST_VIDEO_INFO_IS_YUV (&filter->output_info))
+            gst_caps_set_simple (caps, "colorimetry", G_TYPE_STRING, "bt601", NULL);
+        gst_base_src_set_caps (src, caps);
+        gst_caps_unref (caps);
+        return 0;
+    }
+
     caps = (GstCaps *)gst_type_find_helper_for_buffer (GST_OBJECT (src),
                                                                 buffer, NULL);
 
@@ -269,20 +733,18 @@ gst_update_src_caps (GstBaseSrc * src, GstZcmImageSrc *filter, GstBuffer *buffer
     * If not, it means it has been requested not to drop data, and
     * upstream and/or app must know what they are doing ... */
 
-    if (filter->frame_info.frame_type == ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_I420)
-        gst_caps_set_simple (caps, "format", G_TYPE_STRING, "I420", NULL);
-    else if (filter->frame_info.frame_type == ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_RGB)
-        gst_caps_set_simple (caps, "format", G_TYPE_STRING, "RGB", NULL);
-    else if (filter->frame_info.frame_type == ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BGR)
-        gst_caps_set_simple (caps, "format", G_TYPE_STRING, "BGR", NULL);
-    else if (filter->frame_info.frame_type == ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_RGBA)
-        gst_caps_set_simple (caps, "format", G_TYPE_STRING, "RGBA", NULL);
-    else if (filter->frame_info.frame_type == ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_BGRA)
-        gst_caps_set_simple (caps, "format", G_TYPE_STRING, "BGRA", NULL);
-    else if (filter->frame_info.frame_type == ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_MJPEG)
+    if (filter->frame_info.frame_type == ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_MJPEG)
+    {
         gst_caps_set_simple (caps, "format", G_TYPE_STRING, "MJPEG", NULL);
+    }
     else
-        return -1;
+    {
+        GstVideoFormat format = gst_zcm_format_from_pixelformat (filter->frame_info.frame_type);
+        if (format == GST_VIDEO_FORMAT_UNKNOWN)
+            return -1;
+        gst_caps_set_simple (caps, "format", G_TYPE_STRING,
+                             gst_video_format_to_string (format), NULL);
+    }
 
     gst_caps_set_simple (caps, "framerate", GST_TYPE_FRACTION, 25, 1, NULL);
     gst_caps_set_simple (caps, "width", G_TYPE_INT, filter->frame_info.width,
@@ -292,6 +754,38 @@ gst_update_src_caps (GstBaseSrc * src, GstZcmImageSrc *filter, GstBuffer *buffer
 
 }
 
+/* Fills frames into pooled huge page buffers when hugepages is set, in place
+ * of whatever downstream offered, as the pool keeps their pages mapped */
+static gboolean
+gst_zcmimagesrc_decide_allocation (GstBaseSrc * src, GstQuery * query)
+{
+    GstZcmImageSrc *filter = (GstZcmImageSrc *)src;
+
+    if (filter->hugepages)
+    {
+        GstBufferPool *pool = NULL;
+        guint size = 0, min = 0, max = 0;
+        gboolean update = gst_query_get_n_allocation_pools (query) > 0;
+        if (update)
+        {
+            gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+            if (pool)
+                gst_object_unref (pool);
+        }
+        pool = gst_zcm_hugepage_pool_new ();
+        /* fill copies whole frames into buffers of blocksize */
+        size = MAX (size, gst_base_src_get_blocksize (src));
+
+        if (update)
+            gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+        else
+            gst_query_add_allocation_pool (query, pool, size, min, max);
+        gst_object_unref (pool);
+    }
+
+    return GST_BASE_SRC_CLASS (parent_class)->decide_allocation (src, query);
+}
+
 static GstFlowReturn gst_zcmimagesrc_fill (GstBaseSrc * src, guint64 offset,
     guint length, GstBuffer * buf)
 {
@@ -302,8 +796,14 @@ static GstFlowReturn gst_zcmimagesrc_fill (GstBaseSrc * src, guint64 offset,
     /* Waiting for buffer */
     g_mutex_lock (filter->mutx);
 
-    /*Condition wait is done to sync with zcm image output*/
-    g_cond_wait_until (filter->cond, filter->mutx, endtime);
+    /*Condition wait is done to sync with zcm image output. A frame may
+      already be waiting, e.g. the latched one that answered our request*/
+    while (!filter->frame_ready)
+    {
+        if (!g_cond_wait_until (filter->cond, filter->mutx, endtime))
+            break;
+    }
+    filter->frame_ready = FALSE;
 
     if (filter->image_info == NULL)
     {
@@ -314,6 +814,13 @@ static GstFlowReturn gst_zcmimagesrc_fill (GstBaseSrc * src, guint64 offset,
         return GST_FLOW_EOS;
     }
 
+    /* Converted frames are laid out for the negotiated size and format */
+    if (filter->convert &&
+        (filter->image_info->width != filter->frame_info.width ||
+         filter->image_info->height != filter->frame_info.height ||
+         filter->image_info->frame_type != filter->frame_info.frame_type))
+        filter->update_caps = TRUE;
+
     if (filter->update_caps == TRUE)
     {
         filter->frame_info.width = filter->image_info->width;
@@ -324,21 +831,201 @@ static GstFlowReturn gst_zcmimagesrc_fill (GstBaseSrc * src, guint64 offset,
         if (gst_update_src_caps (src, filter,buf) == -1)
         {
             g_print ("frametype %d not supported", filter->frame_info.frame_type);
+            g_mutex_unlock (filter->mutx);
             return GST_FLOW_ERROR;
         }
 
         filter->update_caps = FALSE;
     }
 
-    gst_buffer_map (buf, &info, GST_MAP_WRITE);
-    gst_buffer_resize (buf, 0, filter->image_info->size);
-    memcpy(info.data, filter->image_info->buf, filter->image_info->size);
-    gst_buffer_unmap (buf, &info);
+    if (filter->convert)
+    {
+        gst_buffer_set_size (buf, GST_VIDEO_INFO_SIZE (&filter->output_info));
+        if (!gst_buffer_map (buf, &info, GST_MAP_WRITE))
+        {
+            g_print ("could not map the output buffer\n");
+            g_mutex_unlock (filter->mutx);
+            return GST_FLOW_ERROR;
+        }
+        gboolean converted = gst_zcm_convert (filter->frame_info.frame_type,
+                                              filter->image_info->buf, filter->image_info->size,
+                                              filter->image_info->stride,
+                                              &filter->output_info, info.data);
+        gst_buffer_unmap (buf, &info);
+        if (!converted)
+        {
+            g_print ("frame could not be converted to %s\n",
+                     gst_video_format_to_string (filter->output_format));
+            g_mutex_unlock (filter->mutx);
+            return GST_FLOW_ERROR;
+        }
+    }
+    else
+    {
+        gst_buffer_map (buf, &info, GST_MAP_WRITE);
+        gst_buffer_resize (buf, 0, filter->image_info->size);
+        memcpy(info.data, filter->image_info->buf, filter->image_info->size);
+        gst_buffer_unmap (buf, &info);
+    }
 
     g_mutex_unlock (filter->mutx);
     return GST_FLOW_OK;
 }
 
+/* Spreads the frames of a batch back out in running time, keeping the
+ * spacing their publisher recorded and ending the batch at the current time */
+static void
+timestamp_buffer_list (GstBaseSrc * src, GstBufferList * list, GArray * utimes)
+{
+    GstClock *clock = gst_element_get_clock (GST_ELEMENT (src));
+    if (!clock)
+        return;
+
+    GstClockTime now = gst_clock_get_time (clock);
+    GstClockTime base_time = gst_element_get_base_time (GST_ELEMENT (src));
+    gst_object_unref (clock);
+    if (now < base_time)
+        return;
+
+    GstClockTime running = now - base_time;
+    guint n = gst_buffer_list_length (list);
+    int64_t last_utime = g_array_index (utimes, int64_t, n - 1);
+    for (guint i = 0; i < n; ++i)
+    {
+        GstBuffer *buf = gst_buffer_list_get (list, i);
+        int64_t behind_us = last_utime - g_array_index (utimes, int64_t, i);
+        if (behind_us < 0) behind_us = 0;
+        GstClockTime behind = (GstClockTime) behind_us * GST_USECOND;
+        GST_BUFFER_PTS (buf) = running > behind ? running - behind : 0;
+    }
+}
+
+/* Moves the sender's clock times into running time here, keeping the spacing
+ * of the frames and the reordering delay between their PTS and DTS */
+static void
+timestamp_encoded_list (GstBaseSrc * src, GstZcmImageSrc * filter, GstBufferList * list)
+{
+    GstBuffer *first = gst_buffer_list_get (list, 0);
+    GstClockTime first_ts = GST_BUFFER_DTS_IS_VALID (first) ?
+        GST_BUFFER_DTS (first) : GST_BUFFER_PTS (first);
+
+    if (!filter->have_ts_offset && GST_CLOCK_TIME_IS_VALID (first_ts))
+    {
+        GstClock *clock = gst_element_get_clock (GST_ELEMENT (src));
+        if (clock)
+        {
+            GstClockTime now = gst_clock_get_time (clock);
+            GstClockTime base_time = gst_element_get_base_time (GST_ELEMENT (src));
+            gst_object_unref (clock);
+            if (now >= base_time)
+            {
+                filter->ts_offset = GST_CLOCK_DIFF (first_ts, now - base_time);
+                filter->have_ts_offset = TRUE;
+            }
+        }
+    }
+
+    guint n = gst_buffer_list_length (list);
+    for (guint i = 0; i < n; ++i)
+    {
+        GstBuffer *buf = gst_buffer_list_get (list, i);
+        GstClockTime ts[2] = { GST_BUFFER_PTS (buf), GST_BUFFER_DTS (buf) };
+        for (int j = 0; j < 2; ++j)
+        {
+            if (!filter->have_ts_offset || !GST_CLOCK_TIME_IS_VALID (ts[j]))
+                ts[j] = GST_CLOCK_TIME_NONE;
+            else if ((GstClockTimeDiff) ts[j] + filter->ts_offset < 0)
+                ts[j] = 0;
+            else
+                ts[j] = ts[j] + filter->ts_offset;
+        }
+        GST_BUFFER_PTS (buf) = ts[0];
+        GST_BUFFER_DTS (buf) = ts[1];
+    }
+}
+
+static GstFlowReturn gst_zcmimagesrc_create (GstBaseSrc * src, guint64 offset,
+    guint length, GstBuffer ** buf)
+{
+    GstZcmImageSrc *filter = (GstZcmImageSrc *)src;
+
+    if (!filter->batched && !filter->encoded)
+        return GST_BASE_SRC_CLASS (parent_class)->create (src, offset, length, buf);
+
+    gint64 endtime = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+    g_mutex_lock (filter->mutx);
+
+    while (gst_buffer_list_length (filter->pending) == 0)
+    {
+        if (!g_cond_wait_until (filter->cond, filter->mutx, endtime))
+            break;
+    }
+
+    if (gst_buffer_list_length (filter->pending) == 0)
+    {
+        g_print ("exceeded waiting time to receive the frame\n");
+        g_mutex_unlock (filter->mutx);
+        if (filter->update_caps == TRUE)
+            return GST_FLOW_ERROR;
+        return GST_FLOW_EOS;
+    }
+
+    GstBufferList *list = filter->pending;
+    filter->pending = gst_buffer_list_new ();
+
+    if (filter->encoded)
+    {
+        if (filter->update_caps == TRUE)
+        {
+            gst_base_src_set_caps (src, filter->encoded_caps);
+            filter->update_caps = FALSE;
+        }
+        timestamp_encoded_list (src, filter, list);
+        g_mutex_unlock (filter->mutx);
+
+        gst_base_src_submit_buffer_list (src, list);
+        *buf = NULL;
+        return GST_FLOW_OK;
+    }
+
+    GArray *utimes = filter->pending_utime;
+    filter->pending_utime = g_array_new (FALSE, FALSE, sizeof(int64_t));
+
+    /* The sender may change size or format between batches */
+    if (filter->image_info->width != filter->frame_info.width ||
+        filter->image_info->height != filter->frame_info.height ||
+        filter->image_info->frame_type != filter->frame_info.frame_type)
+        filter->update_caps = TRUE;
+
+    if (filter->update_caps == TRUE)
+    {
+        filter->frame_info.width = filter->image_info->width;
+        filter->frame_info.height = filter->image_info->height;
+        filter->frame_info.framerate_num = filter->image_info->framerate_num;
+        filter->frame_info.framerate_den = filter->image_info->framerate_den;
+        filter->frame_info.frame_type = filter->image_info->frame_type;
+        if (gst_update_src_caps (src, filter, gst_buffer_list_get (list, 0)) == -1)
+        {
+            g_print ("frametype %d not supported", filter->frame_info.frame_type);
+            g_mutex_unlock (filter->mutx);
+            gst_buffer_list_unref (list);
+            g_array_free (utimes, TRUE);
+            return GST_FLOW_ERROR;
+        }
+
+        filter->update_caps = FALSE;
+    }
+
+    g_mutex_unlock (filter->mutx);
+
+    timestamp_buffer_list (src, list, utimes);
+    g_array_free (utimes, TRUE);
+
+    gst_base_src_submit_buffer_list (src, list);
+    *buf = NULL;
+    return GST_FLOW_OK;
+}
+
 /* initialize the new element
  * instantiate pads and add them to element
  * set pad calback functions
@@ -351,6 +1038,28 @@ gst_zcmimagesrc_init (GstZcmImageSrc * filter)
     filter->channel = "GSTREAMER_DATA";
     filter->zcm_url = NULL;
     filter->status = GST_FLOW_OK;
+    filter->batched = FALSE;
+    filter->pending = NULL;
+    filter->pending_utime = NULL;
+    filter->encoded = FALSE;
+    filter->keyframe_channel = "GSTREAMER_KEYFRAME";
+    filter->encoded_caps = NULL;
+    filter->need_keyframe = TRUE;
+    filter->last_keyframe_request = 0;
+    filter->ts_offset = 0;
+    filter->have_ts_offset = FALSE;
+    filter->latest_channel = "GSTREAMER_LATEST";
+    filter->latest_reply_channel = NULL;
+    filter->frame_ready = FALSE;
+    filter->got_frame = FALSE;
+    filter->output_format = GST_VIDEO_FORMAT_UNKNOWN;
+    filter->convert = FALSE;
+    filter->hugepages = FALSE;
+    filter->image_sub = NULL;
+    filter->batch_sub = NULL;
+    filter->encoded_sub = NULL;
+    filter->latest_sub = NULL;
+    filter->zcm = NULL;
     gst_base_src_set_blocksize (GST_BASE_SRC (filter), DEFAULT_BLOCKSIZE);
 }
 
@@ -370,6 +1079,30 @@ gst_zcmimagesrc_set_property (GObject * object, guint prop_id,
         case PROP_VERBOSE:
             filter->verbose = g_value_get_boolean (value);
             break;
+        case PROP_BATCHED:
+            filter->batched = g_value_get_boolean (value);
+            break;
+        case PROP_ENCODED:
+            filter->encoded = g_value_get_boolean (value);
+            break;
+        case PROP_KEYFRAME_CHANNEL:
+            filter->keyframe_channel = g_strdup (g_value_get_string (value));
+            break;
+        case PROP_LATEST_CHANNEL:
+            filter->latest_channel = g_strdup (g_value_get_string (value));
+            break;
+        case PROP_OUTPUT_FORMAT:
+        {
+            const gchar *format = g_value_get_string (value);
+            filter->output_format = format && *format ?
+                gst_video_format_from_string (format) : GST_VIDEO_FORMAT_UNKNOWN;
+            if (format && *format && filter->output_format == GST_VIDEO_FORMAT_UNKNOWN)
+                g_print ("unknown output format %s, pushing frames as received\n", format);
+            break;
+        }
+        case PROP_HUGEPAGES:
+            filter->hugepages = g_value_get_boolean (value);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
             break;
@@ -385,6 +1118,25 @@ gst_zcmimagesrc_get_property (GObject * object, guint prop_id,
         case PROP_VERBOSE:
             g_value_set_boolean (value, filter->verbose);
             break;
+        case PROP_BATCHED:
+            g_value_set_boolean (value, filter->batched);
+            break;
+        case PROP_ENCODED:
+            g_value_set_boolean (value, filter->encoded);
+            break;
+        case PROP_KEYFRAME_CHANNEL:
+            g_value_set_string (value, filter->keyframe_channel);
+            break;
+        case PROP_LATEST_CHANNEL:
+            g_value_set_string (value, filter->latest_channel);
+            break;
+        case PROP_OUTPUT_FORMAT:
+            g_value_set_string (value, filter->output_format == GST_VIDEO_FORMAT_UNKNOWN ?
+                                "" : gst_video_format_to_string (filter->output_format));
+            break;
+        case PROP_HUGEPAGES:
+            g_value_set_boolean (value, filter->hugepages);
+            break;
         case PROP_CHANNEL:
             g_value_set_string (value, filter->channel);
             break;
@@ -421,46 +1173,3 @@ gst_zcmimagesrc_change_state (GstElement * element, GstStateChange transition)
 
     return ret;
 }
-
-/* entry point to initialize the plug-in
- * initialize the plug-in itself
- * register the element factories and other features
- */
-static gboolean
-zcmimagesrc_init (GstPlugin * zcmimagesrc)
-{
-    /* debug category for fltering log messages
-     *
-     * exchange the string 'Template zcmimagesrc' with your description
-     */
-    GST_DEBUG_CATEGORY_INIT (gst_zcmimagesrc_debug, "zcmimagesrc",
-            0, "Template zcmimagesrc");
-
-    return gst_element_register (zcmimagesrc, "zcmimagesrc", GST_RANK_NONE,
-            GST_TYPE_ZCMIMAGESRC);
-}
-
-#ifndef VERSION
-#define VERSION "1.0.0"
-#endif
-#ifndef PACKAGE
-#define PACKAGE "ZeroCM"
-#endif
-#ifndef PACKAGE_NAME
-#define PACKAGE_NAME "zcm-gstreamer-plugins"
-#endif
-#ifndef GST_PACKAGE_ORIGIN
-#define GST_PACKAGE_ORIGIN "https://github.com/ZeroCM/zcm-gstreamer-plugins"
-#endif
-
-GST_PLUGIN_DEFINE (
-    GST_VERSION_MAJOR,
-    GST_VERSION_MINOR,
-    zcmimagesrc,
-    "Receives images over zcm and passes them into the pipeline",
-    zcmimagesrc_init,
-    VERSION,
-    "LGPL",
-    PACKAGE_NAME,
-    GST_PACKAGE_ORIGIN
-)
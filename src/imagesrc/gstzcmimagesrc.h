@@ -2,11 +2,17 @@
 #define __GST_ZCMSRC_H__
 
 #include <gst/gst.h>
+#include <gst/base/gstbasesrc.h>
+#include <gst/video/video.h>
 #include <glib.h>
 #include <zcm/zcm.h>
 #include <zcm/transport.h>
 #include <zcm/transport_registrar.h>
 #include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_image_t.h"
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_image_batch_t.h"
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_encoded_image_t.h"
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_keyframe_request_t.h"
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_latest_request_t.h"
 G_BEGIN_DECLS
 
 /* #defines don't like whitespacey bits */
@@ -30,6 +36,8 @@ typedef struct _ZcmImageInfo
     unsigned int       height;
     unsigned char    * buf;
     unsigned int       size;
+    gsize              capacity;   // of buf on huge pages, 0 if it was realloc'd
+    int                stride;
     unsigned int       framerate_num;
     unsigned int       framerate_den;
     unsigned int       frame_type;
@@ -49,6 +57,28 @@ struct _GstZcmImageSrc
     GCond           *cond;
     GMutex          *mutx;
     gboolean         update_caps;
+    gboolean         batched;
+    GstBufferList   *pending;
+    GArray          *pending_utime;
+    gboolean         encoded;
+    gchar           *keyframe_channel;
+    GstCaps         *encoded_caps;
+    gboolean         need_keyframe;
+    gint64           last_keyframe_request;
+    GstClockTimeDiff ts_offset;
+    gboolean         have_ts_offset;
+    gchar           *latest_channel;
+    gchar           *latest_reply_channel;
+    gboolean         frame_ready;
+    gboolean         got_frame;
+    GstVideoFormat   output_format;
+    GstVideoInfo     output_info;
+    gboolean         convert;
+    gboolean         hugepages;
+    zcm_gstreamer_plugins_image_t_subscription_t         *image_sub;
+    zcm_gstreamer_plugins_image_batch_t_subscription_t   *batch_sub;
+    zcm_gstreamer_plugins_encoded_image_t_subscription_t *encoded_sub;
+    zcm_gstreamer_plugins_image_t_subscription_t         *latest_sub;
     zcm_t *zcm;
 };
 
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "gstzcmframeindex.h"
+
+/* Lists the frames a zcmmultifilesink index recorded with
+ * start_utime <= pic_utime < end_utime, one per line as
+ *   <path> <offset> <size> <pic_utime>
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <index> [start_utime] [end_utime]\n", argv[0]);
+        return 1;
+    }
+
+    gint64 start_utime = argc > 2 ? g_ascii_strtoll(argv[2], NULL, 10) : G_MININT64;
+    gint64 end_utime = argc > 3 ? g_ascii_strtoll(argv[3], NULL, 10) : G_MAXINT64;
+
+    GError* error = NULL;
+    GstZcmFrameIndexReader reader;
+    if (!gst_zcm_frame_index_reader_open(&reader, argv[1], &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    char* pattern = g_strndup(reader.pattern, reader.pattern_size);
+    char** volumes = g_strsplit(pattern, GST_ZCM_FRAME_INDEX_PATTERN_SEPARATOR, -1);
+    gint32 n_volumes = g_strv_length(volumes);
+
+    guint64 i;
+    for (i = gst_zcm_frame_index_reader_lower_bound(&reader, start_utime);
+         i < reader.n_entries; ++i) {
+        const GstZcmFrameIndexEntry* entry = &reader.entries[i];
+        if (entry->size == 0) continue;
+        if (entry->pic_utime >= end_utime) break;
+        if (entry->volume < 0 || entry->volume >= n_volumes) continue;
+
+        // Location patterns take an int, like the sink formats them
+        char* file_pattern = gst_zcm_shard_pattern(volumes[entry->volume],
+                                                   reader.shard_layout, entry->shard);
+        char* path = g_strdup_printf(file_pattern, (int) entry->file);
+        g_free(file_pattern);
+        printf("%s %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GINT64_FORMAT "\n",
+               path, entry->offset, entry->size, entry->pic_utime);
+        g_free(path);
+    }
+
+    g_strfreev(volumes);
+    g_free(pattern);
+    gst_zcm_frame_index_reader_close(&reader);
+    return 0;
+}
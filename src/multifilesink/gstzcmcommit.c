@@ -0,0 +1,163 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include "gstzcmcommit.h"
+
+#include <string.h>
+#include <time.h>
+
+static void*
+commit_thread (void* usr)
+{
+  GstZcmCommit* commit = (GstZcmCommit*) usr;
+
+  pthread_mutex_lock(&commit->mutex);
+  while (true) {
+    if (commit->n_pending == 0) {
+      if (commit->exit) break;
+      pthread_cond_wait(&commit->cond, &commit->mutex);
+      continue;
+    }
+
+    gint64 deadline = commit->first_time + commit->max_delay_us;
+    if (commit->n_pending < commit->max_items && !commit->flushing &&
+        !commit->exit && g_get_monotonic_time() < deadline) {
+      struct timespec ts;
+      ts.tv_sec = deadline / G_USEC_PER_SEC;
+      ts.tv_nsec = (deadline % G_USEC_PER_SEC) * 1000;
+      pthread_cond_timedwait(&commit->cond, &commit->mutex, &ts);
+      continue;
+    }
+
+    // Items added meanwhile go into the other array
+    gpointer* batch = commit->pending;
+    guint capacity = commit->capacity;
+    guint n = commit->n_pending;
+    commit->pending = commit->batch;
+    commit->capacity = commit->batch_capacity;
+    commit->batch = batch;
+    commit->batch_capacity = capacity;
+    commit->n_pending = 0;
+    commit->committing = true;
+    pthread_mutex_unlock(&commit->mutex);
+
+    gboolean ok = commit->sync(batch, n, commit->user_data);
+    for (guint i = 0; i < n; ++i) commit->done(batch[i], ok, commit->user_data);
+
+    pthread_mutex_lock(&commit->mutex);
+    commit->committing = false;
+    pthread_cond_broadcast(&commit->idle);
+  }
+  pthread_mutex_unlock(&commit->mutex);
+
+  return NULL;
+}
+
+void
+gst_zcm_commit_init (GstZcmCommit * commit)
+{
+  memset(commit, 0, sizeof(*commit));
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&commit->cond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_cond_init(&commit->idle, NULL);
+  pthread_mutex_init(&commit->mutex, NULL);
+}
+
+void
+gst_zcm_commit_clear (GstZcmCommit * commit)
+{
+  gst_zcm_commit_stop(commit);
+
+  g_free(commit->pending);
+  g_free(commit->batch);
+  pthread_mutex_destroy(&commit->mutex);
+  pthread_cond_destroy(&commit->idle);
+  pthread_cond_destroy(&commit->cond);
+}
+
+void
+gst_zcm_commit_start (GstZcmCommit * commit, guint max_items,
+    guint max_delay_ms, GstZcmCommitSyncFunc sync, GstZcmCommitDoneFunc done,
+    gpointer user_data)
+{
+  gst_zcm_commit_stop(commit);
+
+  pthread_mutex_lock(&commit->mutex);
+  commit->sync = sync;
+  commit->done = done;
+  commit->user_data = user_data;
+  commit->max_items = MAX(max_items, 1);
+  commit->max_delay_us = (gint64) max_delay_ms * 1000;
+  commit->flushing = false;
+  commit->exit = false;
+  pthread_mutex_unlock(&commit->mutex);
+
+  pthread_create(&commit->thread, NULL, commit_thread, commit);
+  commit->running = true;
+}
+
+void
+gst_zcm_commit_stop (GstZcmCommit * commit)
+{
+  if (!commit->running) return;
+
+  pthread_mutex_lock(&commit->mutex);
+  commit->exit = true;
+  pthread_cond_signal(&commit->cond);
+  pthread_mutex_unlock(&commit->mutex);
+
+  pthread_join(commit->thread, NULL);
+  commit->running = false;
+}
+
+void
+gst_zcm_commit_add (GstZcmCommit * commit, gpointer item)
+{
+  pthread_mutex_lock(&commit->mutex);
+  if (commit->n_pending == commit->capacity) {
+    // Only grows while syncs fall behind, a batch is usually max_items
+    commit->capacity = MAX(commit->capacity * 2, commit->max_items);
+    commit->pending = g_renew(gpointer, commit->pending, commit->capacity);
+  }
+  if (commit->n_pending == 0) commit->first_time = g_get_monotonic_time();
+  commit->pending[commit->n_pending++] = item;
+  if (commit->n_pending == 1 || commit->n_pending == commit->max_items) {
+    pthread_cond_signal(&commit->cond);
+  }
+  pthread_mutex_unlock(&commit->mutex);
+}
+
+void
+gst_zcm_commit_drain (GstZcmCommit * commit)
+{
+  if (!commit->running) return;
+
+  pthread_mutex_lock(&commit->mutex);
+  commit->flushing = true;
+  pthread_cond_signal(&commit->cond);
+  while (commit->n_pending > 0 || commit->committing) {
+    pthread_cond_wait(&commit->idle, &commit->mutex);
+  }
+  commit->flushing = false;
+  pthread_mutex_unlock(&commit->mutex);
+}
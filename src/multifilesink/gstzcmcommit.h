@@ -0,0 +1,90 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMCOMMIT_H_
+#define _GST_ZCMCOMMIT_H_
+
+#include <gst/gst.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+
+G_BEGIN_DECLS
+
+/* Group commit: items whose writes are done collect in a batch that is made
+ * durable with one sync once it holds max_items or its oldest item has waited
+ * max_delay_us, and only then are the items handed on, in the order they were
+ * added. */
+
+typedef struct _GstZcmCommit GstZcmCommit;
+
+/* Makes the writes of a batch of items durable, returns whether it did. Runs
+ * on the commit thread. */
+typedef gboolean (*GstZcmCommitSyncFunc) (gpointer * items, guint n_items,
+    gpointer user_data);
+
+/* Called on the commit thread for every item of a batch after its sync */
+typedef void (*GstZcmCommitDoneFunc) (gpointer item, gboolean ok,
+    gpointer user_data);
+
+struct _GstZcmCommit
+{
+  GstZcmCommitSyncFunc sync;
+  GstZcmCommitDoneFunc done;
+  gpointer user_data;
+
+  guint max_items;
+  gint64 max_delay_us;
+
+  pthread_t thread;
+  bool running;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;   // on CLOCK_MONOTONIC
+  pthread_cond_t idle;
+  gpointer* pending;     // swapped with batch for every commit
+  guint n_pending;
+  guint capacity;
+  gpointer* batch;
+  guint batch_capacity;
+  gint64 first_time;     // when the oldest pending item was added
+  bool committing;
+  bool flushing;
+  bool exit;
+};
+
+void gst_zcm_commit_init (GstZcmCommit * commit);
+void gst_zcm_commit_clear (GstZcmCommit * commit);
+
+void gst_zcm_commit_start (GstZcmCommit * commit, guint max_items,
+    guint max_delay_ms, GstZcmCommitSyncFunc sync, GstZcmCommitDoneFunc done,
+    gpointer user_data);
+
+/* Commits whatever is pending and joins the commit thread */
+void gst_zcm_commit_stop (GstZcmCommit * commit);
+
+/* Adds an item whose writes have completed. Never blocks on a sync. */
+void gst_zcm_commit_add (GstZcmCommit * commit, gpointer item);
+
+/* Commits the pending items right away and waits until they are done */
+void gst_zcm_commit_drain (GstZcmCommit * commit);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,595 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // O_DIRECT, fallocate, syncfs
+#endif
+
+#include "gstzcmdirectio.h"
+#include "gstzcmhugepage.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+static inline gsize
+align_up (gsize size)
+{
+  return (size + GST_ZCM_DIRECT_IO_ALIGN - 1) & ~((gsize) GST_ZCM_DIRECT_IO_ALIGN - 1);
+}
+
+/* Aligned staging memory, grown to the largest frame seen */
+typedef struct
+{
+  void* mem;
+  gsize capacity;
+  bool hugepages;  // mem is from gst_zcm_hugepage_alloc()
+} Staging;
+
+static void
+staging_release (Staging* staging)
+{
+  if (staging->hugepages) gst_zcm_hugepage_free(staging->mem, staging->capacity);
+  else free(staging->mem);
+  staging->mem = NULL;
+  staging->capacity = 0;
+  staging->hugepages = false;
+}
+
+static bool
+staging_reserve (Staging* staging, gsize size, bool hugepages)
+{
+  if (staging->capacity >= size && staging->hugepages == hugepages) return true;
+  staging_release(staging);
+
+  // Huge page mappings are page aligned, which covers O_DIRECT
+  if (hugepages) {
+    gsize capacity = size;
+    staging->mem = gst_zcm_hugepage_alloc(&capacity);
+    if (staging->mem) {
+      staging->capacity = capacity;
+      staging->hugepages = true;
+      return true;
+    }
+  }
+
+  if (posix_memalign(&staging->mem, GST_ZCM_DIRECT_IO_ALIGN, size) != 0) {
+    staging->mem = NULL;
+    return false;
+  }
+  staging->capacity = size;
+  return true;
+}
+
+/* Copies data into staging and zero fills up to the next aligned size, which
+ * is returned. The padding is cut off again with ftruncate. */
+static gsize
+staging_fill (Staging* staging, const guint8* data, gsize size,
+    GstZcmFileFlags flags)
+{
+  gsize padded = align_up(size);
+  if (!staging_reserve(staging, padded, flags & GST_ZCM_FILE_HUGEPAGES)) return 0;
+  memcpy(staging->mem, data, size);
+  memset((guint8*) staging->mem + size, 0, padded - size);
+  return padded;
+}
+
+int
+gst_zcm_direct_open (const char * path, gboolean * direct)
+{
+  int fd = -1;
+  if (*direct) {
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    // tmpfs and some network file systems reject O_DIRECT
+    if (fd >= 0 || errno != EINVAL) return fd;
+    *direct = FALSE;
+  }
+  return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+void
+gst_zcm_direct_preallocate (int fd, gsize size)
+{
+  if (size > 0 && fallocate(fd, 0, 0, size) != 0) {
+    // EOPNOTSUPP on tmpfs and friends, the writes allocate as usual there
+  }
+}
+
+gboolean
+gst_zcm_direct_sync (int fd)
+{
+  int ret;
+  do {
+    ret = fdatasync(fd);
+  } while (ret != 0 && errno == EINTR);
+  return ret == 0;
+}
+
+gboolean
+gst_zcm_direct_sync_dir (const char * path)
+{
+  char* dir = g_path_get_dirname(path);
+  int fd = open(dir, O_RDONLY | O_DIRECTORY);
+  g_free(dir);
+  if (fd < 0) return FALSE;
+
+  int ret;
+  do {
+    ret = fsync(fd);
+  } while (ret != 0 && errno == EINTR);
+  close(fd);
+  return ret == 0;
+}
+
+gboolean
+gst_zcm_direct_sync_fs (const char * path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return FALSE;
+  gboolean ok = syncfs(fd) == 0;
+  close(fd);
+  return ok;
+}
+
+static int
+open_direct (const char* path)
+{
+  gboolean direct = TRUE;
+  return gst_zcm_direct_open(path, &direct);
+}
+
+static bool
+pwrite_all (int fd, const guint8* data, gsize size, off_t offset)
+{
+  while (size > 0) {
+    ssize_t ret = pwrite(fd, data, size, offset);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += ret;
+    size -= ret;
+    offset += ret;
+  }
+  return true;
+}
+
+static void
+staging_free (gpointer data)
+{
+  Staging* staging = data;
+  staging_release(staging);
+  g_free(staging);
+}
+
+static GPrivate direct_staging = G_PRIVATE_INIT (staging_free);
+
+static Staging*
+thread_staging (void)
+{
+  Staging* staging = g_private_get(&direct_staging);
+  if (!staging) {
+    staging = g_new0(Staging, 1);
+    g_private_set(&direct_staging, staging);
+  }
+  return staging;
+}
+
+gboolean
+gst_zcm_direct_pwrite (int fd, guint64 offset, const guint8 * data,
+    gsize size, gboolean direct, GstZcmFileFlags flags)
+{
+  if (!direct) return pwrite_all(fd, data, size, offset);
+
+  Staging* staging = thread_staging();
+  gsize padded = staging_fill(staging, data, size, flags);
+  if (padded == 0 && size > 0) return FALSE;
+
+  return pwrite_all(fd, staging->mem, padded, offset);
+}
+
+gboolean
+gst_zcm_direct_write_file (const char * path, const guint8 * data, gsize size,
+    GstZcmFileFlags flags)
+{
+  Staging* staging = thread_staging();
+
+  gsize padded = staging_fill(staging, data, size, flags);
+  if (padded == 0 && size > 0) return FALSE;
+
+  int fd = open_direct(path);
+  if (fd < 0) return FALSE;
+  if (flags & GST_ZCM_FILE_PREALLOCATE) gst_zcm_direct_preallocate(fd, size);
+
+  bool ok = pwrite_all(fd, staging->mem, padded, 0) && ftruncate(fd, size) == 0;
+  if (ok && (flags & GST_ZCM_FILE_SYNC)) ok = gst_zcm_direct_sync(fd);
+  if (close(fd) != 0) ok = false;
+  if (ok && (flags & GST_ZCM_FILE_SYNC)) ok = gst_zcm_direct_sync_dir(path);
+
+  return ok;
+}
+
+#ifdef HAVE_LIBURING
+
+typedef struct
+{
+  Staging staging;
+  struct iovec iov;
+  int fd;
+  bool own_fd;
+  char* path;          // of a file created with GST_ZCM_FILE_SYNC, or NULL
+  GstZcmFileFlags flags;
+  off_t offset;
+  gsize size;
+  gpointer job;
+  bool queued;         // on the ring, guarded by the writer's mutex
+} Slot;
+
+struct _GstZcmUringWriter
+{
+  struct io_uring ring;
+
+  GstZcmUringDoneFunc done;
+  gpointer user_data;
+
+  Slot* slots;
+  guint depth;
+
+  pthread_t reaper;
+
+  // Guards the submission queue and everything below
+  pthread_mutex_t mutex;
+  pthread_cond_t slot_free;
+  pthread_cond_t idle;
+  Slot** free_slots;   // stack of n_free slots
+  guint n_free;
+  guint in_flight;
+  guint unsubmitted;
+  guint batch;
+  bool dead;           // the reaper quit on a ring error, writes fail now
+};
+
+static void
+finish_slot (GstZcmUringWriter* writer, Slot* slot, int res)
+{
+  bool ok = res >= 0;
+
+  // O_DIRECT writes come back short only in whole blocks, finish them off
+  // synchronously
+  if (ok && (gsize) res < slot->iov.iov_len) {
+    ok = pwrite_all(slot->fd, (guint8*) slot->iov.iov_base + res,
+                    slot->iov.iov_len - res, slot->offset + res);
+  }
+  if (slot->own_fd && ok && ftruncate(slot->fd, slot->size) != 0) ok = false;
+  if (ok && (slot->flags & GST_ZCM_FILE_SYNC)) ok = gst_zcm_direct_sync(slot->fd);
+  if (slot->own_fd && close(slot->fd) != 0) ok = false;
+  if (ok && slot->path) ok = gst_zcm_direct_sync_dir(slot->path);
+
+  writer->done(slot->job, ok, writer->user_data);
+
+  pthread_mutex_lock(&writer->mutex);
+  slot->job = NULL;
+  slot->queued = false;
+  writer->free_slots[writer->n_free++] = slot;
+  writer->in_flight--;
+  pthread_cond_signal(&writer->slot_free);
+  if (writer->in_flight == 0) pthread_cond_broadcast(&writer->idle);
+  pthread_mutex_unlock(&writer->mutex);
+}
+
+/* The ring cannot be waited on anymore, nothing queued will complete. Fails
+ * it all so drains return, and every later write fails right away. */
+static void
+fail_queued (GstZcmUringWriter* writer, int error)
+{
+  pthread_mutex_lock(&writer->mutex);
+  writer->dead = true;
+  pthread_cond_broadcast(&writer->slot_free);
+  pthread_mutex_unlock(&writer->mutex);
+
+  // Nothing is queued anymore once dead is set, see queue_slot
+  for (guint i = 0; i < writer->depth; ++i) {
+    if (writer->slots[i].queued) finish_slot(writer, &writer->slots[i], error);
+  }
+}
+
+static void*
+reaper_thread (void* usr)
+{
+  GstZcmUringWriter* writer = usr;
+
+  while (true) {
+    struct io_uring_cqe* cqe;
+    int ret = io_uring_wait_cqe(&writer->ring, &cqe);
+    if (ret == -EINTR) continue;
+    if (ret < 0) {
+      fail_queued(writer, ret);
+      break;
+    }
+
+    Slot* slot = io_uring_cqe_get_data(cqe);
+    int res = cqe->res;
+    io_uring_cqe_seen(&writer->ring, cqe);
+
+    // A NULL slot is the nop queued by gst_zcm_uring_writer_free
+    if (!slot) break;
+    finish_slot(writer, slot, res);
+  }
+
+  return NULL;
+}
+
+/* Called with the mutex held */
+static struct io_uring_sqe*
+get_sqe (GstZcmUringWriter* writer)
+{
+  struct io_uring_sqe* sqe = io_uring_get_sqe(&writer->ring);
+  if (!sqe) {
+    io_uring_submit(&writer->ring);
+    writer->unsubmitted = 0;
+    sqe = io_uring_get_sqe(&writer->ring);
+  }
+  return sqe;
+}
+
+GstZcmUringWriter *
+gst_zcm_uring_writer_new (guint depth, GstZcmUringDoneFunc done,
+    gpointer user_data)
+{
+  GstZcmUringWriter* writer = g_new0(GstZcmUringWriter, 1);
+  depth = MAX(depth, 1);
+
+  // One extra entry for the shutdown nop
+  if (io_uring_queue_init(depth + 1, &writer->ring, 0) < 0) {
+    g_free(writer);
+    return NULL;
+  }
+
+  writer->done = done;
+  writer->user_data = user_data;
+  writer->depth = depth;
+  writer->batch = MAX(depth / 4, 1);
+  writer->slots = g_new0(Slot, depth);
+
+  pthread_mutex_init(&writer->mutex, NULL);
+  pthread_cond_init(&writer->slot_free, NULL);
+  pthread_cond_init(&writer->idle, NULL);
+  writer->free_slots = g_new(Slot*, depth);
+  for (guint i = 0; i < depth; ++i) writer->free_slots[i] = &writer->slots[i];
+  writer->n_free = depth;
+
+  pthread_create(&writer->reaper, NULL, reaper_thread, writer);
+
+  return writer;
+}
+
+void
+gst_zcm_uring_writer_free (GstZcmUringWriter * writer)
+{
+  if (!writer) return;
+
+  gst_zcm_uring_writer_drain(writer);
+
+  pthread_mutex_lock(&writer->mutex);
+  if (!writer->dead) {
+    struct io_uring_sqe* sqe = get_sqe(writer);
+    io_uring_prep_nop(sqe);
+    io_uring_sqe_set_data(sqe, NULL);
+    io_uring_submit(&writer->ring);
+  }
+  pthread_mutex_unlock(&writer->mutex);
+
+  pthread_join(writer->reaper, NULL);
+  io_uring_queue_exit(&writer->ring);
+
+  for (guint i = 0; i < writer->depth; ++i) {
+    staging_release(&writer->slots[i].staging);
+    g_free(writer->slots[i].path);
+  }
+  g_free(writer->slots);
+  g_free(writer->free_slots);
+
+  pthread_cond_destroy(&writer->idle);
+  pthread_cond_destroy(&writer->slot_free);
+  pthread_mutex_destroy(&writer->mutex);
+  g_free(writer);
+}
+
+/* Returns NULL once the writer is dead */
+static Slot*
+take_slot (GstZcmUringWriter* writer)
+{
+  pthread_mutex_lock(&writer->mutex);
+  while (writer->n_free == 0 && !writer->dead) {
+    // Whatever is held back for batching has to go out to free a slot
+    if (writer->unsubmitted) {
+      io_uring_submit(&writer->ring);
+      writer->unsubmitted = 0;
+    }
+    pthread_cond_wait(&writer->slot_free, &writer->mutex);
+  }
+  // Reusing the most recently freed slot keeps its staging buffer warm
+  Slot* slot = writer->dead ? NULL : writer->free_slots[--writer->n_free];
+  pthread_mutex_unlock(&writer->mutex);
+  return slot;
+}
+
+static void
+return_slot (GstZcmUringWriter* writer, Slot* slot)
+{
+  pthread_mutex_lock(&writer->mutex);
+  writer->free_slots[writer->n_free++] = slot;
+  pthread_cond_signal(&writer->slot_free);
+  pthread_mutex_unlock(&writer->mutex);
+}
+
+/* Returns FALSE, giving the slot back, if the writer died since take_slot */
+static gboolean
+queue_slot (GstZcmUringWriter* writer, Slot* slot)
+{
+  pthread_mutex_lock(&writer->mutex);
+  if (writer->dead) {
+    if (slot->own_fd) close(slot->fd);
+    slot->job = NULL;
+    writer->free_slots[writer->n_free++] = slot;
+    pthread_mutex_unlock(&writer->mutex);
+    return FALSE;
+  }
+  struct io_uring_sqe* sqe = get_sqe(writer);
+  // writev rather than write keeps this working on 5.4 kernels
+  io_uring_prep_writev(sqe, slot->fd, &slot->iov, 1, slot->offset);
+  io_uring_sqe_set_data(sqe, slot);
+  slot->queued = true;
+  writer->in_flight++;
+  if (++writer->unsubmitted >= writer->batch) {
+    io_uring_submit(&writer->ring);
+    writer->unsubmitted = 0;
+  }
+  pthread_mutex_unlock(&writer->mutex);
+  return TRUE;
+}
+
+gboolean
+gst_zcm_uring_writer_submit (GstZcmUringWriter * writer, const char * path,
+    const guint8 * data, gsize size, GstZcmFileFlags flags, gpointer job)
+{
+  Slot* slot = take_slot(writer);
+  if (!slot) return FALSE;
+
+  gsize padded = staging_fill(&slot->staging, data, size, flags);
+  slot->fd = (padded > 0 || size == 0) ? open_direct(path) : -1;
+  if (slot->fd < 0) {
+    return_slot(writer, slot);
+    return FALSE;
+  }
+  if (flags & GST_ZCM_FILE_PREALLOCATE) gst_zcm_direct_preallocate(slot->fd, size);
+
+  slot->iov.iov_base = slot->staging.mem;
+  slot->iov.iov_len = padded;
+  slot->own_fd = true;
+  g_free(slot->path);
+  slot->path = (flags & GST_ZCM_FILE_SYNC) ? g_strdup(path) : NULL;
+  slot->flags = flags;
+  slot->offset = 0;
+  slot->size = size;
+  slot->job = job;
+
+  return queue_slot(writer, slot);
+}
+
+gboolean
+gst_zcm_uring_writer_submit_at (GstZcmUringWriter * writer, int fd,
+    guint64 offset, const guint8 * data, gsize size, gboolean direct,
+    GstZcmFileFlags flags, gpointer job)
+{
+  Slot* slot = take_slot(writer);
+  if (!slot) return FALSE;
+
+  gsize padded = staging_fill(&slot->staging, data, size, flags);
+  if (padded == 0 && size > 0) {
+    return_slot(writer, slot);
+    return FALSE;
+  }
+
+  slot->iov.iov_base = slot->staging.mem;
+  slot->iov.iov_len = direct ? padded : size;
+  slot->fd = fd;
+  slot->own_fd = false;
+  g_free(slot->path);
+  slot->path = NULL;
+  slot->flags = flags;
+  slot->offset = offset;
+  slot->size = size;
+  slot->job = job;
+
+  return queue_slot(writer, slot);
+}
+
+void
+gst_zcm_uring_writer_flush (GstZcmUringWriter * writer)
+{
+  pthread_mutex_lock(&writer->mutex);
+  if (writer->unsubmitted) {
+    io_uring_submit(&writer->ring);
+    writer->unsubmitted = 0;
+  }
+  pthread_mutex_unlock(&writer->mutex);
+}
+
+void
+gst_zcm_uring_writer_drain (GstZcmUringWriter * writer)
+{
+  pthread_mutex_lock(&writer->mutex);
+  if (writer->unsubmitted) {
+    io_uring_submit(&writer->ring);
+    writer->unsubmitted = 0;
+  }
+  while (writer->in_flight > 0) pthread_cond_wait(&writer->idle, &writer->mutex);
+  pthread_mutex_unlock(&writer->mutex);
+}
+
+#else
+
+GstZcmUringWriter *
+gst_zcm_uring_writer_new (guint depth, GstZcmUringDoneFunc done,
+    gpointer user_data)
+{
+  return NULL;
+}
+
+void
+gst_zcm_uring_writer_free (GstZcmUringWriter * writer)
+{
+}
+
+gboolean
+gst_zcm_uring_writer_submit (GstZcmUringWriter * writer, const char * path,
+    const guint8 * data, gsize size, GstZcmFileFlags flags, gpointer job)
+{
+  return FALSE;
+}
+
+gboolean
+gst_zcm_uring_writer_submit_at (GstZcmUringWriter * writer, int fd,
+    guint64 offset, const guint8 * data, gsize size, gboolean direct,
+    GstZcmFileFlags flags, gpointer job)
+{
+  return FALSE;
+}
+
+void
+gst_zcm_uring_writer_flush (GstZcmUringWriter * writer)
+{
+}
+
+void
+gst_zcm_uring_writer_drain (GstZcmUringWriter * writer)
+{
+}
+
+#endif
@@ -0,0 +1,121 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMDIRECTIO_H_
+#define _GST_ZCMDIRECTIO_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// O_DIRECT transfers must be aligned to the logical block size of the
+// device, a page covers every device we record to
+#define GST_ZCM_DIRECT_IO_ALIGN 4096
+
+typedef enum
+{
+  GST_ZCM_WRITE_BACKEND_BUFFERED,
+  GST_ZCM_WRITE_BACKEND_DIRECT,
+  GST_ZCM_WRITE_BACKEND_URING,
+} GstZcmWriteBackend;
+
+/* How a file is written, besides its data */
+typedef enum
+{
+  GST_ZCM_FILE_PREALLOCATE = 1 << 0,  // see gst_zcm_direct_preallocate()
+  GST_ZCM_FILE_SYNC = 1 << 1,         // fdatasync (and sync a new file's
+                                      // directory) before the write completes
+  GST_ZCM_FILE_HUGEPAGES = 1 << 2,    // stage the data on huge pages
+} GstZcmFileFlags;
+
+/* Creates path for writing, with O_DIRECT if *direct is set and the file
+ * system supports it. *direct is cleared when it does not. */
+int gst_zcm_direct_open (const char * path, gboolean * direct);
+
+/* Allocates the first size bytes of a newly created file in one go, so its
+ * blocks are laid out together instead of as the writes arrive. Best effort,
+ * file systems without fallocate are left alone. */
+void gst_zcm_direct_preallocate (int fd, gsize size);
+
+/* fdatasync, retried on EINTR */
+gboolean gst_zcm_direct_sync (int fd);
+
+/* fsyncs the directory holding path, so that a newly created file's entry is
+ * as durable as its data */
+gboolean gst_zcm_direct_sync_dir (const char * path);
+
+/* Makes everything written to the file system holding path durable, with one
+ * syncfs */
+gboolean gst_zcm_direct_sync_fs (const char * path);
+
+/* Writes data at offset into a file from gst_zcm_direct_open(). On an
+ * O_DIRECT file, offset must be aligned and the write is zero padded to the
+ * next GST_ZCM_DIRECT_IO_ALIGN boundary. Of flags only
+ * GST_ZCM_FILE_HUGEPAGES is looked at, pair with gst_zcm_direct_sync() for
+ * GST_ZCM_FILE_SYNC. */
+gboolean gst_zcm_direct_pwrite (int fd, guint64 offset, const guint8 * data,
+    gsize size, gboolean direct, GstZcmFileFlags flags);
+
+/* Writes size bytes of data to a new file at path with O_DIRECT, staging them
+ * through a per-thread aligned buffer. Falls back to a buffered write on file
+ * systems without O_DIRECT support. */
+gboolean gst_zcm_direct_write_file (const char * path, const guint8 * data,
+    gsize size, GstZcmFileFlags flags);
+
+/* Called on the completion thread once a submitted file is written (ok) or
+ * failed, after which the writer is done with job */
+typedef void (*GstZcmUringDoneFunc) (gpointer job, gboolean ok,
+    gpointer user_data);
+
+typedef struct _GstZcmUringWriter GstZcmUringWriter;
+
+/* Returns NULL if io_uring is not available, either because the plugin was
+ * built without liburing or the kernel refuses to set up a ring. At most
+ * depth files are in flight, each staged in its own aligned buffer. */
+GstZcmUringWriter * gst_zcm_uring_writer_new (guint depth,
+    GstZcmUringDoneFunc done, gpointer user_data);
+
+/* Writes everything in flight, then frees the writer */
+void gst_zcm_uring_writer_free (GstZcmUringWriter * writer);
+
+/* Copies data into a free staging buffer, waiting for one if all are in
+ * flight, and queues its write to path. Writes are submitted to the kernel in
+ * batches, see gst_zcm_uring_writer_flush(). GST_ZCM_FILE_SYNC is done on the
+ * completion thread. Returns FALSE without calling done if the file could not
+ * be created, or once the ring has failed: writes in flight then complete
+ * with ok FALSE. */
+gboolean gst_zcm_uring_writer_submit (GstZcmUringWriter * writer,
+    const char * path, const guint8 * data, gsize size, GstZcmFileFlags flags,
+    gpointer job);
+
+/* Like gst_zcm_uring_writer_submit(), but writes into the already open fd at
+ * offset, with the rules of gst_zcm_direct_pwrite(). fd stays open. */
+gboolean gst_zcm_uring_writer_submit_at (GstZcmUringWriter * writer, int fd,
+    guint64 offset, const guint8 * data, gsize size, gboolean direct,
+    GstZcmFileFlags flags, gpointer job);
+
+/* Submits any writes still held back for batching */
+void gst_zcm_uring_writer_flush (GstZcmUringWriter * writer);
+
+/* Waits until every submitted file is written */
+void gst_zcm_uring_writer_drain (GstZcmUringWriter * writer);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,280 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include "gstzcmencode.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jpeglib.h>
+#include <png.h>
+#include <zstd.h>
+
+gboolean
+gst_zcm_encode_supported (GstZcmCompression compression, GstVideoFormat format)
+{
+  switch (compression) {
+    case GST_ZCM_COMPRESSION_NONE:
+    case GST_ZCM_COMPRESSION_ZSTD:
+      return TRUE;
+    case GST_ZCM_COMPRESSION_PNG:
+      if (format == GST_VIDEO_FORMAT_GRAY16_BE || format == GST_VIDEO_FORMAT_GRAY16_LE) {
+        return TRUE;
+      }
+      // Fall through
+    case GST_ZCM_COMPRESSION_JPEG:
+      switch (format) {
+        case GST_VIDEO_FORMAT_GRAY8:
+        case GST_VIDEO_FORMAT_RGB:
+        case GST_VIDEO_FORMAT_BGR:
+        case GST_VIDEO_FORMAT_RGBA:
+        case GST_VIDEO_FORMAT_BGRA:
+        case GST_VIDEO_FORMAT_RGBx:
+        case GST_VIDEO_FORMAT_BGRx:
+          return TRUE;
+        default:
+          return FALSE;
+      }
+  }
+  return FALSE;
+}
+
+static gboolean
+reserve (guint8 ** out, gsize * capacity, gsize size)
+{
+  if (size <= *capacity) return TRUE;
+
+  gsize new_capacity = MAX(size, *capacity * 2);
+  guint8* mem = realloc(*out, new_capacity);
+  if (!mem) return FALSE;
+
+  *out = mem;
+  *capacity = new_capacity;
+  return TRUE;
+}
+
+typedef struct
+{
+  guint8** out;
+  gsize* capacity;
+  gsize size;
+} PngOutput;
+
+static void
+png_write_data (png_structp png, png_bytep data, png_size_t length)
+{
+  PngOutput* output = png_get_io_ptr(png);
+  if (!reserve(output->out, output->capacity, output->size + length)) {
+    png_error(png, "out of memory");
+  }
+  memcpy(*output->out + output->size, data, length);
+  output->size += length;
+}
+
+static void
+png_flush_data (png_structp png)
+{
+}
+
+static gboolean
+encode_png (gint level, const GstVideoInfo * info, const guint8 * data,
+    gint stride, guint8 ** out, gsize * capacity, gsize * out_size)
+{
+  GstVideoFormat format = GST_VIDEO_INFO_FORMAT(info);
+  int color_type = PNG_COLOR_TYPE_RGB;
+  int bit_depth = 8;
+  switch (format) {
+    case GST_VIDEO_FORMAT_GRAY8:
+      color_type = PNG_COLOR_TYPE_GRAY;
+      break;
+    case GST_VIDEO_FORMAT_GRAY16_BE:
+    case GST_VIDEO_FORMAT_GRAY16_LE:
+      color_type = PNG_COLOR_TYPE_GRAY;
+      bit_depth = 16;
+      break;
+    case GST_VIDEO_FORMAT_RGBA:
+    case GST_VIDEO_FORMAT_BGRA:
+      color_type = PNG_COLOR_TYPE_RGB_ALPHA;
+      break;
+    default:
+      break;
+  }
+
+  png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (!png) return FALSE;
+  png_infop png_info = png_create_info_struct(png);
+  if (!png_info) {
+    png_destroy_write_struct(&png, NULL);
+    return FALSE;
+  }
+
+  PngOutput output = { out, capacity, 0 };
+
+  if (setjmp(png_jmpbuf(png))) {
+    png_destroy_write_struct(&png, &png_info);
+    return FALSE;
+  }
+
+  png_set_write_fn(png, &output, png_write_data, png_flush_data);
+  // Filtering costs more time than it saves space on camera frames
+  png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+  png_set_compression_level(png, MIN(level, 9));
+  png_set_IHDR(png, png_info, GST_VIDEO_INFO_WIDTH(info), GST_VIDEO_INFO_HEIGHT(info),
+               bit_depth, color_type, PNG_INTERLACE_NONE,
+               PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png, png_info);
+
+  if (format == GST_VIDEO_FORMAT_BGR || format == GST_VIDEO_FORMAT_BGRA ||
+      format == GST_VIDEO_FORMAT_BGRx) {
+    png_set_bgr(png);
+  }
+  if (format == GST_VIDEO_FORMAT_RGBx || format == GST_VIDEO_FORMAT_BGRx) {
+    png_set_filler(png, 0, PNG_FILLER_AFTER);
+  }
+  if (format == GST_VIDEO_FORMAT_GRAY16_LE) png_set_swap(png);
+
+  for (gint y = 0; y < GST_VIDEO_INFO_HEIGHT(info); ++y) {
+    png_write_row(png, (png_const_bytep) (data + (gsize) y * stride));
+  }
+  png_write_end(png, NULL);
+  png_destroy_write_struct(&png, &png_info);
+
+  *out_size = output.size;
+  return TRUE;
+}
+
+typedef struct
+{
+  struct jpeg_error_mgr mgr;
+  jmp_buf jmp;
+} JpegError;
+
+static void
+jpeg_error_exit (j_common_ptr cinfo)
+{
+  JpegError* error = (JpegError*) cinfo->err;
+  longjmp(error->jmp, 1);
+}
+
+static gboolean
+encode_jpeg (gint quality, const GstVideoInfo * info, const guint8 * data,
+    gint stride, guint8 ** out, gsize * capacity, gsize * out_size)
+{
+  GstVideoFormat format = GST_VIDEO_INFO_FORMAT(info);
+
+  struct jpeg_compress_struct cinfo;
+  JpegError error;
+  cinfo.err = jpeg_std_error(&error.mgr);
+  error.mgr.error_exit = jpeg_error_exit;
+
+  // libjpeg fills *out while the frame fits and switches to a buffer of its
+  // own, from malloc, once it does not
+  unsigned char* buffer = *out;
+  unsigned long buffer_size = *capacity;
+
+  if (setjmp(error.jmp)) {
+    jpeg_destroy_compress(&cinfo);
+    return FALSE;
+  }
+
+  jpeg_create_compress(&cinfo);
+  jpeg_mem_dest(&cinfo, &buffer, &buffer_size);
+
+  cinfo.image_width = GST_VIDEO_INFO_WIDTH(info);
+  cinfo.image_height = GST_VIDEO_INFO_HEIGHT(info);
+  cinfo.input_components = GST_VIDEO_INFO_COMP_PSTRIDE(info, 0);
+  switch (format) {
+    case GST_VIDEO_FORMAT_GRAY8: cinfo.in_color_space = JCS_GRAYSCALE; break;
+    case GST_VIDEO_FORMAT_RGB:   cinfo.in_color_space = JCS_RGB; break;
+    case GST_VIDEO_FORMAT_BGR:   cinfo.in_color_space = JCS_EXT_BGR; break;
+    case GST_VIDEO_FORMAT_RGBA:  cinfo.in_color_space = JCS_EXT_RGBA; break;
+    case GST_VIDEO_FORMAT_BGRA:  cinfo.in_color_space = JCS_EXT_BGRA; break;
+    case GST_VIDEO_FORMAT_RGBx:  cinfo.in_color_space = JCS_EXT_RGBX; break;
+    case GST_VIDEO_FORMAT_BGRx:  cinfo.in_color_space = JCS_EXT_BGRX; break;
+    default:
+      jpeg_destroy_compress(&cinfo);
+      return FALSE;
+  }
+
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, CLAMP(quality, 1, 100), TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    JSAMPROW row = (JSAMPROW) (data + (gsize) cinfo.next_scanline * stride);
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+
+  if (buffer != *out) {
+    free(*out);
+    *out = buffer;
+    *capacity = buffer_size;
+  }
+  *out_size = buffer_size;
+  return TRUE;
+}
+
+static void
+zstd_context_free (gpointer data)
+{
+  ZSTD_freeCCtx(data);
+}
+
+static GPrivate zstd_context = G_PRIVATE_INIT (zstd_context_free);
+
+static gboolean
+encode_zstd (gint level, const guint8 * data, gsize size, guint8 ** out,
+    gsize * capacity, gsize * out_size)
+{
+  ZSTD_CCtx* cctx = g_private_get(&zstd_context);
+  if (!cctx) {
+    cctx = ZSTD_createCCtx();
+    if (!cctx) return FALSE;
+    g_private_set(&zstd_context, cctx);
+  }
+
+  if (!reserve(out, capacity, ZSTD_compressBound(size))) return FALSE;
+
+  size_t ret = ZSTD_compressCCtx(cctx, *out, *capacity, data, size,
+                                 level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+  if (ZSTD_isError(ret)) return FALSE;
+
+  *out_size = ret;
+  return TRUE;
+}
+
+gboolean
+gst_zcm_encode (GstZcmCompression compression, gint level,
+    const GstVideoInfo * info, const guint8 * data, gsize size, gint stride,
+    guint8 ** out, gsize * capacity, gsize * out_size)
+{
+  switch (compression) {
+    case GST_ZCM_COMPRESSION_PNG:
+      return encode_png(level, info, data, stride, out, capacity, out_size);
+    case GST_ZCM_COMPRESSION_ZSTD:
+      return encode_zstd(level, data, size, out, capacity, out_size);
+    case GST_ZCM_COMPRESSION_JPEG:
+      return encode_jpeg(level, info, data, stride, out, capacity, out_size);
+    default:
+      return FALSE;
+  }
+}
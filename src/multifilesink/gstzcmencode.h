@@ -0,0 +1,51 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMENCODE_H_
+#define _GST_ZCMENCODE_H_
+
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/* Matches the COMPRESSION_ constants of photo_t.zcm */
+typedef enum
+{
+  GST_ZCM_COMPRESSION_NONE,
+  GST_ZCM_COMPRESSION_PNG,
+  GST_ZCM_COMPRESSION_ZSTD,
+  GST_ZCM_COMPRESSION_JPEG,
+} GstZcmCompression;
+
+/* Whether frames in format can be encoded with compression. PNG and JPEG
+ * take packed gray and RGB formats, zstd takes anything. */
+gboolean gst_zcm_encode_supported (GstZcmCompression compression,
+    GstVideoFormat format);
+
+/* Encodes one frame, whose first plane starts at data with the given stride,
+ * into *out, reallocating it (with realloc) when it holds fewer than
+ * *capacity bytes. level is the PNG or zstd compression level, -1 for the
+ * default, or the JPEG quality. Safe to call from several threads. */
+gboolean gst_zcm_encode (GstZcmCompression compression, gint level,
+    const GstVideoInfo * info, const guint8 * data, gsize size, gint stride,
+    guint8 ** out, gsize * capacity, gsize * out_size);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,245 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include "gstzcmframeindex.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static guint32
+data_offset_for (gsize pattern_size)
+{
+  gsize offset = sizeof(GstZcmFrameIndexHeader) + pattern_size;
+  return (offset + 7) & ~7;
+}
+
+static gboolean
+write_header (int fd, const char * pattern, GstZcmShardLayout shard_layout,
+    guint shard_size)
+{
+  gsize pattern_size = strlen(pattern);
+  guint32 data_offset = data_offset_for(pattern_size);
+
+  char* data = g_malloc0(data_offset);
+  GstZcmFrameIndexHeader* header = (GstZcmFrameIndexHeader*) data;
+  memcpy(header->magic, GST_ZCM_FRAME_INDEX_MAGIC, sizeof(header->magic));
+  header->version = GST_ZCM_FRAME_INDEX_VERSION;
+  header->entry_size = sizeof(GstZcmFrameIndexEntry);
+  header->data_offset = data_offset;
+  header->pattern_size = pattern_size;
+  header->shard_layout = shard_layout;
+  header->shard_size = shard_size;
+  memcpy(data + sizeof(*header), pattern, pattern_size);
+
+  gboolean ok = ftruncate(fd, 0) == 0 &&
+                pwrite(fd, data, data_offset, 0) == data_offset;
+  g_free(data);
+  return ok;
+}
+
+/* Returns the data offset if fd holds an index for pattern sharded this way,
+ * 0 otherwise */
+static guint32
+check_header (int fd, const char * pattern, GstZcmShardLayout shard_layout,
+    guint shard_size)
+{
+  GstZcmFrameIndexHeader header;
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header)) return 0;
+  if (memcmp(header.magic, GST_ZCM_FRAME_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != GST_ZCM_FRAME_INDEX_VERSION ||
+      header.entry_size != sizeof(GstZcmFrameIndexEntry) ||
+      header.pattern_size != strlen(pattern) ||
+      header.shard_layout != shard_layout || header.shard_size != shard_size ||
+      header.data_offset != data_offset_for(header.pattern_size)) {
+    return 0;
+  }
+
+  gboolean same = FALSE;
+  char* stored = g_malloc(header.pattern_size + 1);
+  if (pread(fd, stored, header.pattern_size, sizeof(header)) == header.pattern_size) {
+    same = memcmp(stored, pattern, header.pattern_size) == 0;
+  }
+  g_free(stored);
+
+  return same ? header.data_offset : 0;
+}
+
+GstZcmFrameIndex *
+gst_zcm_frame_index_open (const char * path, const char * pattern,
+    GstZcmShardLayout shard_layout, guint shard_size, gint64 * next_file)
+{
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return NULL;
+
+  guint32 data_offset = check_header(fd, pattern, shard_layout, shard_size);
+  if (data_offset == 0) {
+    if (!write_header(fd, pattern, shard_layout, shard_size)) {
+      close(fd);
+      return NULL;
+    }
+    data_offset = data_offset_for(strlen(pattern));
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  // A crash can leave a torn entry at the end, drop it
+  guint64 n_entries = ((guint64) st.st_size - data_offset) /
+                      sizeof(GstZcmFrameIndexEntry);
+  if (ftruncate(fd, data_offset + n_entries * sizeof(GstZcmFrameIndexEntry)) != 0) {
+    // Harmless, the next entry overwrites the torn one anyway
+  }
+
+  // Frames are numbered in arrival order, so the last one completed holds the
+  // highest number. Only frames in flight at a crash are left incomplete and
+  // they sit at the very end, so this reads a handful of entries at most.
+  for (guint64 i = n_entries; i > 0; --i) {
+    GstZcmFrameIndexEntry entry;
+    off_t offset = data_offset + (off_t) (i - 1) * sizeof(entry);
+    if (pread(fd, &entry, sizeof(entry), offset) != sizeof(entry)) break;
+    if (entry.size == 0) continue;
+    *next_file = entry.file + 1;
+    break;
+  }
+
+  GstZcmFrameIndex* index = g_new0(GstZcmFrameIndex, 1);
+  index->fd = fd;
+  index->data_offset = data_offset;
+  index->n_entries = n_entries;
+
+  return index;
+}
+
+void
+gst_zcm_frame_index_close (GstZcmFrameIndex * index)
+{
+  if (!index) return;
+
+  close(index->fd);
+  g_free(index);
+}
+
+guint64
+gst_zcm_frame_index_reserve (GstZcmFrameIndex * index)
+{
+  return index->n_entries++;
+}
+
+gboolean
+gst_zcm_frame_index_write (GstZcmFrameIndex * index, guint64 slot,
+    const GstZcmFrameIndexEntry * entry)
+{
+  off_t offset = index->data_offset + (off_t) slot * sizeof(*entry);
+  return pwrite(index->fd, entry, sizeof(*entry), offset) == sizeof(*entry);
+}
+
+gboolean
+gst_zcm_frame_index_forget (GstZcmFrameIndex * index, guint64 first,
+    guint64 last, gint64 file)
+{
+  GstZcmFrameIndexEntry entries[64];
+
+  for (guint64 slot = first; slot <= last; slot += G_N_ELEMENTS(entries)) {
+    guint64 n = MIN(last - slot + 1, G_N_ELEMENTS(entries));
+    off_t offset = index->data_offset + (off_t) slot * sizeof(entries[0]);
+    ssize_t size = n * sizeof(entries[0]);
+    if (pread(index->fd, entries, size, offset) != size) return FALSE;
+
+    for (guint64 i = 0; i < n; ++i) {
+      if (entries[i].file == file) entries[i].size = 0;
+    }
+    if (pwrite(index->fd, entries, size, offset) != size) return FALSE;
+  }
+
+  return TRUE;
+}
+
+gboolean
+gst_zcm_frame_index_reader_open (GstZcmFrameIndexReader * reader,
+    const char * path, GError ** error)
+{
+  memset(reader, 0, sizeof(*reader));
+
+  GMappedFile* file = g_mapped_file_new(path, FALSE, error);
+  if (!file) return FALSE;
+
+  const char* data = g_mapped_file_get_contents(file);
+  gsize size = g_mapped_file_get_length(file);
+
+  GstZcmFrameIndexHeader header;
+  if (size < sizeof(header)) goto invalid;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, GST_ZCM_FRAME_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != GST_ZCM_FRAME_INDEX_VERSION ||
+      header.entry_size != sizeof(GstZcmFrameIndexEntry) ||
+      header.data_offset != data_offset_for(header.pattern_size) ||
+      header.data_offset > size) {
+    goto invalid;
+  }
+
+  reader->file = file;
+  reader->pattern = data + sizeof(header);
+  reader->pattern_size = header.pattern_size;
+  reader->shard_layout = header.shard_layout;
+  reader->shard_size = header.shard_size;
+  reader->entries = (const GstZcmFrameIndexEntry*) (data + header.data_offset);
+  reader->n_entries = (size - header.data_offset) / sizeof(GstZcmFrameIndexEntry);
+
+  return TRUE;
+
+invalid:
+  g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+              "%s is not a zcmmultifilesink frame index", path);
+  g_mapped_file_unref(file);
+  return FALSE;
+}
+
+void
+gst_zcm_frame_index_reader_close (GstZcmFrameIndexReader * reader)
+{
+  if (reader->file) g_mapped_file_unref(reader->file);
+  memset(reader, 0, sizeof(*reader));
+}
+
+guint64
+gst_zcm_frame_index_reader_lower_bound (const GstZcmFrameIndexReader * reader,
+    gint64 utime)
+{
+  // Incomplete entries carry no timestamp, compare them by their neighbours
+  // by skipping forward to the next complete one
+  guint64 lo = 0, hi = reader->n_entries;
+  while (lo < hi) {
+    guint64 mid = lo + (hi - lo) / 2;
+    guint64 probe = mid;
+    while (probe < hi && reader->entries[probe].size == 0) probe++;
+    if (probe == hi) {
+      hi = mid;
+    } else if (reader->entries[probe].pic_utime < utime) {
+      lo = probe + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
@@ -0,0 +1,126 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMFRAMEINDEX_H_
+#define _GST_ZCMFRAMEINDEX_H_
+
+#include <gst/gst.h>
+
+#include "gstzcmshard.h"
+
+G_BEGIN_DECLS
+
+/* The frame index is a sidecar file listing every frame zcmmultifilesink
+ * wrote under one set of location patterns. It starts with a
+ * GstZcmFrameIndexHeader and the patterns, separated by
+ * GST_ZCM_FRAME_INDEX_PATTERN_SEPARATOR, followed at data_offset by one fixed
+ * size GstZcmFrameIndexEntry per frame, in the order the frames arrived and in
+ * host byte order. An entry is filled in once its frame is on disk, entries
+ * with size 0 belong to frames that were never completed or have since been
+ * deleted. The header also records how files are sharded into
+ * subdirectories, see gstzcmshard.h. */
+
+#define GST_ZCM_FRAME_INDEX_MAGIC "ZCMFRIDX"
+#define GST_ZCM_FRAME_INDEX_VERSION 3
+#define GST_ZCM_FRAME_INDEX_PATTERN_SEPARATOR ";"
+
+typedef struct _GstZcmFrameIndexHeader GstZcmFrameIndexHeader;
+typedef struct _GstZcmFrameIndexEntry GstZcmFrameIndexEntry;
+typedef struct _GstZcmFrameIndex GstZcmFrameIndex;
+
+struct _GstZcmFrameIndexHeader
+{
+  char magic[8];
+  guint32 version;
+  guint32 entry_size;
+  guint32 data_offset;
+  guint32 pattern_size;
+  guint32 shard_layout;  // a GstZcmShardLayout
+  guint32 shard_size;
+};
+
+struct _GstZcmFrameIndexEntry
+{
+  gint64 file;       // number the location pattern was formatted with
+  guint64 offset;    // of the frame within that file
+  guint64 size;
+  gint64 pic_utime;
+  gint64 utime;      // when the frame was written
+  gint32 volume;     // which pattern file was formatted with
+  gint32 shard;      // subdirectory of the file, see gst_zcm_shard_pattern()
+};
+
+struct _GstZcmFrameIndex
+{
+  int fd;
+  guint32 data_offset;
+  guint64 n_entries;
+};
+
+/* Opens the index at path for appending frames written to pattern, the
+ * location patterns joined by GST_ZCM_FRAME_INDEX_PATTERN_SEPARATOR, creating
+ * it if needed. *next_file is set to the number after the highest one in the
+ * index, or left alone when the index holds no completed frame, in which case
+ * the caller has to find out from the files on disk. An index written for other patterns
+ * or another shard layout, or by an older version, is started over. Returns
+ * NULL if the file cannot be opened. */
+GstZcmFrameIndex * gst_zcm_frame_index_open (const char * path,
+    const char * pattern, GstZcmShardLayout shard_layout, guint shard_size,
+    gint64 * next_file);
+
+void gst_zcm_frame_index_close (GstZcmFrameIndex * index);
+
+/* Claims the next entry, streaming thread only */
+guint64 gst_zcm_frame_index_reserve (GstZcmFrameIndex * index);
+
+/* Fills in an entry claimed earlier, safe to call from any thread */
+gboolean gst_zcm_frame_index_write (GstZcmFrameIndex * index, guint64 slot,
+    const GstZcmFrameIndexEntry * entry);
+
+/* Marks the entries of file's frames among slots first to last as no longer
+ * on disk, once the file has been deleted */
+gboolean gst_zcm_frame_index_forget (GstZcmFrameIndex * index, guint64 first,
+    guint64 last, gint64 file);
+
+/* Read side, for tools. Maps the index at path read only. */
+typedef struct _GstZcmFrameIndexReader GstZcmFrameIndexReader;
+
+struct _GstZcmFrameIndexReader
+{
+  GMappedFile* file;
+  const char* pattern;
+  gsize pattern_size;
+  GstZcmShardLayout shard_layout;
+  guint shard_size;
+  const GstZcmFrameIndexEntry* entries;
+  guint64 n_entries;
+};
+
+gboolean gst_zcm_frame_index_reader_open (GstZcmFrameIndexReader * reader,
+    const char * path, GError ** error);
+void gst_zcm_frame_index_reader_close (GstZcmFrameIndexReader * reader);
+
+/* Returns the first entry with pic_utime >= utime. Frames are recorded in
+ * arrival order, so pic_utime only goes backwards across clock jumps. */
+guint64 gst_zcm_frame_index_reader_lower_bound (
+    const GstZcmFrameIndexReader * reader, gint64 utime);
+
+G_END_DECLS
+
+#endif
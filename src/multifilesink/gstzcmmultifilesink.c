@@ -28,6 +28,99 @@
  * gst-launch-1.0 -v videotestsrc ! zcmmultifilesink location=/tmp/%05d.raw
  * ]|
  * Sinks test video images into location and publishes traffic to ZCM_DEFAULT_URL
+ *
+ * Files are written by a pool of writer-threads fed through a queue of up to
+ * queue-size frames, so a slow disk does not stall the streaming thread. When
+ * the queue is full queue-policy either blocks upstream or drops frames. The
+ * photo_t for a frame is only published once its file has been written.
+ * |[
+ * gst-launch-1.0 -v v4l2src ! zcmmultifilesink location=/data/%08d.raw writer-threads=4 queue-size=64 queue-policy=drop-oldest
+ * ]|
+ *
+ * write-backend=direct writes with O_DIRECT so recordings do not go through
+ * (and evict everything else from) the page cache. write-backend=uring also
+ * batches the writes into io_uring submissions, with up to uring-depth files
+ * in flight, and publishes each photo_t from the completion. It needs the
+ * plugin built against liburing and falls back to direct otherwise.
+ * |[
+ * gst-launch-1.0 -v v4l2src ! zcmmultifilesink location=/data/%08d.raw write-backend=uring uring-depth=64
+ * ]|
+ *
+ * output-mode=segments appends frames to large preallocated segment files
+ * instead of creating one file per frame, which keeps file system metadata
+ * work out of the recording path. location then numbers the segments, which
+ * roll over after segment-size bytes or segment-duration-ms. Next to each
+ * segment an index file (location + ".idx", see gstzcmsegment.h) lists the
+ * offset, size, timestamp, format and strides of its frames, and each
+ * photo_t carries the segment path and the frame's offset within it.
+ * |[
+ * gst-launch-1.0 -v v4l2src ! zcmmultifilesink location=/data/%05d.seg output-mode=segments segment-size=4294967296
+ * ]|
+ *
+ * On start the sink continues numbering after the highest numbered file
+ * matching location, which means scanning the whole output directory. With
+ * index-location set it instead keeps a frame index there (see
+ * gstzcmframeindex.h) recording the file, offset, size and timestamps of
+ * every frame, resumes from its last entry, and zcm-frame-index can list the
+ * frames recorded in a time range without touching the data.
+ * |[
+ * gst-launch-1.0 -v v4l2src ! zcmmultifilesink location=/data/%08d.raw index-location=/data/frames.idx
+ * zcm-frame-index /data/frames.idx 1600000000000000 1600000060000000
+ * ]|
+ *
+ * max-bytes, max-files and max-age bound what the sink keeps on disk: it
+ * remembers the files it wrote (and with index-location, those written by
+ * earlier runs) and a low priority background thread deletes the oldest in
+ * batches once a limit is exceeded. Segments are deleted whole.
+ * |[
+ * gst-launch-1.0 -v v4l2src ! zcmmultifilesink location=/data/%05d.seg output-mode=segments index-location=/data/frames.idx max-bytes=500000000000 max-age=604800
+ * ]|
+ *
+ * compression=png, zstd or jpeg compresses frames on compression-threads
+ * encoder threads before they are written, several frames at a time. Files,
+ * segment offsets and photo_t still follow frame order. photo_t.compression
+ * says how data_size bytes at filepath are encoded, pixelformat and strides
+ * describe the frame once decoded. PNG and JPEG take packed gray and RGB
+ * formats, zstd compresses any raw frame as is.
+ * |[
+ * gst-launch-1.0 -v v4l2src ! videoconvert ! video/x-raw,format=RGB ! zcmmultifilesink location=/data/%08d.jpg compression=jpeg jpeg-quality=90
+ * ]|
+ *
+ * locations takes several ';' separated patterns, one per disk, and stripes
+ * frames (or segments' frames) across them, in turn with
+ * stripe-policy=round-robin or to the volume with the fewest frames queued
+ * with stripe-policy=shortest-queue. Every volume has writer-threads writers
+ * and a queue of its own, so one slow disk does not hold up the others. File
+ * numbers stay unique across volumes, photo_t.volume and the frame index
+ * record which pattern a frame's file was named with, and retention limits
+ * apply to all volumes together.
+ * |[
+ * gst-launch-1.0 -v v4l2src ! zcmmultifilesink locations="/mnt/a/%08d.raw;/mnt/b/%08d.raw" stripe-policy=shortest-queue index-location=/data/frames.idx
+ * ]|
+ *
+ * shard-layout spreads files over nested subdirectories of location's
+ * directory (see gstzcmshard.h) so that creating and looking up files stays
+ * cheap however many are recorded: shard-layout=index puts shard-size files
+ * in each directory, shard-layout=hour one UTC hour. Each shard's directory is
+ * made before the sink moves into it. preallocate allocates every frame file
+ * in full before writing it, the way segments are preallocated. hugepages
+ * puts the aligned buffers the direct and uring backends copy frames into on
+ * huge pages, which pays off from 4K frames up.
+ * |[
+ * gst-launch-1.0 -v v4l2src ! zcmmultifilesink location=/data/%08d.raw shard-layout=index shard-size=10000 preallocate=true write-backend=direct
+ * ]|
+ *
+ * By default a photo_t goes out once its frame is written, not once it is
+ * durable. sync-mode=frame fdatasyncs every frame before publishing it,
+ * along with the directory of every file (or segment) it creates.
+ * sync-mode=group collects written frames and makes them durable together,
+ * with one syncfs per volume (or fdatasync per segment), once sync-frames have
+ * gathered or the oldest has waited sync-interval-ms, and publishes them
+ * afterwards. A crash then never loses a frame whose photo_t was sent, at the
+ * cost of one sync per batch rather than per frame.
+ * |[
+ * gst-launch-1.0 -v v4l2src ! zcmmultifilesink location=/data/%08d.raw sync-mode=group sync-frames=64 sync-interval-ms=50
+ * ]|
  * </refsect2>
  */
 
@@ -39,13 +132,18 @@
 #include <gst/video/video.h>
 #include <gst/video/gstvideosink.h>
 #include "gstzcmmultifilesink.h"
+#include "gstzcmtransport.h"
+#include "gstzcmformat.h"
 
-#include "assert.h"
 #include "dirent.h"
+#include "errno.h"
 #include "libgen.h"
+#include "stdarg.h"
 #include "stdio.h"
+#include "string.h"
 
 #include <sys/time.h>
+#include <time.h>
 
 #include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_image_t.h"
 
@@ -62,6 +160,12 @@ static void gst_zcm_multifilesink_get_property (GObject * object,
 static void gst_zcm_multifilesink_dispose (GObject * object);
 static void gst_zcm_multifilesink_finalize (GObject * object);
 
+static gboolean gst_zcm_multifilesink_start (GstBaseSink * sink);
+static gboolean gst_zcm_multifilesink_stop (GstBaseSink * sink);
+static gboolean gst_zcm_multifilesink_unlock (GstBaseSink * sink);
+static gboolean gst_zcm_multifilesink_unlock_stop (GstBaseSink * sink);
+static gboolean gst_zcm_multifilesink_event (GstBaseSink * sink,
+    GstEvent * event);
 static GstFlowReturn gst_zcm_multifilesink_show_frame (GstVideoSink *
     video_sink, GstBuffer * buf);
 
@@ -72,8 +176,199 @@ enum
   PROP_CHANNEL,
   PROP_LOCATION,
   PROP_PERIOD_US,
+  PROP_WRITER_THREADS,
+  PROP_QUEUE_SIZE,
+  PROP_QUEUE_POLICY,
+  PROP_QUEUE_DEPTH,
+  PROP_DROPPED_FRAMES,
+  PROP_WRITE_LATENCY_US,
+  PROP_MAX_WRITE_LATENCY_US,
+  PROP_WRITE_BACKEND,
+  PROP_URING_DEPTH,
+  PROP_OUTPUT_MODE,
+  PROP_SEGMENT_SIZE,
+  PROP_SEGMENT_DURATION_MS,
+  PROP_INDEX_LOCATION,
+  PROP_MAX_BYTES,
+  PROP_MAX_FILES,
+  PROP_MAX_AGE,
+  PROP_COMPRESSION,
+  PROP_COMPRESSION_THREADS,
+  PROP_COMPRESSION_LEVEL,
+  PROP_JPEG_QUALITY,
+  PROP_LOCATIONS,
+  PROP_STRIPE_POLICY,
+  PROP_SHARD_LAYOUT,
+  PROP_SHARD_SIZE,
+  PROP_PREALLOCATE,
+  PROP_HUGEPAGES,
+  PROP_SYNC_MODE,
+  PROP_SYNC_FRAMES,
+  PROP_SYNC_INTERVAL_MS,
 };
 
+#define DEFAULT_WRITER_THREADS 1
+#define DEFAULT_QUEUE_SIZE 16
+#define DEFAULT_URING_DEPTH 32
+#define DEFAULT_SEGMENT_SIZE (1024 * 1024 * 1024ULL)
+#define DEFAULT_JPEG_QUALITY 85
+#define DEFAULT_SHARD_SIZE 10000
+#define DEFAULT_SYNC_FRAMES 32
+#define DEFAULT_SYNC_INTERVAL_MS 100
+
+#define GST_TYPE_ZCM_MULTIFILESINK_QUEUE_POLICY (gst_zcm_multifilesink_queue_policy_get_type())
+static GType
+gst_zcm_multifilesink_queue_policy_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_ZCM_WRITER_POOL_BLOCK, "Block upstream until there is room", "block"},
+    {GST_ZCM_WRITER_POOL_DROP_NEW, "Drop the incoming frame", "drop-new"},
+    {GST_ZCM_WRITER_POOL_DROP_OLDEST, "Drop the oldest queued frame", "drop-oldest"},
+    {0, NULL, NULL},
+  };
+
+  if (!type) {
+    type = g_enum_register_static ("GstZcmMultiFileSinkQueuePolicy", values);
+  }
+  return type;
+}
+
+#define GST_TYPE_ZCM_MULTIFILESINK_WRITE_BACKEND (gst_zcm_multifilesink_write_backend_get_type())
+static GType
+gst_zcm_multifilesink_write_backend_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_ZCM_WRITE_BACKEND_BUFFERED, "Buffered writes through the page cache", "buffered"},
+    {GST_ZCM_WRITE_BACKEND_DIRECT, "O_DIRECT writes", "direct"},
+    {GST_ZCM_WRITE_BACKEND_URING, "Batched O_DIRECT writes through io_uring", "uring"},
+    {0, NULL, NULL},
+  };
+
+  if (!type) {
+    type = g_enum_register_static ("GstZcmMultiFileSinkWriteBackend", values);
+  }
+  return type;
+}
+
+#define GST_TYPE_ZCM_MULTIFILESINK_OUTPUT_MODE (gst_zcm_multifilesink_output_mode_get_type())
+static GType
+gst_zcm_multifilesink_output_mode_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_ZCM_MULTIFILESINK_OUTPUT_FILES, "One file per frame", "files"},
+    {GST_ZCM_MULTIFILESINK_OUTPUT_SEGMENTS, "Frames appended to indexed segment files", "segments"},
+    {0, NULL, NULL},
+  };
+
+  if (!type) {
+    type = g_enum_register_static ("GstZcmMultiFileSinkOutputMode", values);
+  }
+  return type;
+}
+
+#define GST_TYPE_ZCM_MULTIFILESINK_COMPRESSION (gst_zcm_multifilesink_compression_get_type())
+static GType
+gst_zcm_multifilesink_compression_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_ZCM_COMPRESSION_NONE, "Raw frames", "none"},
+    {GST_ZCM_COMPRESSION_PNG, "Lossless PNG", "png"},
+    {GST_ZCM_COMPRESSION_ZSTD, "Lossless zstd of the raw frame", "zstd"},
+    {GST_ZCM_COMPRESSION_JPEG, "JPEG at jpeg-quality", "jpeg"},
+    {0, NULL, NULL},
+  };
+
+  if (!type) {
+    type = g_enum_register_static ("GstZcmMultiFileSinkCompression", values);
+  }
+  return type;
+}
+
+#define GST_TYPE_ZCM_MULTIFILESINK_STRIPE_POLICY (gst_zcm_multifilesink_stripe_policy_get_type())
+static GType
+gst_zcm_multifilesink_stripe_policy_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_ZCM_MULTIFILESINK_STRIPE_ROUND_ROBIN, "Each volume in turn", "round-robin"},
+    {GST_ZCM_MULTIFILESINK_STRIPE_SHORTEST_QUEUE, "The volume with the fewest frames queued", "shortest-queue"},
+    {0, NULL, NULL},
+  };
+
+  if (!type) {
+    type = g_enum_register_static ("GstZcmMultiFileSinkStripePolicy", values);
+  }
+  return type;
+}
+
+#define GST_TYPE_ZCM_MULTIFILESINK_SHARD_LAYOUT (gst_zcm_multifilesink_shard_layout_get_type())
+static GType
+gst_zcm_multifilesink_shard_layout_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_ZCM_SHARD_NONE, "All files in location's directory", "none"},
+    {GST_ZCM_SHARD_INDEX, "shard-size files per subdirectory", "index"},
+    {GST_ZCM_SHARD_HOUR, "A subdirectory per UTC hour", "hour"},
+    {0, NULL, NULL},
+  };
+
+  if (!type) {
+    type = g_enum_register_static ("GstZcmMultiFileSinkShardLayout", values);
+  }
+  return type;
+}
+
+#define GST_TYPE_ZCM_MULTIFILESINK_SYNC_MODE (gst_zcm_multifilesink_sync_mode_get_type())
+static GType
+gst_zcm_multifilesink_sync_mode_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_ZCM_MULTIFILESINK_SYNC_NONE, "Publish frames once written", "none"},
+    {GST_ZCM_MULTIFILESINK_SYNC_FRAME, "fdatasync every frame before publishing it", "frame"},
+    {GST_ZCM_MULTIFILESINK_SYNC_GROUP, "Sync frames in batches before publishing them", "group"},
+    {0, NULL, NULL},
+  };
+
+  if (!type) {
+    type = g_enum_register_static ("GstZcmMultiFileSinkSyncMode", values);
+  }
+  return type;
+}
+
+/* A frame on its way to disk. The buffer is held by reference until written.
+ * Jobs are recycled through the sink's free list, keeping their filepath
+ * buffer, so a steady stream of frames does not allocate. */
+typedef struct _GstZcmMultiFileSinkJob
+{
+  struct _GstZcmMultiFileSinkJob* next;
+  GstZcmMultiFileSink* sink;
+  GstBuffer* buf;
+  char* filepath;
+  gsize filepath_size;
+  GstZcmSegment* segment; // NULL when writing a file of its own
+  char* rolled_path;      // segment of the volume closed before this frame
+  guint32 entry;
+  gint64 file;            // number location was formatted with
+  guint volume;
+  gint32 shard;
+  guint64 index_slot;
+  guint64 encode_seq;
+  guint64 publish_seq;
+  gboolean ok;
+  gboolean dropped;
+  guint8* encoded;        // the frame compressed, the buffer is released then
+  gsize encoded_capacity;
+  gsize encoded_size;
+  zcm_gstreamer_plugins_photo_t photo;
+  int32_t stride[GST_VIDEO_MAX_PLANES];
+} GstZcmMultiFileSinkJob;
+
 /* Private members */
 
 static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
@@ -89,14 +384,6 @@ static inline uint64_t utime()
     return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
-static inline void usleep(uint64_t us)
-{
-    struct timespec req = { 0 };
-    req.tv_sec          = us / 1000000L;
-    req.tv_nsec         = (us - req.tv_sec * 1000000L) * 1000L;
-    nanosleep(&req, NULL);
-}
-
 static inline void printf_int_to_scanf(char* dst, const char* src)
 {
     int inIntFmtStr = 0;
@@ -117,10 +404,11 @@ static inline void printf_int_to_scanf(char* dst, const char* src)
     *dst = '\0';
 }
 
-static inline void updateStartFilepath(GstZcmMultiFileSink* zcmmultifilesink)
+static inline void updateStartFilepath(GstZcmMultiFileSink* zcmmultifilesink,
+                                       const char* location)
 {
-  char* loc1 = strdup(zcmmultifilesink->location->str);
-  char* loc2 = strdup(zcmmultifilesink->location->str);
+  char* loc1 = strdup(location);
+  char* loc2 = strdup(location);
   // apparently these calls can modify the input,
   // but you actually want the output, so it's ugly
   char* bName = basename(loc1);
@@ -145,7 +433,7 @@ static inline void updateStartFilepath(GstZcmMultiFileSink* zcmmultifilesink)
   } else {
     printf("Output directory not found, starting from ");
   }
-  printf(zcmmultifilesink->location->str, zcmmultifilesink->nwrites);
+  printf(location, zcmmultifilesink->nwrites);
   printf("\n");
 
   free(loc1);
@@ -153,44 +441,759 @@ static inline void updateStartFilepath(GstZcmMultiFileSink* zcmmultifilesink)
   free(sFmt);
 }
 
+/* Formats into *str, growing it only when the result does not fit */
+static void
+format_into (char** str, gsize* size, const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  gsize length = g_vsnprintf(*str, *size, format, args);
+  va_end(args);
+
+  if (length >= *size) {
+    *size = length + 1;
+    g_free(*str);
+    *str = g_malloc(*size);
+    va_start(args, format);
+    g_vsnprintf(*str, *size, format, args);
+    va_end(args);
+  }
+}
+
+/* Re-announces the latest photo_t once nothing has been published for
+ * period-us. Publishing a frame pushes the deadline back, so while frames
+ * flow this wakes up at most once a period and publishes nothing. */
 static void* pub_thread(void* usr)
 {
   GstZcmMultiFileSink* zcmmultifilesink = (GstZcmMultiFileSink*) usr;
 
-  bool exit;
-  GString* channel = g_string_new("");
-  gulong period_us;
-  zcm_gstreamer_plugins_photo_t* photo = NULL;
+  char* channel = NULL;
+  gsize channel_size = 0;
 
-  while (true) {
-    pthread_mutex_lock(&zcmmultifilesink->mutex);
+  pthread_mutex_lock(&zcmmultifilesink->mutex);
+  while (!zcmmultifilesink->exit) {
+    gint64 now = g_get_monotonic_time();
+    gint64 deadline = zcmmultifilesink->last_publish + zcmmultifilesink->period_us;
 
-        exit = zcmmultifilesink->exit;
-        g_string_assign(channel, zcmmultifilesink->channel->str);
-        period_us = zcmmultifilesink->period_us;
+    if (zcmmultifilesink->front < 0) {
+      pthread_cond_wait(&zcmmultifilesink->pub_cond, &zcmmultifilesink->mutex);
+      continue;
+    }
+    if (now < deadline) {
+      struct timespec ts;
+      ts.tv_sec = deadline / G_USEC_PER_SEC;
+      ts.tv_nsec = (deadline % G_USEC_PER_SEC) * 1000;
+      pthread_cond_timedwait(&zcmmultifilesink->pub_cond, &zcmmultifilesink->mutex, &ts);
+      continue;
+    }
 
-        if (zcmmultifilesink->photo) {
-            if (photo) zcm_gstreamer_plugins_photo_t_destroy(photo);
-            photo = zcmmultifilesink->photo;
-            zcmmultifilesink->photo = NULL;
-        }
+    if (zcmmultifilesink->channel_changed) {
+      format_into(&channel, &channel_size, "%s", zcmmultifilesink->channel->str);
+      zcmmultifilesink->channel_changed = false;
+    }
+
+    // Writers fill the other copy meanwhile, see publish_photo
+    gint slot = zcmmultifilesink->reading = zcmmultifilesink->front;
+    zcmmultifilesink->last_publish = now;
 
     pthread_mutex_unlock(&zcmmultifilesink->mutex);
 
-    if (exit) break;
+    zcm_gstreamer_plugins_photo_t* photo = &zcmmultifilesink->latest[slot].photo;
+    photo->utime = utime();
+    zcm_gstreamer_plugins_photo_t_publish(zcmmultifilesink->zcm, channel, photo);
+
+    pthread_mutex_lock(&zcmmultifilesink->mutex);
+    zcmmultifilesink->reading = -1;
+  }
+  pthread_mutex_unlock(&zcmmultifilesink->mutex);
+
+  g_free(channel);
+
+  return NULL;
+}
+
+static GstZcmMultiFileSinkJob*
+job_new (GstZcmMultiFileSink* zcmmultifilesink)
+{
+  pthread_mutex_lock(&zcmmultifilesink->jobs_mutex);
+  GstZcmMultiFileSinkJob* job = zcmmultifilesink->free_jobs;
+  if (job) zcmmultifilesink->free_jobs = job->next;
+  pthread_mutex_unlock(&zcmmultifilesink->jobs_mutex);
+
+  if (!job) job = g_slice_new0(GstZcmMultiFileSinkJob);
+
+  job->next = NULL;
+  job->sink = zcmmultifilesink;
+  job->segment = NULL;
+  job->rolled_path = NULL;
+  job->entry = 0;
+  job->file = 0;
+  job->volume = 0;
+  job->shard = 0;
+  job->index_slot = 0;
+  job->ok = FALSE;
+  job->dropped = FALSE;
+  job->encoded_size = 0;
+  memset(&job->photo, 0, sizeof(job->photo));
+
+  return job;
+}
+
+static void
+job_free (gpointer data)
+{
+  GstZcmMultiFileSinkJob* job = data;
+  GstZcmMultiFileSink* zcmmultifilesink = job->sink;
+
+  if (job->buf) gst_buffer_unref(job->buf);
+  job->buf = NULL;
+  gst_zcm_segment_unref(job->segment);
+  job->segment = NULL;
+  g_free(job->rolled_path);
+  job->rolled_path = NULL;
+
+  pthread_mutex_lock(&zcmmultifilesink->jobs_mutex);
+  job->next = zcmmultifilesink->free_jobs;
+  zcmmultifilesink->free_jobs = job;
+  pthread_mutex_unlock(&zcmmultifilesink->jobs_mutex);
+}
+
+static void
+publish_photo (GstZcmMultiFileSink* zcmmultifilesink,
+               zcm_gstreamer_plugins_photo_t* photo)
+{
+  photo->utime = utime();
+
+  pthread_mutex_lock(&zcmmultifilesink->mutex);
+
+  zcm_gstreamer_plugins_photo_t_publish(zcmmultifilesink->zcm, zcmmultifilesink->channel->str, photo);
+
+  // Keep a copy for pub_thread to re-announce, in whichever copy it is not
+  // sending right now
+  gint front = zcmmultifilesink->front;
+  gint slot = front < 0 ? 0 : (zcmmultifilesink->reading == 1 - front ? front : 1 - front);
+  GstZcmMultiFileSinkPhoto* latest = &zcmmultifilesink->latest[slot];
 
-    if (photo) {
-      photo->utime = utime();
-      zcm_gstreamer_plugins_photo_t_publish(zcmmultifilesink->zcm, channel->str, photo);
+  format_into(&latest->filepath, &latest->filepath_size, "%s", photo->filepath);
+  latest->photo = *photo;
+  latest->photo.filepath = latest->filepath;
+  latest->photo.num_strides = MIN(photo->num_strides, GST_VIDEO_MAX_PLANES);
+  latest->photo.stride = latest->stride;
+  memcpy(latest->stride, photo->stride, latest->photo.num_strides * sizeof(int32_t));
+
+  zcmmultifilesink->front = slot;
+  zcmmultifilesink->last_publish = g_get_monotonic_time();
+  if (front < 0) pthread_cond_signal(&zcmmultifilesink->pub_cond);
+
+  pthread_mutex_unlock(&zcmmultifilesink->mutex);
+}
+
+static gboolean
+write_buffered (const char* path, const guint8* data, gsize size,
+                GstZcmFileFlags flags)
+{
+  FILE *fp = fopen(path, "w");
+  if (!fp) return FALSE;
+  if (flags & GST_ZCM_FILE_PREALLOCATE) gst_zcm_direct_preallocate(fileno(fp), size);
+  gboolean ok = fwrite(data, 1, size, fp) == size;
+  if (ok && (flags & GST_ZCM_FILE_SYNC)) {
+    ok = fflush(fp) == 0 && gst_zcm_direct_sync(fileno(fp));
+  }
+  ok = fclose(fp) == 0 && ok;
+  if (ok && (flags & GST_ZCM_FILE_SYNC)) ok = gst_zcm_direct_sync_dir(path);
+  return ok;
+}
+
+static gboolean
+write_index_entry (GstZcmMultiFileSinkJob* job)
+{
+  zcm_gstreamer_plugins_photo_t* photo = &job->photo;
+
+  GstZcmSegmentIndexEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.offset = photo->offset;
+  entry.size = photo->data_size;
+  entry.pic_utime = photo->pic_utime;
+  entry.pixelformat = photo->pixelformat;
+  entry.width = photo->width;
+  entry.height = photo->height;
+  entry.compression = photo->compression;
+  entry.num_strides = MIN(photo->num_strides, GST_ZCM_SEGMENT_MAX_STRIDES);
+  for (gint i = 0; i < entry.num_strides; ++i) entry.stride[i] = photo->stride[i];
+
+  return gst_zcm_segment_write_entry(job->segment, job->entry, &entry);
+}
+
+static void
+write_frame_index_entry (GstZcmMultiFileSinkJob* job)
+{
+  GstZcmMultiFileSink* zcmmultifilesink = job->sink;
+
+  GstZcmFrameIndexEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.file = job->file;
+  entry.volume = job->volume;
+  entry.shard = job->shard;
+  entry.offset = job->photo.offset;
+  entry.size = job->photo.data_size;
+  entry.pic_utime = job->photo.pic_utime;
+  entry.utime = g_get_real_time();
+
+  // The frame itself is fine, it only cannot be found through the index
+  if (!gst_zcm_frame_index_write(zcmmultifilesink->index, job->index_slot, &entry)) {
+    GST_WARNING_OBJECT (zcmmultifilesink, "Failed to index %s: %s",
+        job->filepath, g_strerror(errno));
+  }
+}
+
+/* Publishes a written frame (once it is indexed, for segments) and frees the
+ * job. Runs in frame order, see publish_job. */
+static void
+complete_job (GstZcmMultiFileSinkJob* job)
+{
+  GstZcmMultiFileSink* zcmmultifilesink = job->sink;
+
+  gboolean ok = job->ok;
+  if (ok && job->segment) ok = write_index_entry(job);
+
+  if (ok) {
+    if (zcmmultifilesink->index) write_frame_index_entry(job);
+    gst_zcm_retention_add(&zcmmultifilesink->retention, job->filepath, job->file,
+        job->photo.data_size, g_get_real_time(),
+        zcmmultifilesink->index ? job->index_slot : GST_ZCM_RETENTION_NO_SLOT,
+        job->segment != NULL);
+    publish_photo(zcmmultifilesink, &job->photo);
+  } else if (!job->dropped) {
+    GST_ERROR_OBJECT (zcmmultifilesink, "Failed to write file %s: %s",
+        job->filepath, g_strerror(errno));
+  }
+
+  // Every frame of the rolled segment came before this one, so all of them
+  // have been accounted for
+  if (job->rolled_path) {
+    gst_zcm_retention_close(&zcmmultifilesink->retention, job->rolled_path);
+  }
+  job_free(job);
+}
+
+/* Written frames come here in frame order, see finish_job. With
+ * sync-mode=group they wait for their batch to be synced first. */
+static void
+publish_job (gpointer data, gpointer usr)
+{
+  GstZcmMultiFileSinkJob* job = data;
+  GstZcmMultiFileSink* zcmmultifilesink = job->sink;
+
+  if (job->ok && zcmmultifilesink->syncing == GST_ZCM_MULTIFILESINK_SYNC_GROUP) {
+    gst_zcm_commit_add(&zcmmultifilesink->commit, job);
+    return;
+  }
+  complete_job(job);
+}
+
+/* Makes a batch of written frames durable on the commit thread. Frames in a
+ * segment take an fdatasync of the segment, files of their own a syncfs of
+ * their volume, which covers the data and the file system metadata of
+ * every file written to it. */
+static gboolean
+commit_sync (gpointer* items, guint n_items, gpointer usr)
+{
+  GstZcmMultiFileSink* zcmmultifilesink = (GstZcmMultiFileSink*) usr;
+
+  gboolean ok = TRUE;
+  int error = 0;
+  for (guint i = 0; i < n_items; ++i) {
+    GstZcmMultiFileSinkJob* job = items[i];
+    GstZcmMultiFileSinkVolume* volume = &zcmmultifilesink->volumes[job->volume];
+    if (!job->segment) {
+      volume->sync_path = job->filepath;
+    } else if (job->segment != volume->synced_segment) {
+      // Frames are placed in order, so a volume's segments do not repeat
+      if (!gst_zcm_direct_sync(job->segment->fd)) {
+        ok = FALSE;
+        error = errno;
+      }
+      volume->synced_segment = job->segment;
+    }
+  }
+
+  for (guint i = 0; i < zcmmultifilesink->n_volumes; ++i) {
+    GstZcmMultiFileSinkVolume* volume = &zcmmultifilesink->volumes[i];
+    if (volume->sync_path && !gst_zcm_direct_sync_fs(volume->sync_path)) {
+      ok = FALSE;
+      error = errno;
     }
+    volume->sync_path = NULL;
+    volume->synced_segment = NULL;
+  }
 
-    usleep(period_us);
+  if (!ok) {
+    GST_ERROR_OBJECT (zcmmultifilesink, "Failed to sync %u frames: %s",
+        n_items, g_strerror(error));
   }
+  return ok;
+}
 
-  if (photo) zcm_gstreamer_plugins_photo_t_destroy(photo);
-  g_string_free(channel, true);
+static void
+commit_done (gpointer data, gboolean ok, gpointer usr)
+{
+  GstZcmMultiFileSinkJob* job = data;
 
-  return NULL;
+  // Not durable, so not published. commit_sync reported it already.
+  if (!ok) {
+    job->ok = FALSE;
+    job->dropped = TRUE;
+  }
+  complete_job(job);
+}
+
+/* Writes complete out of order with several writer threads or io_uring, the
+ * photo_t still go out in frame order */
+static void
+finish_job (GstZcmMultiFileSinkJob* job, gboolean ok)
+{
+  job->ok = ok;
+  gst_zcm_sequencer_done(&job->sink->publish_order, job->publish_seq, job);
+}
+
+/* Frames the writer queue drops still take their turn in publish_job */
+static void
+drop_job (gpointer data)
+{
+  GstZcmMultiFileSinkJob* job = data;
+  job->dropped = TRUE;
+  finish_job(job, FALSE);
+}
+
+/* Runs on the retention thread after it deleted one of our files */
+static void
+retention_removed (const GstZcmRetentionFile* file, gpointer usr)
+{
+  GstZcmMultiFileSink* zcmmultifilesink = (GstZcmMultiFileSink*) usr;
+
+  if (zcmmultifilesink->output_mode == GST_ZCM_MULTIFILESINK_OUTPUT_SEGMENTS) {
+    char* index_path = g_strconcat(file->path, GST_ZCM_SEGMENT_INDEX_SUFFIX, NULL);
+    remove(index_path);
+    g_free(index_path);
+  }
+  gst_zcm_shard_cleanup(file->path, zcmmultifilesink->shard_layout);
+
+  if (zcmmultifilesink->index && file->first_slot != GST_ZCM_RETENTION_NO_SLOT &&
+      !gst_zcm_frame_index_forget(zcmmultifilesink->index, file->first_slot,
+                                  file->last_slot, file->file)) {
+    GST_WARNING_OBJECT (zcmmultifilesink, "Failed to remove %s from the frame index",
+        file->path);
+  }
+}
+
+/* Tracks the files recorded in the frame index by earlier runs, so retention
+ * covers them without scanning the output directory */
+static void
+retention_load_index (GstZcmMultiFileSink* zcmmultifilesink)
+{
+  GError* error = NULL;
+  GstZcmFrameIndexReader reader;
+  if (!gst_zcm_frame_index_reader_open(&reader,
+          zcmmultifilesink->index_location->str, &error)) {
+    GST_WARNING_OBJECT (zcmmultifilesink, "%s", error->message);
+    g_error_free(error);
+    return;
+  }
+
+  // The index was opened for the current volumes, so entry->volume is one
+  // of them unless the file is damaged
+  char* path = NULL;
+  gint64 file = -1;
+  for (guint64 i = 0; i < reader.n_entries; ++i) {
+    const GstZcmFrameIndexEntry* entry = &reader.entries[i];
+    if (entry->size == 0) continue;
+    if (entry->volume < 0 || entry->volume >= (gint32) zcmmultifilesink->n_volumes) continue;
+    if (!path || entry->file != file) {
+      g_free(path);
+      file = entry->file;
+      char* pattern = gst_zcm_shard_pattern(
+          zcmmultifilesink->volumes[entry->volume].location,
+          zcmmultifilesink->shard_layout, entry->shard);
+      path = g_strdup_printf(pattern, file);
+      g_free(pattern);
+    }
+    gst_zcm_retention_add(&zcmmultifilesink->retention, path, file,
+        entry->size, entry->utime, i, false);
+  }
+  g_free(path);
+
+  gst_zcm_frame_index_reader_close(&reader);
+}
+
+/* Runs on the io_uring completion thread */
+static void
+uring_done (gpointer data, gboolean ok, gpointer usr)
+{
+  finish_job(data, ok);
+}
+
+static void
+uring_flush (gpointer usr)
+{
+  GstZcmMultiFileSinkVolume* volume = usr;
+  gst_zcm_uring_writer_flush(volume->uring);
+}
+
+/* Runs on a writer thread, or on the streaming thread with writer-threads=0 */
+static void
+write_job (gpointer data, gpointer usr)
+{
+  GstZcmMultiFileSinkJob* job = data;
+  GstZcmMultiFileSink* zcmmultifilesink = job->sink;
+  GstZcmMultiFileSinkVolume* volume = &zcmmultifilesink->volumes[job->volume];
+
+  // Our own reference, the job may be finished and recycled by the io_uring
+  // completion before the buffer is unmapped here
+  GstBuffer* buf = job->buf ? gst_buffer_ref(job->buf) : NULL;
+  GstMapInfo info;
+  const guint8* bytes = job->encoded;
+  gsize size = job->encoded_size;
+  if (buf) {
+    if (!gst_buffer_map (buf, &info, GST_MAP_READ)) {
+      GST_WARNING_OBJECT (zcmmultifilesink, "could not map buffer info");
+      gst_buffer_unref(buf);
+      finish_job(job, FALSE);
+      return;
+    }
+    bytes = info.data;
+    size = info.size;
+  }
+
+  GstZcmFileFlags flags = 0;
+  if (zcmmultifilesink->preallocate) flags |= GST_ZCM_FILE_PREALLOCATE;
+  if (zcmmultifilesink->hugepages) flags |= GST_ZCM_FILE_HUGEPAGES;
+  if (zcmmultifilesink->syncing == GST_ZCM_MULTIFILESINK_SYNC_FRAME) flags |= GST_ZCM_FILE_SYNC;
+
+  GstZcmSegment* segment = job->segment;
+  gboolean ok;
+  switch (zcmmultifilesink->backend) {
+    case GST_ZCM_WRITE_BACKEND_URING:
+      // The data is staged in an aligned buffer, so the frame can be released
+      // right away and the job completes in uring_done
+      if (segment) {
+        ok = gst_zcm_uring_writer_submit_at(volume->uring, segment->fd,
+            job->photo.offset, bytes, size, segment->direct, flags, job);
+      } else {
+        ok = gst_zcm_uring_writer_submit(volume->uring, job->filepath,
+            bytes, size, flags, job);
+      }
+      if (!ok) finish_job(job, FALSE);
+      break;
+    case GST_ZCM_WRITE_BACKEND_DIRECT:
+      if (segment) {
+        ok = gst_zcm_direct_pwrite(segment->fd, job->photo.offset,
+            bytes, size, segment->direct, flags);
+      } else {
+        ok = gst_zcm_direct_write_file(job->filepath, bytes, size, flags);
+      }
+      break;
+    default:
+      if (segment) {
+        ok = gst_zcm_direct_pwrite(segment->fd, job->photo.offset,
+            bytes, size, FALSE, flags);
+      } else {
+        ok = write_buffered(job->filepath, bytes, size, flags);
+      }
+      break;
+  }
+  if (ok && segment && (flags & GST_ZCM_FILE_SYNC) &&
+      zcmmultifilesink->backend != GST_ZCM_WRITE_BACKEND_URING) {
+    ok = gst_zcm_direct_sync(segment->fd);
+  }
+
+  if (zcmmultifilesink->backend != GST_ZCM_WRITE_BACKEND_URING) finish_job(job, ok);
+
+  if (buf) {
+    gst_buffer_unmap (buf, &info);
+    gst_buffer_unref(buf);
+  }
+}
+
+/* Runs on an encoder thread */
+static void
+encode_job (gpointer data, gpointer usr)
+{
+  GstZcmMultiFileSinkJob* job = data;
+  GstZcmMultiFileSink* zcmmultifilesink = job->sink;
+
+  gint level = zcmmultifilesink->encoding == GST_ZCM_COMPRESSION_JPEG ?
+               zcmmultifilesink->jpeg_quality : zcmmultifilesink->compression_level;
+
+  GstMapInfo info;
+  if (gst_buffer_map (job->buf, &info, GST_MAP_READ)) {
+    job->ok = gst_zcm_encode(zcmmultifilesink->encoding, level,
+        &zcmmultifilesink->info, info.data, info.size, job->stride[0],
+        &job->encoded, &job->encoded_capacity, &job->encoded_size);
+    gst_buffer_unmap (job->buf, &info);
+  }
+  if (!job->ok) GST_ERROR_OBJECT (zcmmultifilesink, "Failed to encode frame");
+
+  // Only the encoded frame is written, hand the buffer back upstream now
+  gst_buffer_unref(job->buf);
+  job->buf = NULL;
+
+  gst_zcm_sequencer_done(&zcmmultifilesink->encode_order, job->encode_seq, job);
+}
+
+static void
+drop_encode (gpointer data)
+{
+  GstZcmMultiFileSinkJob* job = data;
+  job->dropped = TRUE;
+  gst_zcm_sequencer_done(&job->sink->encode_order, job->encode_seq, job);
+}
+
+/* Returns the pattern file is to be created with on volume, in the directory
+ * of its shard, which is set in *shard */
+static const char*
+shard_pattern (GstZcmMultiFileSink* zcmmultifilesink,
+               GstZcmMultiFileSinkVolume* volume, gint64 file, gint32* shard)
+{
+  GstZcmShardLayout layout = zcmmultifilesink->shard_layout;
+  *shard = 0;
+  if (layout == GST_ZCM_SHARD_NONE) return volume->location;
+
+  gint64 number = gst_zcm_shard_number(layout, zcmmultifilesink->shard_size,
+      file, g_get_real_time());
+  if (number != volume->shard || !volume->pattern) {
+    // Normally made along with the previous shard, see below
+    if (!gst_zcm_shard_prepare(volume->location, layout, number)) {
+      GST_WARNING_OBJECT (zcmmultifilesink, "Failed to create shard %"
+          G_GINT64_FORMAT " of %s: %s", number, volume->location, g_strerror(errno));
+    }
+    // Making the next shard's directory now leaves only file creates for the
+    // frames that cross into it
+    gst_zcm_shard_prepare(volume->location, layout, number + 1);
+
+    g_free(volume->pattern);
+    volume->pattern = gst_zcm_shard_pattern(volume->location, layout, number);
+    volume->shard = number;
+  }
+  *shard = volume->shard;
+
+  return volume->pattern;
+}
+
+/* Returns the segment on volume the next frame of size bytes goes into,
+ * starting a new one when the current one is full or old enough */
+static GstZcmSegment*
+current_segment (GstZcmMultiFileSink* zcmmultifilesink,
+                 GstZcmMultiFileSinkVolume* volume, gsize size)
+{
+  GstZcmSegment* segment = volume->segment;
+
+  if (segment && segment->n_frames > 0) {
+    bool full = segment->used + size > zcmmultifilesink->segment_size;
+    bool old = zcmmultifilesink->segment_duration_ms > 0 &&
+               g_get_monotonic_time() - segment->open_time >=
+                   (gint64) zcmmultifilesink->segment_duration_ms * 1000;
+    if (full || old) {
+      // Frames still being written hold their own reference
+      if (!volume->rolled_path) volume->rolled_path = g_strdup(segment->path);
+      gst_zcm_segment_unref(segment);
+      segment = volume->segment = NULL;
+    }
+  }
+
+  if (!segment) {
+    const char* pattern = shard_pattern(zcmmultifilesink, volume,
+        zcmmultifilesink->nwrites, &volume->segment_shard);
+    char* path = g_strdup_printf(pattern, zcmmultifilesink->nwrites);
+    segment = gst_zcm_segment_open(path, zcmmultifilesink->segment_size,
+        zcmmultifilesink->backend != GST_ZCM_WRITE_BACKEND_BUFFERED);
+    // Frames only fdatasync the segment, its directory entry (and that of
+    // its index) has to be durable before the first of them is published
+    if (segment && zcmmultifilesink->syncing != GST_ZCM_MULTIFILESINK_SYNC_NONE &&
+        !gst_zcm_direct_sync_dir(path)) {
+      GST_ERROR_OBJECT (zcmmultifilesink, "Failed to sync the directory of %s: %s",
+          path, g_strerror(errno));
+      gst_zcm_segment_unref(segment);
+      segment = NULL;
+    } else if (segment) {
+      GST_DEBUG_OBJECT (zcmmultifilesink, "Started segment %s", path);
+      volume->segment_file = zcmmultifilesink->nwrites++;
+    } else {
+      GST_ERROR_OBJECT (zcmmultifilesink, "Failed to create segment %s: %s",
+          path, g_strerror(errno));
+    }
+    g_free(path);
+    volume->segment = segment;
+  }
+
+  return segment;
+}
+
+/* Picks the volume the next frame goes to according to stripe-policy. Queues
+ * that are equally short are taken in turn. */
+static guint
+choose_volume (GstZcmMultiFileSink* zcmmultifilesink)
+{
+  guint n = zcmmultifilesink->n_volumes;
+  guint first = zcmmultifilesink->next_volume % n;
+  zcmmultifilesink->next_volume = first + 1;
+
+  if (zcmmultifilesink->stripe_policy != GST_ZCM_MULTIFILESINK_STRIPE_SHORTEST_QUEUE ||
+      n == 1) {
+    return first;
+  }
+
+  guint best = first;
+  guint best_depth = G_MAXUINT;
+  for (guint i = 0; i < n; ++i) {
+    guint v = (first + i) % n;
+    GstZcmWriterPoolStats stats;
+    gst_zcm_writer_pool_get_stats(&zcmmultifilesink->volumes[v].writers, &stats);
+    if (stats.depth < best_depth) {
+      best = v;
+      best_depth = stats.depth;
+    }
+  }
+  return best;
+}
+
+/* Gives the frame its volume and file, or its place in the volume's current
+ * segment, now that its size on disk is known. Runs on one thread at a time,
+ * in frame order. */
+static gboolean
+place_job (GstZcmMultiFileSink* zcmmultifilesink, GstZcmMultiFileSinkJob* job,
+           gsize size)
+{
+  zcm_gstreamer_plugins_photo_t* photo = &job->photo;
+
+  job->volume = choose_volume(zcmmultifilesink);
+  photo->volume = job->volume;
+  GstZcmMultiFileSinkVolume* volume = &zcmmultifilesink->volumes[job->volume];
+
+  if (zcmmultifilesink->output_mode == GST_ZCM_MULTIFILESINK_OUTPUT_SEGMENTS) {
+    GstZcmSegment* segment = current_segment(zcmmultifilesink, volume, size);
+    if (!segment) return FALSE;
+    job->segment = gst_zcm_segment_ref(segment);
+    format_into(&job->filepath, &job->filepath_size, "%s", segment->path);
+    job->file = volume->segment_file;
+    job->shard = volume->segment_shard;
+    job->rolled_path = volume->rolled_path;
+    volume->rolled_path = NULL;
+    photo->offset = gst_zcm_segment_reserve(segment, size, &job->entry);
+  } else {
+    const char* pattern = shard_pattern(zcmmultifilesink, volume,
+        zcmmultifilesink->nwrites, &job->shard);
+    format_into(&job->filepath, &job->filepath_size, pattern,
+        zcmmultifilesink->nwrites);
+    job->file = zcmmultifilesink->nwrites++;
+    photo->offset = 0;
+  }
+
+  if (zcmmultifilesink->index) {
+    job->index_slot = gst_zcm_frame_index_reserve(zcmmultifilesink->index);
+  }
+
+  photo->filepath = job->filepath;
+  photo->data_size = size;
+  job->publish_seq = gst_zcm_sequencer_take(&zcmmultifilesink->publish_order);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+submit_job (GstZcmMultiFileSink* zcmmultifilesink, GstZcmMultiFileSinkJob* job)
+{
+  GstZcmMultiFileSinkVolume* volume = &zcmmultifilesink->volumes[job->volume];
+
+  if (volume->writers.n_threads == 0) {
+    write_job(job, volume);
+    if (volume->uring) gst_zcm_uring_writer_flush(volume->uring);
+    return GST_FLOW_OK;
+  }
+
+  return gst_zcm_writer_pool_push(&volume->writers, job);
+}
+
+/* Keeps the first error of an encoded frame, which the next show_frame
+ * returns upstream. A flushing writer pool merely drops the frame. */
+static void
+encoded_failed (GstZcmMultiFileSink* zcmmultifilesink, GstFlowReturn ret)
+{
+  if (ret == GST_FLOW_OK || ret == GST_FLOW_FLUSHING) return;
+  g_atomic_int_compare_and_exchange(&zcmmultifilesink->encoded_ret,
+                                    GST_FLOW_OK, ret);
+}
+
+/* Encoded frames come back here in frame order */
+static void
+encoded_job (gpointer data, gpointer usr)
+{
+  GstZcmMultiFileSinkJob* job = data;
+  GstZcmMultiFileSink* zcmmultifilesink = job->sink;
+
+  if (!job->ok) {
+    encoded_failed(zcmmultifilesink, GST_FLOW_ERROR);
+    job_free(job);
+    return;
+  }
+
+  if (!place_job(zcmmultifilesink, job, job->encoded_size)) {
+    encoded_failed(zcmmultifilesink, GST_FLOW_ERROR);
+    job_free(job);
+    return;
+  }
+
+  encoded_failed(zcmmultifilesink, submit_job(zcmmultifilesink, job));
+}
+
+static void
+volumes_free (GstZcmMultiFileSinkVolume* volumes, guint n_volumes)
+{
+  for (guint i = 0; i < n_volumes; ++i) {
+    gst_zcm_writer_pool_clear(&volumes[i].writers);
+    g_free(volumes[i].location);
+    g_free(volumes[i].pattern);
+    g_free(volumes[i].rolled_path);
+  }
+  g_free(volumes);
+}
+
+/* Sets up a volume for each of locations, or for location if that is empty,
+ * replacing the previous ones. Returns the patterns joined the way the frame
+ * index records them. */
+static char*
+volumes_new (GstZcmMultiFileSink* zcmmultifilesink)
+{
+  const char* patterns = zcmmultifilesink->locations->str[0] != '\0' ?
+                         zcmmultifilesink->locations->str :
+                         zcmmultifilesink->location->str;
+  char** split = g_strsplit(patterns, GST_ZCM_FRAME_INDEX_PATTERN_SEPARATOR, -1);
+
+  GstZcmMultiFileSinkVolume* volumes = g_new0(GstZcmMultiFileSinkVolume, g_strv_length(split));
+  guint n_volumes = 0;
+  for (guint i = 0; split[i]; ++i) {
+    if (split[i][0] == '\0') continue;
+    GstZcmMultiFileSinkVolume* volume = &volumes[n_volumes++];
+    volume->location = g_strdup(split[i]);
+    volume->shard = -1;
+    gst_zcm_writer_pool_init(&volume->writers);
+  }
+  g_strfreev(split);
+
+  GST_OBJECT_LOCK (zcmmultifilesink);
+  GstZcmMultiFileSinkVolume* old = zcmmultifilesink->volumes;
+  guint n_old = zcmmultifilesink->n_volumes;
+  zcmmultifilesink->volumes = volumes;
+  zcmmultifilesink->n_volumes = n_volumes;
+  zcmmultifilesink->next_volume = 0;
+  GST_OBJECT_UNLOCK (zcmmultifilesink);
+  volumes_free(old, n_old);
+
+  GString* joined = g_string_new("");
+  for (guint i = 0; i < n_volumes; ++i) {
+    if (i > 0) g_string_append(joined, GST_ZCM_FRAME_INDEX_PATTERN_SEPARATOR);
+    g_string_append(joined, volumes[i].location);
+  }
+  return g_string_free(joined, FALSE);
 }
 
 static void
@@ -198,14 +1201,13 @@ destroy_zcm (GstZcmMultiFileSink* zcmmultifilesink)
 {
   if (!zcmmultifilesink->zcm) return;
 
-  zcm_stop(zcmmultifilesink->zcm);
-
   pthread_mutex_lock(&zcmmultifilesink->mutex);
   zcmmultifilesink->exit = true;
+  pthread_cond_signal(&zcmmultifilesink->pub_cond);
   pthread_mutex_unlock(&zcmmultifilesink->mutex);
   pthread_join(zcmmultifilesink->pub_thr, NULL);
 
-  zcm_destroy(zcmmultifilesink->zcm);
+  gst_zcm_transport_release(zcmmultifilesink->zcm);
   zcmmultifilesink->zcm = NULL;
 }
 
@@ -214,11 +1216,13 @@ init_zcm (GstZcmMultiFileSink* zcmmultifilesink)
 {
   destroy_zcm(zcmmultifilesink);
 
-  zcmmultifilesink->zcm = zcm_create(zcmmultifilesink->url->str);
-
-  zcm_start(zcmmultifilesink->zcm);
+  zcmmultifilesink->zcm = gst_zcm_transport_acquire(zcmmultifilesink->url->str);
+  if (!zcmmultifilesink->zcm) return;
 
   zcmmultifilesink->exit = false;
+  zcmmultifilesink->front = -1;
+  zcmmultifilesink->reading = -1;
+  zcmmultifilesink->channel_changed = true;
   pthread_create(&zcmmultifilesink->pub_thr, NULL, pub_thread, zcmmultifilesink);
 }
 
@@ -249,21 +1253,20 @@ gst_zcmmultifilesink_setcaps (GstBaseSink * bsink, GstCaps * caps)
   }
 
   GstVideoFormat pixelformat = GST_VIDEO_INFO_FORMAT(&info);
-  zcmmultifilesink->pixelformat = gst_video_format_to_fourcc (GST_VIDEO_INFO_FORMAT(&info));
+  zcmmultifilesink->pixelformat = gst_zcm_format_to_pixelformat (pixelformat);
   if (zcmmultifilesink->pixelformat == 0) {
-    switch (pixelformat) {
-      case GST_VIDEO_FORMAT_RGBA:
-        zcmmultifilesink->pixelformat = ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_RGBA;
-        break;
-      default:
-        break;
-    }
     GstStructure *s = gst_caps_get_structure(caps, 0);
     if (!strcmp("image/jpeg", gst_structure_get_name(s))) {
         zcmmultifilesink->pixelformat = ZCM_GSTREAMER_PLUGINS_IMAGE_T_PIXEL_FORMAT_MJPEG;
     }
   }
 
+  if (!gst_zcm_encode_supported(zcmmultifilesink->encoding, pixelformat)) {
+    GST_ERROR_OBJECT (zcmmultifilesink, "Cannot compress %s frames this way",
+        gst_video_format_to_string(pixelformat));
+    return FALSE;
+  }
+
   zcmmultifilesink->info = info;
 
   return TRUE;
@@ -286,6 +1289,11 @@ gst_zcm_multifilesink_class_init (GstZcmMultiFileSinkClass * klass)
       "ZeroCM Team <www.zcm-project.org>");
 
   gstbasesink_class->set_caps = gst_zcmmultifilesink_setcaps;
+  gstbasesink_class->start = GST_DEBUG_FUNCPTR (gst_zcm_multifilesink_start);
+  gstbasesink_class->stop = GST_DEBUG_FUNCPTR (gst_zcm_multifilesink_stop);
+  gstbasesink_class->unlock = GST_DEBUG_FUNCPTR (gst_zcm_multifilesink_unlock);
+  gstbasesink_class->unlock_stop = GST_DEBUG_FUNCPTR (gst_zcm_multifilesink_unlock_stop);
+  gstbasesink_class->event = GST_DEBUG_FUNCPTR (gst_zcm_multifilesink_event);
   gobject_class->set_property = gst_zcm_multifilesink_set_property;
   gobject_class->get_property = gst_zcm_multifilesink_get_property;
   gobject_class->dispose = gst_zcm_multifilesink_dispose;
@@ -307,23 +1315,253 @@ gst_zcm_multifilesink_class_init (GstZcmMultiFileSinkClass * klass)
               "Disk location to save files to",
               "", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_LOCATIONS,
+          g_param_spec_string ("locations", "File save locations",
+              "Disk locations to stripe files across, separated by ';'. Used "
+              "instead of location when set. Applied when the element starts",
+              "", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STRIPE_POLICY,
+          g_param_spec_enum ("stripe-policy", "Stripe policy",
+              "Which of locations each frame is written to",
+              GST_TYPE_ZCM_MULTIFILESINK_STRIPE_POLICY,
+              GST_ZCM_MULTIFILESINK_STRIPE_ROUND_ROBIN,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SHARD_LAYOUT,
+          g_param_spec_enum ("shard-layout", "Shard layout",
+              "How files are spread over subdirectories of location's directory",
+              GST_TYPE_ZCM_MULTIFILESINK_SHARD_LAYOUT, GST_ZCM_SHARD_NONE,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SHARD_SIZE,
+          g_param_spec_uint ("shard-size", "Shard size",
+              "Files per subdirectory with shard-layout=index",
+              1, G_MAXUINT, DEFAULT_SHARD_SIZE,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PREALLOCATE,
+          g_param_spec_boolean ("preallocate", "Preallocate files",
+              "Allocate each file in full before writing it with fallocate. "
+              "Segments are always preallocated, see segment-size",
+              FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_HUGEPAGES,
+          g_param_spec_boolean ("hugepages", "Huge pages",
+              "Stage frames for the direct and uring write backends in huge "
+              "page backed buffers, falling back to normal pages where there "
+              "are none",
+              FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SYNC_MODE,
+          g_param_spec_enum ("sync-mode", "Sync mode",
+              "When frames are made durable, photo_t is published after. "
+              "Applied when the element starts",
+              GST_TYPE_ZCM_MULTIFILESINK_SYNC_MODE, GST_ZCM_MULTIFILESINK_SYNC_NONE,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SYNC_FRAMES,
+          g_param_spec_uint ("sync-frames", "Sync frames",
+              "Frames synced together with sync-mode=group. Applied when the "
+              "element starts",
+              1, G_MAXUINT, DEFAULT_SYNC_FRAMES,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SYNC_INTERVAL_MS,
+          g_param_spec_uint ("sync-interval-ms", "Sync interval ms",
+              "Longest a written frame waits for its sync with "
+              "sync-mode=group. Applied when the element starts",
+              1, G_MAXUINT, DEFAULT_SYNC_INTERVAL_MS,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (gobject_class, PROP_PERIOD_US,
           g_param_spec_string ("period-us", "Publish period us",
               "Publish period of the zcm publish thread in microseconds",
               "100000", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_WRITER_THREADS,
+          g_param_spec_uint ("writer-threads", "Writer threads",
+              "Number of threads writing files to each location (0 to write on "
+              "the streaming thread). Applied when the element starts",
+              0, GST_ZCM_WRITER_POOL_MAX_THREADS, DEFAULT_WRITER_THREADS,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_SIZE,
+          g_param_spec_uint ("queue-size", "Write queue size",
+              "Maximum number of frames waiting to be written to each location. "
+              "Frames are held by reference, so upstream buffer pools must be "
+              "large enough",
+              1, G_MAXUINT, DEFAULT_QUEUE_SIZE,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_POLICY,
+          g_param_spec_enum ("queue-policy", "Write queue policy",
+              "What to do with a frame when the write queue is full",
+              GST_TYPE_ZCM_MULTIFILESINK_QUEUE_POLICY, GST_ZCM_WRITER_POOL_BLOCK,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_DEPTH,
+          g_param_spec_uint ("queue-depth", "Write queue depth",
+              "Number of frames queued or being encoded or written",
+              0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DROPPED_FRAMES,
+          g_param_spec_uint64 ("dropped-frames", "Dropped frames",
+              "Number of frames dropped by queue-policy",
+              0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_WRITE_LATENCY_US,
+          g_param_spec_uint64 ("write-latency-us", "Write latency us",
+              "Time taken by the last file write",
+              0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_WRITE_LATENCY_US,
+          g_param_spec_uint64 ("max-write-latency-us", "Max write latency us",
+              "Longest time taken by a file write since the element started",
+              0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_WRITE_BACKEND,
+          g_param_spec_enum ("write-backend", "Write backend",
+              "How files are written. Applied when the element starts",
+              GST_TYPE_ZCM_MULTIFILESINK_WRITE_BACKEND, GST_ZCM_WRITE_BACKEND_BUFFERED,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_URING_DEPTH,
+          g_param_spec_uint ("uring-depth", "io_uring depth",
+              "Maximum number of files in flight to each location with "
+              "write-backend=uring, each staged in its own frame sized buffer",
+              1, 4096, DEFAULT_URING_DEPTH,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_MODE,
+          g_param_spec_enum ("output-mode", "Output mode",
+              "Whether location names a file per frame or per segment",
+              GST_TYPE_ZCM_MULTIFILESINK_OUTPUT_MODE, GST_ZCM_MULTIFILESINK_OUTPUT_FILES,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SEGMENT_SIZE,
+          g_param_spec_uint64 ("segment-size", "Segment size",
+              "Bytes preallocated for each segment, a new segment is started "
+              "when the next frame would not fit",
+              1, G_MAXUINT64, DEFAULT_SEGMENT_SIZE,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SEGMENT_DURATION_MS,
+          g_param_spec_uint ("segment-duration-ms", "Segment duration ms",
+              "Start a new segment after this many milliseconds (0 for no "
+              "time limit)",
+              0, G_MAXUINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_INDEX_LOCATION,
+          g_param_spec_string ("index-location", "Frame index location",
+              "File recording every frame written, used to resume numbering "
+              "without scanning the output directory (empty for none)",
+              "", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_BYTES,
+          g_param_spec_uint64 ("max-bytes", "Max bytes",
+              "Delete the oldest files once more than this many bytes have "
+              "been written (0 for no limit)",
+              0, G_MAXUINT64, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_FILES,
+          g_param_spec_uint ("max-files", "Max files",
+              "Delete the oldest files once more than this many have been "
+              "written (0 for no limit)",
+              0, G_MAXUINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_AGE,
+          g_param_spec_uint ("max-age", "Max age",
+              "Delete files written more than this many seconds ago (0 for no "
+              "limit)",
+              0, G_MAXUINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_COMPRESSION,
+          g_param_spec_enum ("compression", "Compression",
+              "How frames are compressed before they are written. Applied when "
+              "the element starts",
+              GST_TYPE_ZCM_MULTIFILESINK_COMPRESSION, GST_ZCM_COMPRESSION_NONE,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_COMPRESSION_THREADS,
+          g_param_spec_uint ("compression-threads", "Compression threads",
+              "Number of threads compressing frames (0 for one per CPU core)",
+              0, GST_ZCM_WRITER_POOL_MAX_THREADS, 0,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_COMPRESSION_LEVEL,
+          g_param_spec_int ("compression-level", "Compression level",
+              "PNG (0-9) or zstd (1-22) compression level, -1 for the default",
+              -1, 22, -1, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_JPEG_QUALITY,
+          g_param_spec_int ("jpeg-quality", "JPEG quality",
+              "Quality of compression=jpeg",
+              1, 100, DEFAULT_JPEG_QUALITY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
 gst_zcm_multifilesink_init (GstZcmMultiFileSink * zcmmultifilesink)
 {
   zcmmultifilesink->url = g_string_new("");
-  zcmmultifilesink->photo = NULL;
   zcmmultifilesink->channel = g_string_new("GSTREAMER_DATA");
   zcmmultifilesink->zcm = NULL;
-  memset(&zcmmultifilesink->photo, 0, sizeof(zcmmultifilesink->photo));
+  memset(zcmmultifilesink->latest, 0, sizeof(zcmmultifilesink->latest));
+  zcmmultifilesink->front = -1;
+  zcmmultifilesink->reading = -1;
+  zcmmultifilesink->last_publish = 0;
+  zcmmultifilesink->channel_changed = true;
+  zcmmultifilesink->free_jobs = NULL;
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&zcmmultifilesink->pub_cond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&zcmmultifilesink->mutex, NULL);
+  pthread_mutex_init(&zcmmultifilesink->jobs_mutex, NULL);
+
   zcmmultifilesink->nwrites = 0;
   zcmmultifilesink->location = g_string_new("");
+  zcmmultifilesink->locations = g_string_new("");
+  zcmmultifilesink->stripe_policy = GST_ZCM_MULTIFILESINK_STRIPE_ROUND_ROBIN;
+  zcmmultifilesink->volumes = NULL;
+  zcmmultifilesink->n_volumes = 0;
+  zcmmultifilesink->next_volume = 0;
   zcmmultifilesink->period_us = 100 * 1000;
+  zcmmultifilesink->writer_threads = DEFAULT_WRITER_THREADS;
+  zcmmultifilesink->queue_size = DEFAULT_QUEUE_SIZE;
+  zcmmultifilesink->queue_policy = GST_ZCM_WRITER_POOL_BLOCK;
+  zcmmultifilesink->write_backend = GST_ZCM_WRITE_BACKEND_BUFFERED;
+  zcmmultifilesink->uring_depth = DEFAULT_URING_DEPTH;
+  zcmmultifilesink->backend = GST_ZCM_WRITE_BACKEND_BUFFERED;
+  zcmmultifilesink->output_mode = GST_ZCM_MULTIFILESINK_OUTPUT_FILES;
+  zcmmultifilesink->segment_size = DEFAULT_SEGMENT_SIZE;
+  zcmmultifilesink->segment_duration_ms = 0;
+  zcmmultifilesink->index_location = g_string_new("");
+  zcmmultifilesink->index = NULL;
+  zcmmultifilesink->max_bytes = 0;
+  zcmmultifilesink->max_files = 0;
+  zcmmultifilesink->max_age = 0;
+  zcmmultifilesink->compression = GST_ZCM_COMPRESSION_NONE;
+  zcmmultifilesink->compression_threads = 0;
+  zcmmultifilesink->compression_level = -1;
+  zcmmultifilesink->jpeg_quality = DEFAULT_JPEG_QUALITY;
+  zcmmultifilesink->shard_layout = GST_ZCM_SHARD_NONE;
+  zcmmultifilesink->shard_size = DEFAULT_SHARD_SIZE;
+  zcmmultifilesink->preallocate = FALSE;
+  zcmmultifilesink->hugepages = FALSE;
+  zcmmultifilesink->sync_mode = GST_ZCM_MULTIFILESINK_SYNC_NONE;
+  zcmmultifilesink->sync_frames = DEFAULT_SYNC_FRAMES;
+  zcmmultifilesink->sync_interval_ms = DEFAULT_SYNC_INTERVAL_MS;
+  zcmmultifilesink->syncing = GST_ZCM_MULTIFILESINK_SYNC_NONE;
+  zcmmultifilesink->encoding = GST_ZCM_COMPRESSION_NONE;
+  zcmmultifilesink->encoded_ret = GST_FLOW_OK;
+  gst_zcm_writer_pool_init(&zcmmultifilesink->encoders);
+  gst_zcm_sequencer_init(&zcmmultifilesink->encode_order, encoded_job, zcmmultifilesink);
+  gst_zcm_sequencer_init(&zcmmultifilesink->publish_order, publish_job, zcmmultifilesink);
+  gst_zcm_retention_init(&zcmmultifilesink->retention);
+  gst_zcm_commit_init(&zcmmultifilesink->commit);
 }
 
 void
@@ -342,20 +1580,95 @@ gst_zcm_multifilesink_set_property (GObject * object, guint property_id,
     case PROP_CHANNEL:
       pthread_mutex_lock(&zcmmultifilesink->mutex);
       g_string_assign (zcmmultifilesink->channel, g_value_get_string (value));
+      zcmmultifilesink->channel_changed = true;
       pthread_mutex_unlock(&zcmmultifilesink->mutex);
       break;
     case PROP_LOCATION:
       g_string_assign (zcmmultifilesink->location, g_value_get_string (value));
-      assert(strlen(zcmmultifilesink->location->str) < 1024 && "location length exceeded");
-      updateStartFilepath(zcmmultifilesink);
+      break;
+    case PROP_LOCATIONS:
+      g_string_assign (zcmmultifilesink->locations, g_value_get_string (value));
+      break;
+    case PROP_STRIPE_POLICY:
+      zcmmultifilesink->stripe_policy = g_value_get_enum (value);
+      break;
+    case PROP_SHARD_LAYOUT:
+      zcmmultifilesink->shard_layout = g_value_get_enum (value);
+      break;
+    case PROP_SHARD_SIZE:
+      zcmmultifilesink->shard_size = g_value_get_uint (value);
+      break;
+    case PROP_PREALLOCATE:
+      zcmmultifilesink->preallocate = g_value_get_boolean (value);
+      break;
+    case PROP_HUGEPAGES:
+      zcmmultifilesink->hugepages = g_value_get_boolean (value);
+      break;
+    case PROP_SYNC_MODE:
+      zcmmultifilesink->sync_mode = g_value_get_enum (value);
+      break;
+    case PROP_SYNC_FRAMES:
+      zcmmultifilesink->sync_frames = g_value_get_uint (value);
+      break;
+    case PROP_SYNC_INTERVAL_MS:
+      zcmmultifilesink->sync_interval_ms = g_value_get_uint (value);
       break;
     case PROP_PERIOD_US:
       pthread_mutex_lock(&zcmmultifilesink->mutex);
       gulong tmp = atol(g_value_get_string(value));
       if (tmp) zcmmultifilesink->period_us = tmp;
       else GST_ERROR_OBJECT (zcmmultifilesink, "Input period-us is invalid");
+      pthread_cond_signal(&zcmmultifilesink->pub_cond);
       pthread_mutex_unlock(&zcmmultifilesink->mutex);
       break;
+    case PROP_WRITER_THREADS:
+      zcmmultifilesink->writer_threads = g_value_get_uint (value);
+      break;
+    case PROP_QUEUE_SIZE:
+      zcmmultifilesink->queue_size = g_value_get_uint (value);
+      break;
+    case PROP_QUEUE_POLICY:
+      zcmmultifilesink->queue_policy = g_value_get_enum (value);
+      break;
+    case PROP_WRITE_BACKEND:
+      zcmmultifilesink->write_backend = g_value_get_enum (value);
+      break;
+    case PROP_URING_DEPTH:
+      zcmmultifilesink->uring_depth = g_value_get_uint (value);
+      break;
+    case PROP_OUTPUT_MODE:
+      zcmmultifilesink->output_mode = g_value_get_enum (value);
+      break;
+    case PROP_SEGMENT_SIZE:
+      zcmmultifilesink->segment_size = g_value_get_uint64 (value);
+      break;
+    case PROP_SEGMENT_DURATION_MS:
+      zcmmultifilesink->segment_duration_ms = g_value_get_uint (value);
+      break;
+    case PROP_INDEX_LOCATION:
+      g_string_assign (zcmmultifilesink->index_location, g_value_get_string (value));
+      break;
+    case PROP_MAX_BYTES:
+      zcmmultifilesink->max_bytes = g_value_get_uint64 (value);
+      break;
+    case PROP_MAX_FILES:
+      zcmmultifilesink->max_files = g_value_get_uint (value);
+      break;
+    case PROP_MAX_AGE:
+      zcmmultifilesink->max_age = g_value_get_uint (value);
+      break;
+    case PROP_COMPRESSION:
+      zcmmultifilesink->compression = g_value_get_enum (value);
+      break;
+    case PROP_COMPRESSION_THREADS:
+      zcmmultifilesink->compression_threads = g_value_get_uint (value);
+      break;
+    case PROP_COMPRESSION_LEVEL:
+      zcmmultifilesink->compression_level = g_value_get_int (value);
+      break;
+    case PROP_JPEG_QUALITY:
+      zcmmultifilesink->jpeg_quality = g_value_get_int (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -382,6 +1695,33 @@ gst_zcm_multifilesink_get_property (GObject * object, guint property_id,
     case PROP_LOCATION:
       g_value_set_string (value, zcmmultifilesink->location->str);
       break;
+    case PROP_LOCATIONS:
+      g_value_set_string (value, zcmmultifilesink->locations->str);
+      break;
+    case PROP_STRIPE_POLICY:
+      g_value_set_enum (value, zcmmultifilesink->stripe_policy);
+      break;
+    case PROP_SHARD_LAYOUT:
+      g_value_set_enum (value, zcmmultifilesink->shard_layout);
+      break;
+    case PROP_SHARD_SIZE:
+      g_value_set_uint (value, zcmmultifilesink->shard_size);
+      break;
+    case PROP_PREALLOCATE:
+      g_value_set_boolean (value, zcmmultifilesink->preallocate);
+      break;
+    case PROP_HUGEPAGES:
+      g_value_set_boolean (value, zcmmultifilesink->hugepages);
+      break;
+    case PROP_SYNC_MODE:
+      g_value_set_enum (value, zcmmultifilesink->sync_mode);
+      break;
+    case PROP_SYNC_FRAMES:
+      g_value_set_uint (value, zcmmultifilesink->sync_frames);
+      break;
+    case PROP_SYNC_INTERVAL_MS:
+      g_value_set_uint (value, zcmmultifilesink->sync_interval_ms);
+      break;
     case PROP_PERIOD_US:
       pthread_mutex_lock(&zcmmultifilesink->mutex);
       char str[128];
@@ -389,6 +1729,81 @@ gst_zcm_multifilesink_get_property (GObject * object, guint property_id,
       g_value_set_string (value, str);
       pthread_mutex_unlock(&zcmmultifilesink->mutex);
       break;
+    case PROP_WRITER_THREADS:
+      g_value_set_uint (value, zcmmultifilesink->writer_threads);
+      break;
+    case PROP_QUEUE_SIZE:
+      g_value_set_uint (value, zcmmultifilesink->queue_size);
+      break;
+    case PROP_QUEUE_POLICY:
+      g_value_set_enum (value, zcmmultifilesink->queue_policy);
+      break;
+    case PROP_WRITE_BACKEND:
+      g_value_set_enum (value, zcmmultifilesink->write_backend);
+      break;
+    case PROP_URING_DEPTH:
+      g_value_set_uint (value, zcmmultifilesink->uring_depth);
+      break;
+    case PROP_OUTPUT_MODE:
+      g_value_set_enum (value, zcmmultifilesink->output_mode);
+      break;
+    case PROP_SEGMENT_SIZE:
+      g_value_set_uint64 (value, zcmmultifilesink->segment_size);
+      break;
+    case PROP_SEGMENT_DURATION_MS:
+      g_value_set_uint (value, zcmmultifilesink->segment_duration_ms);
+      break;
+    case PROP_INDEX_LOCATION:
+      g_value_set_string (value, zcmmultifilesink->index_location->str);
+      break;
+    case PROP_MAX_BYTES:
+      g_value_set_uint64 (value, zcmmultifilesink->max_bytes);
+      break;
+    case PROP_MAX_FILES:
+      g_value_set_uint (value, zcmmultifilesink->max_files);
+      break;
+    case PROP_MAX_AGE:
+      g_value_set_uint (value, zcmmultifilesink->max_age);
+      break;
+    case PROP_COMPRESSION:
+      g_value_set_enum (value, zcmmultifilesink->compression);
+      break;
+    case PROP_COMPRESSION_THREADS:
+      g_value_set_uint (value, zcmmultifilesink->compression_threads);
+      break;
+    case PROP_COMPRESSION_LEVEL:
+      g_value_set_int (value, zcmmultifilesink->compression_level);
+      break;
+    case PROP_JPEG_QUALITY:
+      g_value_set_int (value, zcmmultifilesink->jpeg_quality);
+      break;
+    case PROP_QUEUE_DEPTH:
+    case PROP_DROPPED_FRAMES:
+    case PROP_WRITE_LATENCY_US:
+    case PROP_MAX_WRITE_LATENCY_US: {
+      GstZcmWriterPoolStats stats, encoder_stats;
+      memset(&stats, 0, sizeof(stats));
+      GST_OBJECT_LOCK (zcmmultifilesink);
+      for (guint i = 0; i < zcmmultifilesink->n_volumes; ++i) {
+        GstZcmWriterPoolStats volume_stats;
+        gst_zcm_writer_pool_get_stats(&zcmmultifilesink->volumes[i].writers, &volume_stats);
+        stats.depth += volume_stats.depth;
+        stats.dropped += volume_stats.dropped;
+        stats.last_latency_us = MAX(stats.last_latency_us, volume_stats.last_latency_us);
+        stats.max_latency_us = MAX(stats.max_latency_us, volume_stats.max_latency_us);
+      }
+      GST_OBJECT_UNLOCK (zcmmultifilesink);
+      gst_zcm_writer_pool_get_stats(&zcmmultifilesink->encoders, &encoder_stats);
+      if (property_id == PROP_QUEUE_DEPTH)
+        g_value_set_uint (value, stats.depth + encoder_stats.depth);
+      else if (property_id == PROP_DROPPED_FRAMES)
+        g_value_set_uint64 (value, stats.dropped + encoder_stats.dropped);
+      else if (property_id == PROP_WRITE_LATENCY_US)
+        g_value_set_uint64 (value, stats.last_latency_us);
+      else
+        g_value_set_uint64 (value, stats.max_latency_us);
+      break;
+    }
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -416,130 +1831,254 @@ gst_zcm_multifilesink_finalize (GObject * object)
 
   /* clean up object here */
 
+  gst_zcm_writer_pool_clear(&zcmmultifilesink->encoders);
+  volumes_free(zcmmultifilesink->volumes, zcmmultifilesink->n_volumes);
+  gst_zcm_sequencer_clear(&zcmmultifilesink->encode_order);
+  gst_zcm_sequencer_clear(&zcmmultifilesink->publish_order);
+  gst_zcm_retention_clear(&zcmmultifilesink->retention);
+  gst_zcm_commit_clear(&zcmmultifilesink->commit);
   destroy_zcm(zcmmultifilesink);
 
+  while (zcmmultifilesink->free_jobs) {
+    GstZcmMultiFileSinkJob* job = zcmmultifilesink->free_jobs;
+    zcmmultifilesink->free_jobs = job->next;
+    g_free(job->filepath);
+    free(job->encoded);
+    g_slice_free(GstZcmMultiFileSinkJob, job);
+  }
+  g_free(zcmmultifilesink->latest[0].filepath);
+  g_free(zcmmultifilesink->latest[1].filepath);
+  pthread_mutex_destroy(&zcmmultifilesink->jobs_mutex);
+  pthread_mutex_destroy(&zcmmultifilesink->mutex);
+  pthread_cond_destroy(&zcmmultifilesink->pub_cond);
+  g_string_free(zcmmultifilesink->index_location, true);
+  g_string_free(zcmmultifilesink->locations, true);
+
   G_OBJECT_CLASS (gst_zcm_multifilesink_parent_class)->finalize (object);
 }
 
-static GstFlowReturn
-gst_zcm_multifilesink_show_frame (GstVideoSink * sink, GstBuffer * buf)
+static gboolean
+gst_zcm_multifilesink_start (GstBaseSink * sink)
 {
   GstZcmMultiFileSink *zcmmultifilesink = GST_ZCM_MULTIFILESINK (sink);
 
-  zcm_gstreamer_plugins_photo_t photo;
+  GST_DEBUG_OBJECT (zcmmultifilesink, "start");
+
+  char* patterns = volumes_new(zcmmultifilesink);
+
+  gint64 next_file = -1;
+  if (zcmmultifilesink->index_location->str[0] != '\0') {
+    zcmmultifilesink->index = gst_zcm_frame_index_open(
+        zcmmultifilesink->index_location->str, patterns,
+        zcmmultifilesink->shard_layout, zcmmultifilesink->shard_size,
+        &next_file);
+    if (!zcmmultifilesink->index) {
+      GST_ERROR_OBJECT (zcmmultifilesink, "Failed to open frame index %s: %s",
+          zcmmultifilesink->index_location->str, g_strerror(errno));
+      g_free(patterns);
+      return FALSE;
+    }
+  }
+  if (next_file >= 0) {
+    zcmmultifilesink->nwrites = next_file;
+  } else {
+    // No index, or a new or reset one: only the files on disk tell where the
+    // last run stopped, and starting over at 0 would truncate them
+    for (guint i = 0; i < zcmmultifilesink->n_volumes; ++i) {
+      // Numbers only grow, so with sharding the newest shard has the highest
+      const char* location = zcmmultifilesink->volumes[i].location;
+      char* latest = gst_zcm_shard_latest_pattern(location, zcmmultifilesink->shard_layout);
+      updateStartFilepath(zcmmultifilesink, latest ? latest : location);
+      g_free(latest);
+    }
+  }
+  g_free(patterns);
+
+  if (zcmmultifilesink->max_bytes > 0 || zcmmultifilesink->max_files > 0 ||
+      zcmmultifilesink->max_age > 0) {
+    gst_zcm_retention_start(&zcmmultifilesink->retention,
+        zcmmultifilesink->max_bytes, zcmmultifilesink->max_files,
+        zcmmultifilesink->max_age, retention_removed, zcmmultifilesink);
+    if (zcmmultifilesink->index) retention_load_index(zcmmultifilesink);
+  }
 
-  GST_DEBUG_OBJECT (zcmmultifilesink, "show_frame");
+  zcmmultifilesink->backend = zcmmultifilesink->write_backend;
+  for (guint i = 0; i < zcmmultifilesink->n_volumes &&
+       zcmmultifilesink->backend == GST_ZCM_WRITE_BACKEND_URING; ++i) {
+    GstZcmMultiFileSinkVolume* volume = &zcmmultifilesink->volumes[i];
+    volume->uring = gst_zcm_uring_writer_new(zcmmultifilesink->uring_depth,
+        uring_done, volume);
+    if (!volume->uring) {
+      GST_WARNING_OBJECT (zcmmultifilesink,
+          "io_uring is not available, falling back to write-backend=direct");
+      zcmmultifilesink->backend = GST_ZCM_WRITE_BACKEND_DIRECT;
+      for (guint j = 0; j < i; ++j) {
+        gst_zcm_uring_writer_free(zcmmultifilesink->volumes[j].uring);
+        zcmmultifilesink->volumes[j].uring = NULL;
+      }
+    }
+  }
 
-  if (zcmmultifilesink->location->str[0] == '\0') return GST_FLOW_ERROR;
+  gst_zcm_sequencer_reset(&zcmmultifilesink->encode_order);
+  gst_zcm_sequencer_reset(&zcmmultifilesink->publish_order);
+  zcmmultifilesink->encoded_ret = GST_FLOW_OK;
 
-  if (!zcmmultifilesink->zcm) init_zcm(zcmmultifilesink);
-
-  if (gst_buffer_n_memory (buf) != 1) {
-    GST_ERROR_OBJECT (zcmmultifilesink, "Support only 1 memory per buffer");
-    return GST_FLOW_ERROR;
+  zcmmultifilesink->syncing = zcmmultifilesink->sync_mode;
+  if (zcmmultifilesink->syncing == GST_ZCM_MULTIFILESINK_SYNC_GROUP) {
+    gst_zcm_commit_start(&zcmmultifilesink->commit, zcmmultifilesink->sync_frames,
+        zcmmultifilesink->sync_interval_ms, commit_sync, commit_done,
+        zcmmultifilesink);
   }
 
-  if (!zcmmultifilesink->zcm) return GST_FLOW_ERROR;
-
-  GstVideoFrame src;
-  if (!gst_video_frame_map (&src, &zcmmultifilesink->info, buf, GST_MAP_READ)) {
-    GST_WARNING_OBJECT (zcmmultifilesink, "could not map image");
-    return GST_FLOW_OK;
+  for (guint i = 0; i < zcmmultifilesink->n_volumes &&
+       zcmmultifilesink->writer_threads > 0; ++i) {
+    GstZcmMultiFileSinkVolume* volume = &zcmmultifilesink->volumes[i];
+    gst_zcm_writer_pool_start(&volume->writers,
+        zcmmultifilesink->writer_threads, zcmmultifilesink->queue_size,
+        zcmmultifilesink->queue_policy, write_job,
+        volume->uring ? uring_flush : NULL, drop_job, volume);
   }
 
-  GstMapInfo info;
-  if (!gst_buffer_map (buf, &info, GST_MAP_READ)) {
-    GST_WARNING_OBJECT (zcmmultifilesink, "could not map buffer info");
-    gst_video_frame_unmap (&src);
-    return GST_FLOW_OK;
+  zcmmultifilesink->encoding = zcmmultifilesink->compression;
+  if (zcmmultifilesink->encoding != GST_ZCM_COMPRESSION_NONE) {
+    guint threads = zcmmultifilesink->compression_threads;
+    if (threads == 0) threads = g_get_num_processors();
+    gst_zcm_writer_pool_start(&zcmmultifilesink->encoders, threads,
+        zcmmultifilesink->queue_size, zcmmultifilesink->queue_policy, encode_job,
+        NULL, drop_encode, zcmmultifilesink);
   }
 
+  return TRUE;
+}
 
-  // write file
-  char file_location_buf[1024];
-  snprintf(file_location_buf, 1024, zcmmultifilesink->location->str, zcmmultifilesink->nwrites);
+static gboolean
+gst_zcm_multifilesink_stop (GstBaseSink * sink)
+{
+  GstZcmMultiFileSink *zcmmultifilesink = GST_ZCM_MULTIFILESINK (sink);
 
-  FILE *fp;
-  fp = fopen(file_location_buf, "w");
-  if (fp <= 0) {
-    perror("Failed to write file");
-  } else {
-      int ret = fwrite(info.data, 1, info.size, fp);
-      if (ret < 0) {
-        fprintf(stderr, "Failed to write file: %s\n", file_location_buf);
-      } else {
-        zcmmultifilesink->nwrites++;
+  GST_DEBUG_OBJECT (zcmmultifilesink, "stop");
+
+  // Encoders finish into the writers, which finish into io_uring, which
+  // finishes into the group commit
+  gst_zcm_writer_pool_stop(&zcmmultifilesink->encoders);
+  for (guint i = 0; i < zcmmultifilesink->n_volumes; ++i) {
+    GstZcmMultiFileSinkVolume* volume = &zcmmultifilesink->volumes[i];
+    gst_zcm_writer_pool_stop(&volume->writers);
+    gst_zcm_uring_writer_free(volume->uring);
+    volume->uring = NULL;
+    gst_zcm_segment_unref(volume->segment);
+    volume->segment = NULL;
+    g_free(volume->rolled_path);
+    volume->rolled_path = NULL;
+  }
+  gst_zcm_commit_stop(&zcmmultifilesink->commit);
+  gst_zcm_retention_stop(&zcmmultifilesink->retention);
+  gst_zcm_frame_index_close(zcmmultifilesink->index);
+  zcmmultifilesink->index = NULL;
 
-        photo.width = zcmmultifilesink->info.width;
-        photo.height = zcmmultifilesink->info.height;
+  return TRUE;
+}
 
-        photo.pixelformat = zcmmultifilesink->pixelformat;
+static gboolean
+gst_zcm_multifilesink_unlock (GstBaseSink * sink)
+{
+  GstZcmMultiFileSink *zcmmultifilesink = GST_ZCM_MULTIFILESINK (sink);
+  gst_zcm_writer_pool_set_flushing(&zcmmultifilesink->encoders, TRUE);
+  for (guint i = 0; i < zcmmultifilesink->n_volumes; ++i)
+    gst_zcm_writer_pool_set_flushing(&zcmmultifilesink->volumes[i].writers, TRUE);
+  return TRUE;
+}
 
-        gint num_strides = GST_VIDEO_FRAME_N_PLANES (&src);
-        photo.stride = malloc (sizeof(int32_t) * num_strides);
-        photo.num_strides = num_strides;
+static gboolean
+gst_zcm_multifilesink_unlock_stop (GstBaseSink * sink)
+{
+  GstZcmMultiFileSink *zcmmultifilesink = GST_ZCM_MULTIFILESINK (sink);
+  gst_zcm_writer_pool_set_flushing(&zcmmultifilesink->encoders, FALSE);
+  for (guint i = 0; i < zcmmultifilesink->n_volumes; ++i)
+    gst_zcm_writer_pool_set_flushing(&zcmmultifilesink->volumes[i].writers, FALSE);
+  return TRUE;
+}
 
-        for (size_t i = 0; i < num_strides; ++i) {
-          photo.stride[i] = GST_VIDEO_FRAME_PLANE_STRIDE (&src, i);
-        }
+static gboolean
+gst_zcm_multifilesink_event (GstBaseSink * sink, GstEvent * event)
+{
+  GstZcmMultiFileSink *zcmmultifilesink = GST_ZCM_MULTIFILESINK (sink);
 
-        photo.data_size = info.size;
+  // Everything received before EOS is on disk by the time EOS is posted
+  if (GST_EVENT_TYPE (event) == GST_EVENT_EOS) {
+    gst_zcm_writer_pool_drain(&zcmmultifilesink->encoders);
+    for (guint i = 0; i < zcmmultifilesink->n_volumes; ++i) {
+      GstZcmMultiFileSinkVolume* volume = &zcmmultifilesink->volumes[i];
+      gst_zcm_writer_pool_drain(&volume->writers);
+      if (volume->uring) gst_zcm_uring_writer_drain(volume->uring);
+    }
+    gst_zcm_commit_drain(&zcmmultifilesink->commit);
+  }
 
-        photo.filepath = file_location_buf;
+  return GST_BASE_SINK_CLASS (gst_zcm_multifilesink_parent_class)->event (sink, event);
+}
 
-        GstElement *gstElement = GST_ELEMENT (sink);
-        GstClockTime baseTime = gst_element_get_base_time (gstElement);
-        if (GST_BUFFER_DTS_IS_VALID(buf)) {
-          photo.pic_utime = (baseTime + GST_BUFFER_DTS(buf)) / 1e3;
-        } else {
-          photo.pic_utime = 0;
-        }
+static GstFlowReturn
+gst_zcm_multifilesink_show_frame (GstVideoSink * sink, GstBuffer * buf)
+{
+  GstZcmMultiFileSink *zcmmultifilesink = GST_ZCM_MULTIFILESINK (sink);
 
-        photo.utime = utime();
+  GST_DEBUG_OBJECT (zcmmultifilesink, "show_frame");
 
-        pthread_mutex_lock(&zcmmultifilesink->mutex);
+  if (zcmmultifilesink->n_volumes == 0) return GST_FLOW_ERROR;
 
-            zcm_gstreamer_plugins_photo_t_publish(zcmmultifilesink->zcm, zcmmultifilesink->channel->str, &photo);
+  if (!zcmmultifilesink->zcm) init_zcm(zcmmultifilesink);
 
-            if (zcmmultifilesink->photo) {
-                zcm_gstreamer_plugins_photo_t_destroy(zcmmultifilesink->photo);
-            }
-            zcmmultifilesink->photo = zcm_gstreamer_plugins_photo_t_copy(&photo);
+  if (gst_buffer_n_memory (buf) != 1) {
+    GST_ERROR_OBJECT (zcmmultifilesink, "Support only 1 memory per buffer");
+    return GST_FLOW_ERROR;
+  }
 
-        pthread_mutex_unlock(&zcmmultifilesink->mutex);
+  if (!zcmmultifilesink->zcm) return GST_FLOW_ERROR;
 
-        free(photo.stride);
-      }
+  GstZcmMultiFileSinkJob* job = job_new(zcmmultifilesink);
+  job->buf = gst_buffer_ref(buf);
+
+  zcm_gstreamer_plugins_photo_t* photo = &job->photo;
+  photo->width = zcmmultifilesink->info.width;
+  photo->height = zcmmultifilesink->info.height;
+  photo->pixelformat = zcmmultifilesink->pixelformat;
+  photo->compression = zcmmultifilesink->encoding;
+
+  // Strides as gst_video_frame_map would report them, without mapping here
+  GstVideoMeta* meta = gst_buffer_get_video_meta (buf);
+  photo->num_strides = meta ? meta->n_planes : GST_VIDEO_INFO_N_PLANES (&zcmmultifilesink->info);
+  photo->stride = job->stride;
+  for (size_t i = 0; i < photo->num_strides; ++i) {
+    photo->stride[i] = meta ? meta->stride[i] :
+                       GST_VIDEO_INFO_PLANE_STRIDE (&zcmmultifilesink->info, i);
   }
 
-  gst_buffer_unmap (buf, &info);
-  gst_video_frame_unmap (&src);
-
-  return GST_FLOW_OK;
-}
+  GstElement *gstElement = GST_ELEMENT (sink);
+  GstClockTime baseTime = gst_element_get_base_time (gstElement);
+  if (GST_BUFFER_DTS_IS_VALID(buf)) {
+    photo->pic_utime = (baseTime + GST_BUFFER_DTS(buf)) / 1e3;
+  } else {
+    photo->pic_utime = 0;
+  }
 
-static gboolean
-plugin_init (GstPlugin * plugin)
-{
-  return gst_element_register (plugin, "zcmmultifilesink", GST_RANK_NONE,
-      GST_TYPE_ZCM_MULTIFILESINK);
-}
+  if (zcmmultifilesink->encoding != GST_ZCM_COMPRESSION_NONE) {
+    // Frames that failed to encode, be placed or be queued since the last
+    // call are reported here
+    GstFlowReturn encoded_ret = g_atomic_int_get(&zcmmultifilesink->encoded_ret);
+    if (encoded_ret != GST_FLOW_OK) {
+      job_free(job);
+      return encoded_ret;
+    }
+    // Placed and written by encoded_job once it is this frame's turn
+    job->encode_seq = gst_zcm_sequencer_take(&zcmmultifilesink->encode_order);
+    return gst_zcm_writer_pool_push(&zcmmultifilesink->encoders, job);
+  }
 
-#ifndef VERSION
-#define VERSION "1.0.0"
-#endif
-#ifndef PACKAGE
-#define PACKAGE "ZeroCM"
-#endif
-#ifndef PACKAGE_NAME
-#define PACKAGE_NAME "zcm-gstreamer-plugins"
-#endif
-#ifndef GST_PACKAGE_ORIGIN
-#define GST_PACKAGE_ORIGIN "https://github.com/ZeroCM/zcm-gstreamer-plugins"
-#endif
+  if (!place_job(zcmmultifilesink, job, gst_buffer_get_size (buf))) {
+    job_free(job);
+    return GST_FLOW_ERROR;
+  }
 
-GST_PLUGIN_DEFINE (GST_VERSION_MAJOR,
-    GST_VERSION_MINOR,
-    zcmmultifilesink,
-    "Sinks data to files and publishes a zcm message for each write",
-    plugin_init, VERSION, "LGPL", PACKAGE_NAME, GST_PACKAGE_ORIGIN)
+  return submit_job(zcmmultifilesink, job);
+}
@@ -29,6 +29,16 @@
 #include <zcm/zcm.h>
 #include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_photo_t.h"
 
+#include "gstzcmcommit.h"
+#include "gstzcmdirectio.h"
+#include "gstzcmencode.h"
+#include "gstzcmframeindex.h"
+#include "gstzcmretention.h"
+#include "gstzcmsegment.h"
+#include "gstzcmsequencer.h"
+#include "gstzcmshard.h"
+#include "gstzcmwriterpool.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_ZCM_MULTIFILESINK   (gst_zcm_multifilesink_get_type())
@@ -40,6 +50,54 @@ G_BEGIN_DECLS
 typedef struct _GstZcmMultiFileSink GstZcmMultiFileSink;
 typedef struct _GstZcmMultiFileSinkClass GstZcmMultiFileSinkClass;
 
+/* A copy of the last photo_t published, with storage for its variable
+ * length fields */
+typedef struct
+{
+  zcm_gstreamer_plugins_photo_t photo;
+  int32_t stride[GST_VIDEO_MAX_PLANES];
+  char* filepath;
+  gsize filepath_size;
+} GstZcmMultiFileSinkPhoto;
+
+typedef enum
+{
+  GST_ZCM_MULTIFILESINK_OUTPUT_FILES,
+  GST_ZCM_MULTIFILESINK_OUTPUT_SEGMENTS,
+} GstZcmMultiFileSinkOutputMode;
+
+typedef enum
+{
+  GST_ZCM_MULTIFILESINK_STRIPE_ROUND_ROBIN,
+  GST_ZCM_MULTIFILESINK_STRIPE_SHORTEST_QUEUE,
+} GstZcmMultiFileSinkStripePolicy;
+
+typedef enum
+{
+  GST_ZCM_MULTIFILESINK_SYNC_NONE,
+  GST_ZCM_MULTIFILESINK_SYNC_FRAME,
+  GST_ZCM_MULTIFILESINK_SYNC_GROUP,
+} GstZcmMultiFileSinkSyncMode;
+
+/* One of the locations frames are striped across, with writers of its own so
+ * a slow disk only backs up its own queue */
+typedef struct
+{
+  char* location;
+  GstZcmWriterPool writers;
+  GstZcmUringWriter* uring;
+  GstZcmSegment* segment;
+  gint64 segment_file;   // number location was formatted with for segment
+  gint32 segment_shard;
+  char* rolled_path;     // segment retention may delete once the next frame
+                         // placed on the volume is published, see place_job
+  gint64 shard;          // of pattern, -1 before the first file
+  char* pattern;         // location in the current shard's directory
+  // Only touched by the commit thread, see commit_sync
+  GstZcmSegment* synced_segment;
+  const char* sync_path;
+} GstZcmMultiFileSinkVolume;
+
 struct _GstZcmMultiFileSink
 {
   GstVideoSink base_zcmmultifilesink;
@@ -47,19 +105,69 @@ struct _GstZcmMultiFileSink
   // Privates
   zcm_t* zcm;
   GstVideoInfo info;
-  zcm_gstreamer_plugins_photo_t* photo;
   int64_t nwrites;
   int32_t pixelformat;
 
   pthread_t pub_thr;
   pthread_mutex_t mutex;
+  pthread_cond_t pub_cond;
   bool exit;
+  bool channel_changed;
+  // Double buffered so pub_thread can publish one copy outside the mutex
+  GstZcmMultiFileSinkPhoto latest[2];
+  gint front;          // latest copy, -1 before the first frame
+  gint reading;        // copy pub_thread is publishing, or -1
+  gint64 last_publish;
+
+  pthread_mutex_t jobs_mutex;
+  gpointer free_jobs;
+
+  // Replaced on start, kept after stop so their stats stay readable. Swapped
+  // under the object lock.
+  GstZcmMultiFileSinkVolume* volumes;
+  guint n_volumes;
+  guint next_volume;
+  GstZcmWriterPool encoders;
+  GstZcmSequencer encode_order;
+  GstZcmSequencer publish_order;
+  GstZcmCompression encoding;
+  gint encoded_ret;  // GstFlowReturn of the encoder side, see encoded_job()
+  GstZcmWriteBackend backend;
+  GstZcmFrameIndex* index;
+  GstZcmRetention retention;
+  GstZcmMultiFileSinkSyncMode syncing;
+  GstZcmCommit commit;
 
   // Properties
   GString* url;
   GString* channel;
   GString* location;
+  GString* locations;
+  GstZcmMultiFileSinkStripePolicy stripe_policy;
   gulong   period_us;
+  guint    writer_threads;
+  guint    queue_size;
+  GstZcmWriterPoolPolicy queue_policy;
+  GstZcmWriteBackend write_backend;
+  guint    uring_depth;
+  GstZcmMultiFileSinkOutputMode output_mode;
+  guint64  segment_size;
+  guint    segment_duration_ms;
+  GString* index_location;
+  guint64  max_bytes;
+  guint    max_files;
+  guint    max_age;
+  GstZcmCompression compression;
+  guint    compression_threads;
+  gint     compression_level;
+  gint     jpeg_quality;
+  GstZcmShardLayout shard_layout;
+  guint    shard_size;
+  gboolean preallocate;
+  gboolean hugepages;
+  GstZcmMultiFileSinkSyncMode sync_mode;
+  guint    sync_frames;
+  guint    sync_interval_ms;
 };
 
 struct _GstZcmMultiFileSinkClass
@@ -0,0 +1,234 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include "gstzcmretention.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+// Not exported by glibc, see ioprio_set(2)
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+static void
+file_free (GstZcmRetentionFile * file)
+{
+  g_free(file->path);
+  g_slice_free(GstZcmRetentionFile, file);
+}
+
+/* Returns the oldest file that is not open if it has to go, or NULL. Called
+ * with the mutex held. */
+static GList*
+over_budget (GstZcmRetention * retention, gint64 now)
+{
+  // Every volume has a segment open, they are among the newest files
+  GList* link = retention->files.head;
+  while (link && ((GstZcmRetentionFile*) link->data)->open) link = link->next;
+  if (!link) return NULL;
+
+  GstZcmRetentionFile* oldest = link->data;
+  if ((retention->max_bytes > 0 && retention->bytes > retention->max_bytes) ||
+      (retention->max_files > 0 && retention->files.length > retention->max_files) ||
+      (retention->max_age_us > 0 && now - oldest->utime > retention->max_age_us)) {
+    return link;
+  }
+  return NULL;
+}
+
+static void*
+deletion_thread (void* usr)
+{
+  GstZcmRetention* retention = (GstZcmRetention*) usr;
+
+  // Deleting is never urgent, keep out of the way of the writers
+  pid_t tid = syscall(SYS_gettid);
+  setpriority(PRIO_PROCESS, tid, 19);
+  syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid,
+          IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+
+  GstZcmRetentionFile* batch[GST_ZCM_RETENTION_BATCH];
+
+  pthread_mutex_lock(&retention->mutex);
+  while (!retention->exit) {
+    guint n = 0;
+    gint64 now = g_get_real_time();
+    GList* link;
+    while (n < GST_ZCM_RETENTION_BATCH && (link = over_budget(retention, now))) {
+      batch[n] = link->data;
+      g_queue_delete_link(&retention->files, link);
+      g_hash_table_remove(retention->paths, batch[n]->path);
+      retention->bytes -= batch[n]->size;
+      n++;
+    }
+
+    if (n == 0) {
+      if (retention->max_age_us > 0) {
+        // Files age without anything being added, check again in a second
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        pthread_cond_timedwait(&retention->cond, &retention->mutex, &deadline);
+      } else {
+        pthread_cond_wait(&retention->cond, &retention->mutex);
+      }
+      continue;
+    }
+
+    pthread_mutex_unlock(&retention->mutex);
+
+    guint64 deleted_files = 0, deleted_bytes = 0;
+    for (guint i = 0; i < n; ++i) {
+      if (unlink(batch[i]->path) == 0 || errno == ENOENT) {
+        deleted_files++;
+        deleted_bytes += batch[i]->size;
+        if (retention->removed) retention->removed(batch[i], retention->user_data);
+      }
+      file_free(batch[i]);
+    }
+
+    pthread_mutex_lock(&retention->mutex);
+    retention->deleted_files += deleted_files;
+    retention->deleted_bytes += deleted_bytes;
+  }
+  pthread_mutex_unlock(&retention->mutex);
+
+  return NULL;
+}
+
+void
+gst_zcm_retention_init (GstZcmRetention * retention)
+{
+  memset(retention, 0, sizeof(*retention));
+
+  pthread_mutex_init(&retention->mutex, NULL);
+  pthread_cond_init(&retention->cond, NULL);
+  g_queue_init(&retention->files);
+  retention->paths = g_hash_table_new(g_str_hash, g_str_equal);
+}
+
+void
+gst_zcm_retention_clear (GstZcmRetention * retention)
+{
+  gst_zcm_retention_stop(retention);
+
+  g_hash_table_destroy(retention->paths);
+  pthread_cond_destroy(&retention->cond);
+  pthread_mutex_destroy(&retention->mutex);
+}
+
+void
+gst_zcm_retention_start (GstZcmRetention * retention, guint64 max_bytes,
+    guint max_files, guint max_age_s, GstZcmRetentionRemovedFunc removed,
+    gpointer user_data)
+{
+  gst_zcm_retention_stop(retention);
+
+  pthread_mutex_lock(&retention->mutex);
+  retention->removed = removed;
+  retention->user_data = user_data;
+  retention->max_bytes = max_bytes;
+  retention->max_files = max_files;
+  retention->max_age_us = (gint64) max_age_s * G_USEC_PER_SEC;
+  retention->deleted_files = 0;
+  retention->deleted_bytes = 0;
+  retention->exit = false;
+  pthread_mutex_unlock(&retention->mutex);
+
+  pthread_create(&retention->thread, NULL, deletion_thread, retention);
+  retention->running = true;
+}
+
+void
+gst_zcm_retention_stop (GstZcmRetention * retention)
+{
+  if (!retention->running) return;
+
+  pthread_mutex_lock(&retention->mutex);
+  retention->exit = true;
+  pthread_cond_signal(&retention->cond);
+  pthread_mutex_unlock(&retention->mutex);
+
+  pthread_join(retention->thread, NULL);
+  retention->running = false;
+
+  g_hash_table_remove_all(retention->paths);
+  g_queue_clear_full(&retention->files, (GDestroyNotify) file_free);
+  retention->bytes = 0;
+}
+
+void
+gst_zcm_retention_add (GstZcmRetention * retention, const char * path,
+    gint64 file, guint64 size, gint64 utime, guint64 slot, bool open)
+{
+  if (!retention->running) return;
+
+  pthread_mutex_lock(&retention->mutex);
+
+  // Segments of several volumes fill up side by side, so the file can be
+  // anywhere among the newest ones
+  GstZcmRetentionFile* entry = g_hash_table_lookup(retention->paths, path);
+  if (!entry) {
+    entry = g_slice_new0(GstZcmRetentionFile);
+    entry->path = g_strdup(path);
+    entry->file = file;
+    entry->first_slot = GST_ZCM_RETENTION_NO_SLOT;
+    entry->last_slot = 0;
+    entry->open = open;
+    g_queue_push_tail(&retention->files, entry);
+    g_hash_table_insert(retention->paths, entry->path, entry);
+  }
+
+  entry->size += size;
+  entry->utime = MAX(entry->utime, utime);
+  if (slot != GST_ZCM_RETENTION_NO_SLOT) {
+    entry->first_slot = MIN(entry->first_slot, slot);
+    entry->last_slot = MAX(entry->last_slot, slot);
+  }
+  retention->bytes += size;
+
+  if (over_budget(retention, g_get_real_time())) {
+    pthread_cond_signal(&retention->cond);
+  }
+
+  pthread_mutex_unlock(&retention->mutex);
+}
+
+void
+gst_zcm_retention_close (GstZcmRetention * retention, const char * path)
+{
+  if (!retention->running) return;
+
+  pthread_mutex_lock(&retention->mutex);
+
+  GstZcmRetentionFile* entry = g_hash_table_lookup(retention->paths, path);
+  if (entry) {
+    entry->open = false;
+    if (over_budget(retention, g_get_real_time())) {
+      pthread_cond_signal(&retention->cond);
+    }
+  }
+
+  pthread_mutex_unlock(&retention->mutex);
+}
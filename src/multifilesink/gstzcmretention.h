@@ -0,0 +1,101 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMRETENTION_H_
+#define _GST_ZCMRETENTION_H_
+
+#include <gst/gst.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+
+G_BEGIN_DECLS
+
+/* Frames written to a file that is not in the frame index */
+#define GST_ZCM_RETENTION_NO_SLOT G_MAXUINT64
+
+/* Deletes the oldest files in batches of this many */
+#define GST_ZCM_RETENTION_BATCH 64
+
+typedef struct _GstZcmRetention GstZcmRetention;
+typedef struct _GstZcmRetentionFile GstZcmRetentionFile;
+
+struct _GstZcmRetentionFile
+{
+  char* path;
+  gint64 file;         // number location was formatted with
+  guint64 size;
+  gint64 utime;        // when the last frame in the file was written
+  guint64 first_slot;  // frame index entries of the file's frames
+  guint64 last_slot;
+  bool open;           // still being written to, never deleted
+};
+
+/* Runs on the deletion thread once file has been unlinked, to clean up
+ * whatever else refers to it */
+typedef void (*GstZcmRetentionRemovedFunc) (const GstZcmRetentionFile * file,
+    gpointer user_data);
+
+struct _GstZcmRetention
+{
+  GstZcmRetentionRemovedFunc removed;
+  gpointer user_data;
+
+  guint64 max_bytes;
+  guint max_files;
+  gint64 max_age_us;
+
+  pthread_t thread;
+  bool running;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  GQueue files;        // oldest first
+  GHashTable* paths;   // path to its entry in files
+  guint64 bytes;
+  guint64 deleted_files;
+  guint64 deleted_bytes;
+  bool exit;
+};
+
+void gst_zcm_retention_init (GstZcmRetention * retention);
+void gst_zcm_retention_clear (GstZcmRetention * retention);
+
+/* Starts the deletion thread keeping the files added within max_bytes,
+ * max_files and max_age_s, any of which may be 0 for no limit. Files still
+ * open are kept, the oldest closed ones go first. */
+void gst_zcm_retention_start (GstZcmRetention * retention, guint64 max_bytes,
+    guint max_files, guint max_age_s, GstZcmRetentionRemovedFunc removed,
+    gpointer user_data);
+
+/* Joins the deletion thread and forgets the files it was tracking */
+void gst_zcm_retention_stop (GstZcmRetention * retention);
+
+/* Accounts for size bytes written to path. Frames of the same file are
+ * merged, so a segment is tracked and deleted as a whole. A file added as
+ * open stays until gst_zcm_retention_close() is called for it. */
+void gst_zcm_retention_add (GstZcmRetention * retention, const char * path,
+    gint64 file, guint64 size, gint64 utime, guint64 slot, bool open);
+
+/* Lets path be deleted, nothing is written to it anymore */
+void gst_zcm_retention_close (GstZcmRetention * retention, const char * path);
+
+G_END_DECLS
+
+#endif
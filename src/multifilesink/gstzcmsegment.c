@@ -0,0 +1,113 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // fallocate
+#endif
+
+#include "gstzcmsegment.h"
+#include "gstzcmdirectio.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+GstZcmSegment *
+gst_zcm_segment_open (const char * path, guint64 preallocate, gboolean direct)
+{
+  int fd = gst_zcm_direct_open(path, &direct);
+  if (fd < 0) return NULL;
+
+  char* index_path = g_strconcat(path, GST_ZCM_SEGMENT_INDEX_SUFFIX, NULL);
+  int index_fd = open(index_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  g_free(index_path);
+  if (index_fd < 0) {
+    close(fd);
+    return NULL;
+  }
+
+  GstZcmSegmentIndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GST_ZCM_SEGMENT_INDEX_MAGIC, sizeof(header.magic));
+  header.version = GST_ZCM_SEGMENT_INDEX_VERSION;
+  header.entry_size = sizeof(GstZcmSegmentIndexEntry);
+  if (pwrite(index_fd, &header, sizeof(header), 0) != sizeof(header)) {
+    close(index_fd);
+    close(fd);
+    return NULL;
+  }
+
+  // Reserving the extent up front keeps the segment contiguous on disk and
+  // spares every append a block allocation. Not every file system can.
+  if (preallocate > 0) fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, preallocate);
+
+  GstZcmSegment* segment = g_new0(GstZcmSegment, 1);
+  segment->refcount = 1;
+  segment->path = g_strdup(path);
+  segment->fd = fd;
+  segment->index_fd = index_fd;
+  segment->direct = direct;
+  segment->open_time = g_get_monotonic_time();
+
+  return segment;
+}
+
+GstZcmSegment *
+gst_zcm_segment_ref (GstZcmSegment * segment)
+{
+  g_atomic_int_inc(&segment->refcount);
+  return segment;
+}
+
+void
+gst_zcm_segment_unref (GstZcmSegment * segment)
+{
+  if (!segment || !g_atomic_int_dec_and_test(&segment->refcount)) return;
+
+  // Drop the O_DIRECT padding after the last frame and whatever was
+  // preallocated but not used
+  if (ftruncate(segment->fd, segment->used) != 0) {
+    // Readers go by the index, so the segment is merely longer than needed
+  }
+  close(segment->fd);
+  close(segment->index_fd);
+  g_free(segment->path);
+  g_free(segment);
+}
+
+guint64
+gst_zcm_segment_reserve (GstZcmSegment * segment, gsize size, guint32 * entry)
+{
+  guint64 align = segment->direct ? GST_ZCM_DIRECT_IO_ALIGN : 1;
+  guint64 offset = (segment->used + align - 1) & ~(align - 1);
+
+  segment->used = offset + size;
+  *entry = segment->n_frames++;
+
+  return offset;
+}
+
+gboolean
+gst_zcm_segment_write_entry (GstZcmSegment * segment, guint32 entry,
+    const GstZcmSegmentIndexEntry * data)
+{
+  off_t offset = sizeof(GstZcmSegmentIndexHeader) +
+                 (off_t) entry * sizeof(GstZcmSegmentIndexEntry);
+  return pwrite(segment->index_fd, data, sizeof(*data), offset) == sizeof(*data);
+}
@@ -0,0 +1,100 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMSEGMENT_H_
+#define _GST_ZCMSEGMENT_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* A segment is one large file frames are appended to, plus an index file next
+ * to it (the segment path with GST_ZCM_SEGMENT_INDEX_SUFFIX appended). The
+ * index is a GstZcmSegmentIndexHeader followed by one fixed size
+ * GstZcmSegmentIndexEntry per frame, in host byte order. Entries are written
+ * once their frame is on disk, an entry with size 0 was never completed. */
+
+#define GST_ZCM_SEGMENT_INDEX_SUFFIX ".idx"
+#define GST_ZCM_SEGMENT_INDEX_MAGIC "ZCMSEGIX"
+#define GST_ZCM_SEGMENT_INDEX_VERSION 2
+#define GST_ZCM_SEGMENT_MAX_STRIDES 4
+
+typedef struct _GstZcmSegmentIndexHeader GstZcmSegmentIndexHeader;
+typedef struct _GstZcmSegmentIndexEntry GstZcmSegmentIndexEntry;
+typedef struct _GstZcmSegment GstZcmSegment;
+
+struct _GstZcmSegmentIndexHeader
+{
+  char magic[8];
+  guint32 version;
+  guint32 entry_size;
+};
+
+struct _GstZcmSegmentIndexEntry
+{
+  guint64 offset;
+  guint64 size;
+  gint64 pic_utime;
+  gint32 pixelformat;
+  gint32 compression;  // see photo_t.zcm
+  gint32 width;
+  gint32 height;
+  gint32 num_strides;
+  gint32 stride[GST_ZCM_SEGMENT_MAX_STRIDES];
+};
+
+struct _GstZcmSegment
+{
+  gint refcount;
+
+  char* path;
+  int fd;
+  int index_fd;
+  gboolean direct;
+
+  // Only touched by whoever places frames, see gst_zcm_segment_reserve()
+  guint64 used;
+  guint32 n_frames;
+  gint64 open_time;
+};
+
+/* Creates the segment file, preallocating preallocate bytes of it, and its
+ * index. direct requests O_DIRECT, see gst_zcm_direct_open(). */
+GstZcmSegment * gst_zcm_segment_open (const char * path, guint64 preallocate,
+    gboolean direct);
+
+GstZcmSegment * gst_zcm_segment_ref (GstZcmSegment * segment);
+
+/* Dropping the last reference trims the preallocation to what was used and
+ * closes the segment */
+void gst_zcm_segment_unref (GstZcmSegment * segment);
+
+/* Claims room for a frame of size bytes, aligned as O_DIRECT requires, and
+ * its index entry. Returns the frame's offset. Not thread safe, frames are
+ * placed one at a time in frame order. */
+guint64 gst_zcm_segment_reserve (GstZcmSegment * segment, gsize size,
+    guint32 * entry);
+
+/* Writes index entry number entry. Safe to call from any thread. */
+gboolean gst_zcm_segment_write_entry (GstZcmSegment * segment, guint32 entry,
+    const GstZcmSegmentIndexEntry * data);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,110 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include "gstzcmsequencer.h"
+
+#include <string.h>
+
+#define INITIAL_SIZE 64
+
+void
+gst_zcm_sequencer_init (GstZcmSequencer * sequencer, GstZcmSequencerFunc func,
+    gpointer user_data)
+{
+  memset(sequencer, 0, sizeof(*sequencer));
+
+  sequencer->func = func;
+  sequencer->user_data = user_data;
+  sequencer->size = INITIAL_SIZE;
+  sequencer->ring = g_new0(gpointer, sequencer->size);
+  pthread_mutex_init(&sequencer->mutex, NULL);
+}
+
+void
+gst_zcm_sequencer_clear (GstZcmSequencer * sequencer)
+{
+  pthread_mutex_destroy(&sequencer->mutex);
+  g_free(sequencer->ring);
+  sequencer->ring = NULL;
+}
+
+void
+gst_zcm_sequencer_reset (GstZcmSequencer * sequencer)
+{
+  pthread_mutex_lock(&sequencer->mutex);
+  memset(sequencer->ring, 0, sequencer->size * sizeof(gpointer));
+  sequencer->next_in = 0;
+  sequencer->next_out = 0;
+  pthread_mutex_unlock(&sequencer->mutex);
+}
+
+guint64
+gst_zcm_sequencer_take (GstZcmSequencer * sequencer)
+{
+  pthread_mutex_lock(&sequencer->mutex);
+
+  // Every item in flight needs a place in the ring. It only grows until it
+  // covers the most items ever in flight at once.
+  if (sequencer->next_in - sequencer->next_out >= sequencer->size) {
+    guint64 size = sequencer->size * 2;
+    gpointer* ring = g_new0(gpointer, size);
+    for (guint64 n = sequencer->next_out; n < sequencer->next_in; ++n) {
+      ring[n & (size - 1)] = sequencer->ring[n & (sequencer->size - 1)];
+    }
+    g_free(sequencer->ring);
+    sequencer->ring = ring;
+    sequencer->size = size;
+  }
+  guint64 n = sequencer->next_in++;
+
+  pthread_mutex_unlock(&sequencer->mutex);
+
+  return n;
+}
+
+void
+gst_zcm_sequencer_done (GstZcmSequencer * sequencer, guint64 n, gpointer item)
+{
+  pthread_mutex_lock(&sequencer->mutex);
+
+  sequencer->ring[n & (sequencer->size - 1)] = item;
+
+  // Whoever is already handing items out picks this one up too
+  if (sequencer->draining) {
+    pthread_mutex_unlock(&sequencer->mutex);
+    return;
+  }
+  sequencer->draining = true;
+
+  while (true) {
+    gpointer* slot = &sequencer->ring[sequencer->next_out & (sequencer->size - 1)];
+    if (sequencer->next_out == sequencer->next_in || !*slot) break;
+
+    gpointer next = *slot;
+    *slot = NULL;
+    sequencer->next_out++;
+
+    pthread_mutex_unlock(&sequencer->mutex);
+    sequencer->func(next, sequencer->user_data);
+    pthread_mutex_lock(&sequencer->mutex);
+  }
+
+  sequencer->draining = false;
+  pthread_mutex_unlock(&sequencer->mutex);
+}
@@ -0,0 +1,69 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMSEQUENCER_H_
+#define _GST_ZCMSEQUENCER_H_
+
+#include <gst/gst.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+
+G_BEGIN_DECLS
+
+/* Puts items finished out of order by a pool of threads back in the order
+ * they were started. Each item takes a number when it starts and is handed
+ * to func in that order once it and everything before it are done. */
+
+/* Runs on whichever thread completed the next item in order, never on two
+ * threads at once */
+typedef void (*GstZcmSequencerFunc) (gpointer item, gpointer user_data);
+
+typedef struct _GstZcmSequencer GstZcmSequencer;
+
+struct _GstZcmSequencer
+{
+  GstZcmSequencerFunc func;
+  gpointer user_data;
+
+  pthread_mutex_t mutex;
+  gpointer* ring;      // done items waiting for the ones before them
+  guint64 size;        // of ring, a power of two
+  guint64 next_in;
+  guint64 next_out;
+  bool draining;
+};
+
+void gst_zcm_sequencer_init (GstZcmSequencer * sequencer,
+    GstZcmSequencerFunc func, gpointer user_data);
+void gst_zcm_sequencer_clear (GstZcmSequencer * sequencer);
+
+/* Restarts numbering, nothing may be in flight */
+void gst_zcm_sequencer_reset (GstZcmSequencer * sequencer);
+
+/* Returns the number for the next item */
+guint64 gst_zcm_sequencer_take (GstZcmSequencer * sequencer);
+
+/* Marks item number n done. item must not be NULL. */
+void gst_zcm_sequencer_done (GstZcmSequencer * sequencer, guint64 n,
+    gpointer item);
+
+G_END_DECLS
+
+#endif
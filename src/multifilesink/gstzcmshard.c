@@ -0,0 +1,158 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include "gstzcmshard.h"
+
+#include <glib/gstdio.h>
+#include <time.h>
+
+#define SECONDS_PER_HOUR 3600
+
+/* The subdirectory of shard, relative to the location's directory */
+static char*
+shard_subdir (GstZcmShardLayout layout, gint64 shard)
+{
+  if (layout == GST_ZCM_SHARD_HOUR) {
+    time_t seconds = (time_t) shard * SECONDS_PER_HOUR;
+    struct tm tm;
+    char name[32];
+    if (!gmtime_r(&seconds, &tm) || strftime(name, sizeof(name), "%Y%m%d/%H", &tm) == 0) {
+      return g_strdup("invalid");
+    }
+    return g_strdup(name);
+  }
+
+  return g_strdup_printf("%03" G_GINT64_FORMAT "/%03d", shard / 1000,
+      (int) (shard % 1000));
+}
+
+gint64
+gst_zcm_shard_number (GstZcmShardLayout layout, guint size, gint64 file,
+    gint64 real_time)
+{
+  switch (layout) {
+    case GST_ZCM_SHARD_INDEX:
+      return file / MAX(size, 1);
+    case GST_ZCM_SHARD_HOUR:
+      return real_time / ((gint64) SECONDS_PER_HOUR * G_USEC_PER_SEC);
+    default:
+      return 0;
+  }
+}
+
+char *
+gst_zcm_shard_pattern (const char * location, GstZcmShardLayout layout,
+    gint64 shard)
+{
+  if (layout == GST_ZCM_SHARD_NONE) return g_strdup(location);
+
+  char* dir = g_path_get_dirname(location);
+  char* base = g_path_get_basename(location);
+  char* subdir = shard_subdir(layout, shard);
+  char* pattern = g_build_filename(dir, subdir, base, NULL);
+  g_free(subdir);
+  g_free(base);
+  g_free(dir);
+
+  return pattern;
+}
+
+gboolean
+gst_zcm_shard_prepare (const char * location, GstZcmShardLayout layout,
+    gint64 shard)
+{
+  if (layout == GST_ZCM_SHARD_NONE) return TRUE;
+
+  char* dir = g_path_get_dirname(location);
+  char* subdir = shard_subdir(layout, shard);
+  char* path = g_build_filename(dir, subdir, NULL);
+  gboolean ok = g_mkdir_with_parents(path, 0755) == 0;
+  g_free(path);
+  g_free(subdir);
+  g_free(dir);
+
+  return ok;
+}
+
+/* Returns the name of the numerically highest all digit entry of dir */
+static char*
+latest_entry (const char* dir)
+{
+  GDir* d = g_dir_open(dir, 0, NULL);
+  if (!d) return NULL;
+
+  char* latest = NULL;
+  gint64 latest_number = -1;
+  const char* name;
+  while ((name = g_dir_read_name(d)) != NULL) {
+    char* end;
+    gint64 number = g_ascii_strtoll(name, &end, 10);
+    if (end == name || *end != '\0' || number <= latest_number) continue;
+    g_free(latest);
+    latest = g_strdup(name);
+    latest_number = number;
+  }
+  g_dir_close(d);
+
+  return latest;
+}
+
+char *
+gst_zcm_shard_latest_pattern (const char * location, GstZcmShardLayout layout)
+{
+  if (layout == GST_ZCM_SHARD_NONE) return NULL;
+
+  char* dir = g_path_get_dirname(location);
+  char* pattern = NULL;
+
+  // Both layouts nest two levels deep and name them so the latest shard is
+  // the highest number at each level
+  char* top = latest_entry(dir);
+  if (top) {
+    char* top_path = g_build_filename(dir, top, NULL);
+    char* sub = latest_entry(top_path);
+    if (sub) {
+      char* base = g_path_get_basename(location);
+      pattern = g_build_filename(top_path, sub, base, NULL);
+      g_free(base);
+      g_free(sub);
+    }
+    g_free(top_path);
+    g_free(top);
+  }
+  g_free(dir);
+
+  return pattern;
+}
+
+void
+gst_zcm_shard_cleanup (const char * path, GstZcmShardLayout layout)
+{
+  if (layout == GST_ZCM_SHARD_NONE) return;
+
+  // rmdir fails on directories that still hold files, which is all the
+  // checking needed
+  char* sub = g_path_get_dirname(path);
+  if (g_rmdir(sub) == 0) {
+    char* top = g_path_get_dirname(sub);
+    g_rmdir(top);
+    g_free(top);
+  }
+  g_free(sub);
+}
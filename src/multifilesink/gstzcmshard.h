@@ -0,0 +1,71 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMSHARD_H_
+#define _GST_ZCMSHARD_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Sharding spreads the files of one location pattern over nested
+ * subdirectories of the pattern's directory, so no single directory grows
+ * large enough to slow down creating and looking up files. A file's shard is
+ * a number, from which its two level subdirectory is named:
+ *
+ *   index: shard = file / shard-size, subdirectory "%03d/%03d" of shard / 1000
+ *          and shard % 1000
+ *   hour:  shard = hours since the epoch the file was created in, subdirectory
+ *          "YYYYMMDD/HH" in UTC
+ *
+ * so /data/%08d.raw with layout index and shard-size 1000 puts file 1234567
+ * in /data/001/234/01234567.raw. */
+
+typedef enum
+{
+  GST_ZCM_SHARD_NONE,
+  GST_ZCM_SHARD_INDEX,
+  GST_ZCM_SHARD_HOUR,
+} GstZcmShardLayout;
+
+/* Returns the shard file number file falls into when created at real_time
+ * (microseconds since the epoch) */
+gint64 gst_zcm_shard_number (GstZcmShardLayout layout, guint size,
+    gint64 file, gint64 real_time);
+
+/* Returns location with the subdirectory of shard inserted before its file
+ * name, still to be formatted with the file number. Free with g_free(). */
+char * gst_zcm_shard_pattern (const char * location, GstZcmShardLayout layout,
+    gint64 shard);
+
+/* Creates the subdirectory of shard, and any parents it needs */
+gboolean gst_zcm_shard_prepare (const char * location,
+    GstZcmShardLayout layout, gint64 shard);
+
+/* Returns the pattern of the highest numbered shard directory that exists
+ * under location's directory, or NULL if there is none */
+char * gst_zcm_shard_latest_pattern (const char * location,
+    GstZcmShardLayout layout);
+
+/* Removes the directories of the shard path was in once they are empty */
+void gst_zcm_shard_cleanup (const char * path, GstZcmShardLayout layout);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,234 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include "gstzcmwriterpool.h"
+
+#include <string.h>
+
+/* The queue is a fixed ring so queueing a frame never allocates */
+static gpointer
+queue_pop (GstZcmWriterPool * pool)
+{
+  gpointer job = pool->queue[pool->head];
+  pool->head = (pool->head + 1) % pool->capacity;
+  pool->length--;
+  return job;
+}
+
+static void
+queue_push (GstZcmWriterPool * pool, gpointer job)
+{
+  pool->queue[(pool->head + pool->length) % pool->capacity] = job;
+  pool->length++;
+}
+
+static void*
+writer_thread (void* usr)
+{
+  GstZcmWriterPool* pool = (GstZcmWriterPool*) usr;
+
+  bool wrote = false;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (true) {
+    if (wrote && pool->flush && pool->length == 0) {
+      pthread_mutex_unlock(&pool->mutex);
+      pool->flush(pool->user_data);
+      pthread_mutex_lock(&pool->mutex);
+      wrote = false;
+    }
+    while (!pool->exit && pool->length == 0) {
+      pthread_cond_wait(&pool->not_empty, &pool->mutex);
+    }
+    // Exit only once everything queued has been written
+    if (pool->length == 0) break;
+
+    gpointer job = queue_pop(pool);
+    pool->busy++;
+    pthread_cond_signal(&pool->not_full);
+    pthread_mutex_unlock(&pool->mutex);
+
+    gint64 start = g_get_monotonic_time();
+    pool->func(job, pool->user_data);
+    guint64 latency_us = g_get_monotonic_time() - start;
+    wrote = true;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->busy--;
+    pool->stats.last_latency_us = latency_us;
+    if (latency_us > pool->stats.max_latency_us) pool->stats.max_latency_us = latency_us;
+    if (pool->busy == 0 && pool->length == 0) {
+      pthread_cond_broadcast(&pool->idle);
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  return NULL;
+}
+
+void
+gst_zcm_writer_pool_init (GstZcmWriterPool * pool)
+{
+  memset(pool, 0, sizeof(*pool));
+
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->not_empty, NULL);
+  pthread_cond_init(&pool->not_full, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+}
+
+void
+gst_zcm_writer_pool_clear (GstZcmWriterPool * pool)
+{
+  gst_zcm_writer_pool_stop(pool);
+
+  g_free(pool->queue);
+  pthread_cond_destroy(&pool->idle);
+  pthread_cond_destroy(&pool->not_full);
+  pthread_cond_destroy(&pool->not_empty);
+  pthread_mutex_destroy(&pool->mutex);
+}
+
+void
+gst_zcm_writer_pool_start (GstZcmWriterPool * pool, guint n_threads,
+    guint capacity, GstZcmWriterPoolPolicy policy, GstZcmWriterPoolFunc func,
+    GstZcmWriterPoolFlushFunc flush, GDestroyNotify drop, gpointer user_data)
+{
+  gst_zcm_writer_pool_stop(pool);
+
+  pthread_mutex_lock(&pool->mutex);
+  memset(&pool->stats, 0, sizeof(pool->stats));
+  pool->flushing = false;
+  pool->exit = false;
+  pool->func = func;
+  pool->flush = flush;
+  pool->drop = drop;
+  pool->user_data = user_data;
+  pool->n_threads = CLAMP(n_threads, 1, GST_ZCM_WRITER_POOL_MAX_THREADS);
+  pool->capacity = MAX(capacity, 1);
+  pool->policy = policy;
+  pool->queue = g_renew(gpointer, pool->queue, pool->capacity);
+  pool->head = 0;
+  pool->length = 0;
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (guint i = 0; i < pool->n_threads; ++i) {
+    pthread_create(&pool->threads[i], NULL, writer_thread, pool);
+  }
+}
+
+void
+gst_zcm_writer_pool_stop (GstZcmWriterPool * pool)
+{
+  if (pool->n_threads == 0) return;
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->exit = true;
+  pthread_cond_broadcast(&pool->not_empty);
+  pthread_cond_broadcast(&pool->not_full);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (guint i = 0; i < pool->n_threads; ++i) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->n_threads = 0;
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+GstFlowReturn
+gst_zcm_writer_pool_push (GstZcmWriterPool * pool, gpointer job)
+{
+  gpointer dropped = NULL;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  pthread_mutex_lock(&pool->mutex);
+
+  if (pool->exit || pool->n_threads == 0) {
+    dropped = job;
+    job = NULL;
+    ret = GST_FLOW_FLUSHING;
+  } else if (pool->length >= pool->capacity) {
+    switch (pool->policy) {
+      case GST_ZCM_WRITER_POOL_BLOCK:
+        while (!pool->flushing && !pool->exit &&
+               pool->length >= pool->capacity) {
+          pthread_cond_wait(&pool->not_full, &pool->mutex);
+        }
+        if (pool->flushing || pool->exit) {
+          dropped = job;
+          job = NULL;
+          ret = GST_FLOW_FLUSHING;
+        }
+        break;
+      case GST_ZCM_WRITER_POOL_DROP_NEW:
+        dropped = job;
+        job = NULL;
+        pool->stats.dropped++;
+        break;
+      case GST_ZCM_WRITER_POOL_DROP_OLDEST:
+        dropped = queue_pop(pool);
+        pool->stats.dropped++;
+        break;
+    }
+  }
+
+  if (job) {
+    queue_push(pool, job);
+    pthread_cond_signal(&pool->not_empty);
+  }
+
+  pthread_mutex_unlock(&pool->mutex);
+
+  if (dropped && pool->drop) pool->drop(dropped);
+
+  return ret;
+}
+
+void
+gst_zcm_writer_pool_drain (GstZcmWriterPool * pool)
+{
+  if (pool->n_threads == 0) return;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->busy > 0 || pool->length > 0) {
+    pthread_cond_wait(&pool->idle, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void
+gst_zcm_writer_pool_set_flushing (GstZcmWriterPool * pool, gboolean flushing)
+{
+  pthread_mutex_lock(&pool->mutex);
+  pool->flushing = flushing;
+  pthread_cond_broadcast(&pool->not_full);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void
+gst_zcm_writer_pool_get_stats (GstZcmWriterPool * pool,
+    GstZcmWriterPoolStats * stats)
+{
+  pthread_mutex_lock(&pool->mutex);
+  *stats = pool->stats;
+  stats->depth = pool->length + pool->busy;
+  pthread_mutex_unlock(&pool->mutex);
+}
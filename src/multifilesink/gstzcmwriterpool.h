@@ -0,0 +1,112 @@
+/* GStreamer
+ * Copyright (C) 2020 ZeroCM Team <www.zcm-project.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ZCMWRITERPOOL_H_
+#define _GST_ZCMWRITERPOOL_H_
+
+#include <gst/gst.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+
+G_BEGIN_DECLS
+
+#define GST_ZCM_WRITER_POOL_MAX_THREADS 64
+
+typedef enum
+{
+  GST_ZCM_WRITER_POOL_BLOCK,
+  GST_ZCM_WRITER_POOL_DROP_NEW,
+  GST_ZCM_WRITER_POOL_DROP_OLDEST,
+} GstZcmWriterPoolPolicy;
+
+/* Runs on a writer thread for each queued job and owns it afterwards */
+typedef void (*GstZcmWriterPoolFunc) (gpointer job, gpointer user_data);
+
+/* Runs on a writer thread when it finds the queue empty after writing, for
+ * writers that batch work up */
+typedef void (*GstZcmWriterPoolFlushFunc) (gpointer user_data);
+
+typedef struct _GstZcmWriterPool GstZcmWriterPool;
+typedef struct _GstZcmWriterPoolStats GstZcmWriterPoolStats;
+
+struct _GstZcmWriterPoolStats
+{
+  guint depth;
+  guint64 dropped;
+  guint64 last_latency_us;
+  guint64 max_latency_us;
+};
+
+struct _GstZcmWriterPool
+{
+  GstZcmWriterPoolFunc func;
+  GstZcmWriterPoolFlushFunc flush;
+  GDestroyNotify drop;
+  gpointer user_data;
+
+  pthread_t threads[GST_ZCM_WRITER_POOL_MAX_THREADS];
+  guint n_threads;
+  guint capacity;
+  GstZcmWriterPoolPolicy policy;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  pthread_cond_t idle;
+  gpointer* queue;   // ring of capacity jobs, allocated on start
+  guint head;
+  guint length;
+  guint busy;
+  bool flushing;
+  bool exit;
+
+  GstZcmWriterPoolStats stats;
+};
+
+void gst_zcm_writer_pool_init (GstZcmWriterPool * pool);
+void gst_zcm_writer_pool_clear (GstZcmWriterPool * pool);
+
+/* Starts n_threads writers draining a queue of at most capacity jobs. Jobs
+ * dropped by the policy, or pushed while the pool is stopped, go to drop.
+ * flush may be NULL. */
+void gst_zcm_writer_pool_start (GstZcmWriterPool * pool, guint n_threads,
+    guint capacity, GstZcmWriterPoolPolicy policy, GstZcmWriterPoolFunc func,
+    GstZcmWriterPoolFlushFunc flush, GDestroyNotify drop, gpointer user_data);
+
+/* Writes everything still queued, then joins the writer threads */
+void gst_zcm_writer_pool_stop (GstZcmWriterPool * pool);
+
+/* Queues job, taking ownership. With the block policy this waits for room
+ * and returns GST_FLOW_FLUSHING if the pool is set flushing meanwhile. */
+GstFlowReturn gst_zcm_writer_pool_push (GstZcmWriterPool * pool,
+    gpointer job);
+
+/* Waits until every queued job has been written */
+void gst_zcm_writer_pool_drain (GstZcmWriterPool * pool);
+
+void gst_zcm_writer_pool_set_flushing (GstZcmWriterPool * pool,
+    gboolean flushing);
+
+void gst_zcm_writer_pool_get_stats (GstZcmWriterPool * pool,
+    GstZcmWriterPoolStats * stats);
+
+G_END_DECLS
+
+#endif
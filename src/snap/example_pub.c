@@ -1,7 +1,18 @@
+#include <stdio.h>
 #include <unistd.h>
+#include <sys/time.h>
 
 #include <zcm/zcm.h>
 #include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_snap_t.h"
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_snap_ack_t.h"
+
+static void ack_handler(const zcm_recv_buf_t* rbuf, const char* channel,
+                        const zcm_gstreamer_plugins_snap_ack_t* msg, void* usr)
+{
+    printf("ack %ld: debounce %d frame %d latency %ld us (mean %.0f, stddev %.0f, n %ld)\n",
+           msg->seq, msg->debounce, msg->frame_index, msg->latency_us,
+           msg->latency_mean_us, msg->latency_stddev_us, msg->latency_count);
+}
 
 int main(int argc, char *argv[])
 {
@@ -9,11 +20,21 @@ int main(int argc, char *argv[])
     if (!zcm)
         return 1;
 
+    zcm_gstreamer_plugins_snap_ack_t_subscribe(zcm, "GSTREAMER_SNAP_ACK", &ack_handler, NULL);
+    zcm_start(zcm);
+
     zcm_gstreamer_plugins_snap_t snap = {};
     if (argc > 1) snap.debounce = atoi(argv[1]);
+    // Optional capture offset in ms from each debounce change, may be negative
+    int64_t capture_offset_us = argc > 2 ? atoll(argv[2]) * 1000 : 0;
 
     int j;
     for (j = 0; j < 10; ++j) {
+        if (argc > 2) {
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            snap.capture_utime = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec + capture_offset_us;
+        }
         int i;
         for (i = 0; i < 10; ++i) {
             snap.utime++;
@@ -23,6 +44,7 @@ int main(int argc, char *argv[])
         snap.debounce++;
     }
 
+    zcm_stop(zcm);
     zcm_destroy(zcm);
     return 0;
 }
@@ -28,6 +28,35 @@
  * gst-launch-1.0 -v fakesrc ! zcmsnap ! fakesink
  * ]|
  * Blocks all frames except those requested by snap_t messages received on the GSTREAMER_SNAP channel
+ * |[
+ * gst-launch-1.0 -v v4l2src ! zcmsnap preroll-ms=500 postroll-frames=5 ! videoconvert ! jpegenc ! multifilesink
+ * ]|
+ * On every snap also lets through the frames from the half second before the
+ * snap_t arrived and the 5 frames after it
+ *
+ * A snap_t with a capture_utime takes the frame whose timestamp, mapped to
+ * wall clock time, is closest to it: a frame still in the pre-trigger ring
+ * for times in the past, or a frame yet to arrive for times in the future.
+ * This lets cameras on several hosts capture the same instant. The achieved
+ * error is reported in a "zcmsnap" element message on the bus.
+ *
+ * The snap_t mode field also selects bursts (count frames interval_us apart)
+ * and continuous decimation (every count-th frame, or one frame every
+ * interval_us) for time-lapse and dataset capture. Place zcmsnap right after
+ * the source so that unwanted frames are dropped before any conversion.
+ *
+ * On compressed video (H.264, H.265, ...) a snap asks upstream for a key unit
+ * and lets through the next keyframe, or with encoded-capture=gop the whole
+ * group of pictures it starts, so no decoder has to run on every frame:
+ * |[
+ * gst-launch-1.0 rtspsrc location=rtsp://camera ! rtph264depay ! h264parse ! zcmsnap ! avdec_h264 ! jpegenc ! multifilesink
+ * ]|
+ *
+ * Every frame let through for a snap is acknowledged with a snap_ack_t on the
+ * GSTREAMER_SNAP_ACK channel (see ack-channel), carrying the request it
+ * answers, the chosen frame's time and the trigger-to-emit latency together
+ * with running latency statistics, which are also readable as latency-*
+ * properties.
  * </refsect2>
  */
 
@@ -35,10 +64,13 @@
 #include "config.h"
 #endif
 
+#include <math.h>
+
 #include <gst/gst.h>
 #include <gst/video/video.h>
-#include <gst/video/gstvideofilter.h>
+#include <gst/base/gstbasetransform.h>
 #include "gstzcmsnap.h"
+#include "gstzcmtransport.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_zcm_snap_debug_category);
 #define GST_CAT_DEFAULT gst_zcm_snap_debug_category
@@ -55,19 +87,50 @@ static void gst_zcm_snap_finalize (GObject * object);
 
 static gboolean gst_zcm_snap_start (GstBaseTransform * trans);
 static gboolean gst_zcm_snap_stop (GstBaseTransform * trans);
-static gboolean gst_zcm_snap_set_info (GstVideoFilter * filter,
-    GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps,
-    GstVideoInfo * out_info);
-static GstFlowReturn gst_zcm_snap_transform_frame_ip (GstVideoFilter * filter,
-    GstVideoFrame * frame);
+static gboolean gst_zcm_snap_set_caps (GstBaseTransform * trans,
+    GstCaps * incaps, GstCaps * outcaps);
+static GstFlowReturn gst_zcm_snap_transform_ip (GstBaseTransform * trans,
+    GstBuffer * buf);
 
 enum
 {
   PROP_0,
   PROP_ZCM_URL,
   PROP_CHANNEL,
+  PROP_PREROLL_FRAMES,
+  PROP_PREROLL_MS,
+  PROP_PREROLL_MAX_BYTES,
+  PROP_POSTROLL_FRAMES,
+  PROP_LAST_CAPTURE_ERROR_US,
+  PROP_ENCODED_CAPTURE,
+  PROP_ACK_CHANNEL,
+  PROP_LATENCY_COUNT,
+  PROP_LATENCY_MEAN_US,
+  PROP_LATENCY_STDDEV_US,
+  PROP_LATENCY_MIN_US,
+  PROP_LATENCY_MAX_US,
 };
 
+#define GST_TYPE_ZCM_SNAP_ENCODED_CAPTURE (gst_zcm_snap_encoded_capture_get_type())
+static GType
+gst_zcm_snap_encoded_capture_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_ZCM_SNAP_ENCODED_CAPTURE_KEYFRAME, "Pass the next keyframe", "keyframe"},
+    {GST_ZCM_SNAP_ENCODED_CAPTURE_GOP,
+        "Pass the next keyframe and the rest of its group of pictures", "gop"},
+    {0, NULL, NULL},
+  };
+
+  if (!type) {
+    type = g_enum_register_static ("GstZcmSnapEncodedCapture", values);
+  }
+  return type;
+}
+
+#define DEFAULT_PREROLL_MAX_BYTES (256 * 1024 * 1024)
+
 /* pad templates */
 
 static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
@@ -88,12 +151,18 @@ handler (const zcm_recv_buf_t* rbuf, const char* channel,
          const zcm_gstreamer_plugins_snap_t* msg, void* usr)
 {
   GstZcmSnap* zcmsnap = (GstZcmSnap*) usr;
-  if (zcmsnap->last_debounce != msg->debounce) {
-    zcmsnap->last_debounce = msg->debounce;
-    pthread_mutex_lock(&zcmsnap->mutex);
+  pthread_mutex_lock(&zcmsnap->mutex);
+    if (zcmsnap->last_debounce != msg->debounce) {
+      zcmsnap->last_debounce = msg->debounce;
       zcmsnap->take_picture = true;
-    pthread_mutex_unlock(&zcmsnap->mutex);
-  }
+      zcmsnap->capture_utime = msg->capture_utime;
+      zcmsnap->mode = msg->mode;
+      zcmsnap->count = msg->count;
+      zcmsnap->interval_us = msg->interval_us;
+      zcmsnap->request_utime = msg->utime;
+      zcmsnap->request_recv_utime = g_get_real_time();
+    }
+  pthread_mutex_unlock(&zcmsnap->mutex);
 }
 
 static void
@@ -119,8 +188,7 @@ destroy_zcm (GstZcmSnap* zcmsnap)
 {
   if (zcmsnap->zcm) {
     unsubscribe(zcmsnap);
-    zcm_stop(zcmsnap->zcm);
-    zcm_destroy(zcmsnap->zcm);
+    gst_zcm_transport_release(zcmsnap->zcm);
     zcmsnap->zcm = NULL;
   }
 }
@@ -129,14 +197,364 @@ static void
 init_zcm (GstZcmSnap* zcmsnap)
 {
   destroy_zcm(zcmsnap);
-  zcmsnap->zcm = zcm_create(zcmsnap->url->str);
-  subscribe(zcmsnap);
-  zcm_start(zcmsnap->zcm);
+  zcmsnap->zcm = gst_zcm_transport_acquire(zcmsnap->url->str);
+  if (zcmsnap->zcm) subscribe(zcmsnap);
+}
+
+/* Maps a buffer's timestamp onto wall clock time (us since epoch) by way of
+ * the pipeline clock, so frames are matched by when they were captured rather
+ * than when they reached this element */
+static int64_t
+buffer_wall_utime (GstZcmSnap* zcmsnap, GstBuffer* buf)
+{
+  int64_t now_utime = g_get_real_time();
+
+  if (!GST_BUFFER_PTS_IS_VALID(buf)) return now_utime;
+
+  GstClockTime running = gst_segment_to_running_time(
+      &GST_BASE_TRANSFORM(zcmsnap)->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buf));
+  if (!GST_CLOCK_TIME_IS_VALID(running)) return now_utime;
+
+  GstClock* clock = gst_element_get_clock(GST_ELEMENT(zcmsnap));
+  if (!clock) return now_utime;
+  GstClockTime now = gst_clock_get_time(clock);
+  gst_object_unref(clock);
+
+  GstClockTime frame_time = gst_element_get_base_time(GST_ELEMENT(zcmsnap)) + running;
+  return now_utime - ((gint64) now - (gint64) frame_time) / 1000;
+}
+
+static inline int64_t
+abs_diff (int64_t a, int64_t b)
+{
+  return a > b ? a - b : b - a;
+}
+
+static void
+ring_clear (GstZcmSnap* zcmsnap)
+{
+  GstBuffer* buf;
+  while ((buf = g_queue_pop_head(&zcmsnap->ring)) != NULL) {
+    gst_buffer_unref(buf);
+  }
+  zcmsnap->ring_bytes = 0;
+}
+
+static void
+ring_drop_oldest (GstZcmSnap* zcmsnap)
+{
+  GstBuffer* buf = g_queue_pop_head(&zcmsnap->ring);
+  zcmsnap->ring_bytes -= gst_buffer_get_size(buf);
+  gst_buffer_unref(buf);
+}
+
+static inline bool
+preroll_enabled (GstZcmSnap* zcmsnap)
+{
+  return zcmsnap->preroll_frames > 0 || zcmsnap->preroll_ms > 0;
+}
+
+/* Keeps a reference to buf (frames are never copied) and trims the ring back
+ * to the configured frame count, time window and memory cap. Without a
+ * pre-trigger window only the latest frame is kept, as a candidate for
+ * capture_utime requests that fall between two frames. */
+static void
+ring_push (GstZcmSnap* zcmsnap, GstBuffer* buf)
+{
+  g_queue_push_tail(&zcmsnap->ring, gst_buffer_ref(buf));
+  zcmsnap->ring_bytes += gst_buffer_get_size(buf);
+
+  if (!preroll_enabled(zcmsnap)) {
+    while (zcmsnap->ring.length > 1) ring_drop_oldest(zcmsnap);
+    return;
+  }
+
+  while (zcmsnap->preroll_frames && zcmsnap->ring.length > zcmsnap->preroll_frames) {
+    ring_drop_oldest(zcmsnap);
+  }
+
+  if (zcmsnap->preroll_ms && GST_BUFFER_PTS_IS_VALID(buf)) {
+    GstClockTime window = zcmsnap->preroll_ms * GST_MSECOND;
+    while (zcmsnap->ring.length > 1) {
+      GstBuffer* oldest = g_queue_peek_head(&zcmsnap->ring);
+      if (GST_BUFFER_PTS_IS_VALID(oldest) &&
+          GST_BUFFER_PTS(oldest) + window >= GST_BUFFER_PTS(buf)) break;
+      ring_drop_oldest(zcmsnap);
+    }
+  }
+
+  while (zcmsnap->ring.length && zcmsnap->ring_bytes > zcmsnap->preroll_max_bytes) {
+    ring_drop_oldest(zcmsnap);
+  }
+}
+
+static GstFlowReturn
+ring_push_head_downstream (GstZcmSnap* zcmsnap)
+{
+  GstBuffer* buf = g_queue_pop_head(&zcmsnap->ring);
+  zcmsnap->ring_bytes -= gst_buffer_get_size(buf);
+  GstFlowReturn ret = gst_pad_push(GST_BASE_TRANSFORM_SRC_PAD(zcmsnap), buf);
+  if (ret != GST_FLOW_OK) ring_clear(zcmsnap);
+  return ret;
+}
+
+/* Emits a snap whose chosen frame is ring entry `selected`, or the frame
+ * currently being processed when selected == ring length. Older ring entries
+ * go out first as the pre-trigger window and newer ones start the
+ * post-trigger window. */
+static GstFlowReturn
+emit_snap (GstZcmSnap* zcmsnap, guint selected)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if (!preroll_enabled(zcmsnap)) {
+    for (; selected > 0; --selected) ring_drop_oldest(zcmsnap);
+  }
+
+  GST_DEBUG_OBJECT (zcmsnap, "emitting %u pre-trigger frames", selected);
+
+  bool in_ring = selected < zcmsnap->ring.length;
+  guint n = in_ring ? selected + 1 : selected;
+  for (guint i = 0; i < n && ret == GST_FLOW_OK; ++i) {
+    ret = ring_push_head_downstream(zcmsnap);
+  }
+
+  zcmsnap->post_remaining = zcmsnap->postroll_frames;
+  if (in_ring) {
+    while (ret == GST_FLOW_OK && zcmsnap->post_remaining > 0 && zcmsnap->ring.length) {
+      ret = ring_push_head_downstream(zcmsnap);
+      zcmsnap->post_remaining--;
+    }
+  }
+
+  return ret;
+}
+
+static void
+report_capture (GstZcmSnap* zcmsnap, int64_t capture_utime, int64_t frame_utime)
+{
+  zcmsnap->last_capture_error_us = frame_utime - capture_utime;
+
+  GST_INFO_OBJECT (zcmsnap, "captured frame at %ld for requested %ld (error %ld us)",
+      frame_utime, capture_utime, zcmsnap->last_capture_error_us);
+
+  gst_element_post_message(GST_ELEMENT(zcmsnap),
+      gst_message_new_element(GST_OBJECT(zcmsnap),
+          gst_structure_new("zcmsnap",
+              "capture-utime", G_TYPE_INT64, capture_utime,
+              "frame-utime", G_TYPE_INT64, frame_utime,
+              "error-us", G_TYPE_INT64, zcmsnap->last_capture_error_us,
+              NULL)));
+}
+
+static inline double
+latency_stddev (GstZcmSnap* zcmsnap)
+{
+  if (zcmsnap->latency_count < 2) return 0;
+  return sqrt(zcmsnap->latency_m2 / (zcmsnap->latency_count - 1));
+}
+
+static void
+latency_update (GstZcmSnap* zcmsnap, int64_t latency_us)
+{
+  zcmsnap->latency_count++;
+  double delta = latency_us - zcmsnap->latency_mean;
+  zcmsnap->latency_mean += delta / zcmsnap->latency_count;
+  zcmsnap->latency_m2 += delta * (latency_us - zcmsnap->latency_mean);
+
+  if (zcmsnap->latency_count == 1 || latency_us < zcmsnap->latency_min)
+    zcmsnap->latency_min = latency_us;
+  if (zcmsnap->latency_count == 1 || latency_us > zcmsnap->latency_max)
+    zcmsnap->latency_max = latency_us;
+}
+
+/* Called for every frame let through for the current request. The first one
+ * also feeds the latency statistics. */
+static void
+acknowledge (GstZcmSnap* zcmsnap, int64_t frame_utime)
+{
+  int64_t now = g_get_real_time();
+
+  zcm_gstreamer_plugins_snap_ack_t ack;
+  ack.utime = now;
+  ack.seq = zcmsnap->ack_seq++;
+  ack.request_utime = zcmsnap->ack_request_utime;
+  ack.debounce = zcmsnap->ack_debounce;
+  ack.capture_utime = zcmsnap->ack_capture_utime;
+  ack.frame_utime = frame_utime;
+  ack.frame_index = zcmsnap->ack_frame_index++;
+  ack.latency_us = 0;
+
+  if (ack.frame_index == 0) {
+    // A request for a future capture_utime is not late until that time
+    int64_t due = zcmsnap->ack_recv_utime > zcmsnap->ack_capture_utime ?
+                  zcmsnap->ack_recv_utime : zcmsnap->ack_capture_utime;
+    ack.latency_us = now - due;
+    latency_update(zcmsnap, ack.latency_us);
+    GST_DEBUG_OBJECT (zcmsnap, "snap latency %ld us", ack.latency_us);
+  }
+
+  ack.latency_count = zcmsnap->latency_count;
+  ack.latency_mean_us = zcmsnap->latency_mean;
+  ack.latency_stddev_us = latency_stddev(zcmsnap);
+  ack.latency_min_us = zcmsnap->latency_min;
+  ack.latency_max_us = zcmsnap->latency_max;
+
+  if (zcmsnap->zcm && zcmsnap->ack_channel->len > 0) {
+    zcm_gstreamer_plugins_snap_ack_t_publish(zcmsnap->zcm, zcmsnap->ack_channel->str, &ack);
+  }
+}
+
+static void
+start_sampling (GstZcmSnap* zcmsnap, int8_t mode, int32_t count,
+                int64_t interval_us, int64_t capture_utime)
+{
+  GST_DEBUG_OBJECT (zcmsnap, "sampling mode %d count %d interval %ld us",
+      mode, count, interval_us);
+
+  zcmsnap->sample_mode = mode;
+  zcmsnap->sample_remaining = count > 0 ? count : 1;
+  zcmsnap->sample_every = count > 0 ? count : 1;
+  zcmsnap->sample_counter = 0;
+  zcmsnap->sample_interval_us = interval_us > 0 ? interval_us : 0;
+  zcmsnap->sample_next_utime = capture_utime;
+
+  if (mode == ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_STOP) {
+    zcmsnap->sample_mode = ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_SINGLE;
+  }
+}
+
+/* Returns TRUE if the active burst / decimation wants this frame */
+static gboolean
+sample_frame (GstZcmSnap* zcmsnap, GstBuffer* buf)
+{
+  switch (zcmsnap->sample_mode) {
+    case ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_DECIMATE:
+      return zcmsnap->sample_counter++ % zcmsnap->sample_every == 0;
+
+    case ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_BURST:
+    case ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_PERIODIC: {
+      int64_t frame_utime = buffer_wall_utime(zcmsnap, buf);
+      if (zcmsnap->sample_next_utime && frame_utime < zcmsnap->sample_next_utime) {
+        return FALSE;
+      }
+
+      // Stay on the requested schedule, but never try to catch up on
+      // frames that were missed
+      int64_t next = (zcmsnap->sample_next_utime ? zcmsnap->sample_next_utime : frame_utime) +
+                     zcmsnap->sample_interval_us;
+      zcmsnap->sample_next_utime = next > frame_utime ? next : frame_utime + zcmsnap->sample_interval_us;
+
+      if (zcmsnap->sample_mode == ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_BURST &&
+          --zcmsnap->sample_remaining == 0) {
+        zcmsnap->sample_mode = ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_SINGLE;
+      }
+      return TRUE;
+    }
+
+    default:
+      return FALSE;
+  }
+}
+
+static void
+request_key_unit (GstZcmSnap* zcmsnap)
+{
+  GST_DEBUG_OBJECT (zcmsnap, "requesting key unit upstream");
+  gst_pad_push_event(GST_BASE_TRANSFORM_SINK_PAD(zcmsnap),
+      gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE,
+          ++zcmsnap->key_unit_count));
+}
+
+/* Compressed streams can only be cut at keyframes: a capture turns into a
+ * key unit request and the next keyframe (and optionally its GOP) is let
+ * through. The pre-trigger ring is not used since delta frames from before a
+ * keyframe cannot be decoded on their own. */
+static GstFlowReturn
+transform_encoded (GstZcmSnap* zcmsnap, GstBuffer* buf)
+{
+  if (GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_HEADER)) return GST_FLOW_OK;
+
+  bool delta = GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+  bool wanted = false;
+
+  if (zcmsnap->armed) {
+    int64_t frame_utime = buffer_wall_utime(zcmsnap, buf);
+    if (frame_utime >= zcmsnap->armed_capture_utime) {
+      zcmsnap->armed = false;
+      zcmsnap->keyframe_capture_utime = zcmsnap->armed_capture_utime;
+      wanted = true;
+    }
+  }
+
+  if (zcmsnap->sample_mode != ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_SINGLE &&
+      sample_frame(zcmsnap, buf)) {
+    wanted = true;
+  }
+
+  // Before the GOP check, a capture during a GOP starts at the next keyframe
+  if (wanted && !zcmsnap->want_keyframe) {
+    zcmsnap->want_keyframe = true;
+    if (delta) request_key_unit(zcmsnap);
+  }
+
+  if (zcmsnap->in_gop) {
+    if (delta) return GST_FLOW_OK;
+    zcmsnap->in_gop = false;
+  }
+
+  if (zcmsnap->want_keyframe && !delta) {
+    int64_t frame_utime = buffer_wall_utime(zcmsnap, buf);
+    zcmsnap->want_keyframe = false;
+    zcmsnap->in_gop = zcmsnap->encoded_capture == GST_ZCM_SNAP_ENCODED_CAPTURE_GOP;
+    if (zcmsnap->keyframe_capture_utime) {
+      report_capture(zcmsnap, zcmsnap->keyframe_capture_utime, frame_utime);
+      zcmsnap->keyframe_capture_utime = 0;
+    }
+    acknowledge(zcmsnap, frame_utime);
+    return GST_FLOW_OK;
+  }
+
+  return GST_BASE_TRANSFORM_FLOW_DROPPED;
+}
+
+/* Decides whether the frame being processed completes the armed snap. Returns
+ * FALSE to keep waiting, otherwise sets *selected as for emit_snap and
+ * *selected_utime to the chosen frame's wall clock time */
+static gboolean
+select_frame (GstZcmSnap* zcmsnap, GstBuffer* buf, guint* selected,
+              int64_t* selected_utime)
+{
+  int64_t capture_utime = zcmsnap->armed_capture_utime;
+  int64_t frame_utime = buffer_wall_utime(zcmsnap, buf);
+
+  if (capture_utime == 0) {
+    *selected = zcmsnap->ring.length;
+    *selected_utime = frame_utime;
+    return TRUE;
+  }
+
+  if (frame_utime < capture_utime) return FALSE;
+
+  *selected = zcmsnap->ring.length;
+  int64_t best_utime = frame_utime;
+  guint i = 0;
+  for (GList* l = zcmsnap->ring.head; l; l = l->next, ++i) {
+    int64_t utime = buffer_wall_utime(zcmsnap, l->data);
+    if (abs_diff(utime, capture_utime) < abs_diff(best_utime, capture_utime)) {
+      best_utime = utime;
+      *selected = i;
+    }
+  }
+
+  report_capture(zcmsnap, capture_utime, best_utime);
+  *selected_utime = best_utime;
+  return TRUE;
 }
 
 /* class initialization */
 
-G_DEFINE_TYPE_WITH_CODE (GstZcmSnap, gst_zcm_snap, GST_TYPE_VIDEO_FILTER,
+G_DEFINE_TYPE_WITH_CODE (GstZcmSnap, gst_zcm_snap, GST_TYPE_BASE_TRANSFORM,
     GST_DEBUG_CATEGORY_INIT (gst_zcm_snap_debug_category, "zcmsnap", 0,
         "debug category for zcmsnap element"));
 
@@ -145,7 +563,6 @@ gst_zcm_snap_class_init (GstZcmSnapClass * klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
   GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS (klass);
-  GstVideoFilterClass *video_filter_class = GST_VIDEO_FILTER_CLASS (klass);
 
   gst_element_class_add_static_pad_template (GST_ELEMENT_CLASS (klass), &srctemplate);
   gst_element_class_add_static_pad_template (GST_ELEMENT_CLASS (klass), &sinktemplate);
@@ -163,9 +580,9 @@ gst_zcm_snap_class_init (GstZcmSnapClass * klass)
   base_transform_class->start = GST_DEBUG_FUNCPTR (gst_zcm_snap_start);
   base_transform_class->stop = GST_DEBUG_FUNCPTR (gst_zcm_snap_stop);
 
-  video_filter_class->set_info = GST_DEBUG_FUNCPTR (gst_zcm_snap_set_info);
-  video_filter_class->transform_frame_ip =
-      GST_DEBUG_FUNCPTR (gst_zcm_snap_transform_frame_ip);
+  base_transform_class->set_caps = GST_DEBUG_FUNCPTR (gst_zcm_snap_set_caps);
+  base_transform_class->transform_ip =
+      GST_DEBUG_FUNCPTR (gst_zcm_snap_transform_ip);
 
   g_object_class_install_property (gobject_class, PROP_ZCM_URL,
           g_param_spec_string ("url", "Zcm transport url",
@@ -176,6 +593,71 @@ gst_zcm_snap_class_init (GstZcmSnapClass * klass)
           g_param_spec_string ("channel", "Zcm subscribe channel",
               "Channel name for snap_t subscription",
               "GSTREAMER_DATA", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PREROLL_FRAMES,
+          g_param_spec_uint ("preroll-frames", "Pre-trigger frames",
+              "Number of frames from before each snap to also let through "
+              "(0 for no frame count limit). Frames are held by reference, so "
+              "upstream buffer pools must be large enough to cover them",
+              0, G_MAXUINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PREROLL_MS,
+          g_param_spec_uint ("preroll-ms", "Pre-trigger window ms",
+              "Let through the frames from this many milliseconds before each "
+              "snap (0 for no time limit)",
+              0, G_MAXUINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PREROLL_MAX_BYTES,
+          g_param_spec_uint64 ("preroll-max-bytes", "Pre-trigger memory cap",
+              "Maximum number of bytes of frames held for the pre-trigger window",
+              0, G_MAXUINT64, DEFAULT_PREROLL_MAX_BYTES,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_POSTROLL_FRAMES,
+          g_param_spec_uint ("postroll-frames", "Post-trigger frames",
+              "Number of frames after each snapped frame to also let through",
+              0, G_MAXUINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LAST_CAPTURE_ERROR_US,
+          g_param_spec_int64 ("last-capture-error-us", "Last capture error us",
+              "Frame time minus requested capture_utime of the last timed snap",
+              G_MININT64, G_MAXINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ENCODED_CAPTURE,
+          g_param_spec_enum ("encoded-capture", "Encoded capture",
+              "What to let through for each snap on compressed video",
+              GST_TYPE_ZCM_SNAP_ENCODED_CAPTURE, GST_ZCM_SNAP_ENCODED_CAPTURE_KEYFRAME,
+              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ACK_CHANNEL,
+          g_param_spec_string ("ack-channel", "Zcm acknowledgement channel",
+              "Channel name for snap_ack_t publishing (empty to disable)",
+              "GSTREAMER_SNAP_ACK", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_COUNT,
+          g_param_spec_int64 ("latency-count", "Latency count",
+              "Number of snaps the latency statistics cover",
+              0, G_MAXINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_MEAN_US,
+          g_param_spec_double ("latency-mean-us", "Latency mean us",
+              "Mean trigger-to-emit latency of snaps",
+              -G_MAXDOUBLE, G_MAXDOUBLE, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_STDDEV_US,
+          g_param_spec_double ("latency-stddev-us", "Latency stddev us",
+              "Standard deviation of the trigger-to-emit latency of snaps",
+              0, G_MAXDOUBLE, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_MIN_US,
+          g_param_spec_int64 ("latency-min-us", "Latency min us",
+              "Smallest trigger-to-emit latency of snaps",
+              G_MININT64, G_MAXINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_MAX_US,
+          g_param_spec_int64 ("latency-max-us", "Latency max us",
+              "Largest trigger-to-emit latency of snaps",
+              G_MININT64, G_MAXINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -192,10 +674,56 @@ gst_zcm_snap_init (GstZcmSnap* zcmsnap)
 
   pthread_mutex_lock(&zcmsnap->mutex);
     zcmsnap->take_picture = false;
+    zcmsnap->capture_utime = 0;
+    zcmsnap->mode = ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_SINGLE;
+    zcmsnap->count = 0;
+    zcmsnap->interval_us = 0;
+    zcmsnap->request_utime = 0;
+    zcmsnap->request_recv_utime = 0;
   pthread_mutex_unlock(&zcmsnap->mutex);
 
+  zcmsnap->ack_request_utime = 0;
+  zcmsnap->ack_recv_utime = 0;
+  zcmsnap->ack_capture_utime = 0;
+  zcmsnap->ack_debounce = 0;
+  zcmsnap->ack_frame_index = 0;
+  zcmsnap->ack_seq = 0;
+
+  zcmsnap->latency_count = 0;
+  zcmsnap->latency_mean = 0;
+  zcmsnap->latency_m2 = 0;
+  zcmsnap->latency_min = 0;
+  zcmsnap->latency_max = 0;
+
+  zcmsnap->sample_mode = ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_SINGLE;
+  zcmsnap->sample_remaining = 0;
+  zcmsnap->sample_every = 1;
+  zcmsnap->sample_counter = 0;
+  zcmsnap->sample_interval_us = 0;
+  zcmsnap->sample_next_utime = 0;
+
+  zcmsnap->encoded = false;
+  zcmsnap->want_keyframe = false;
+  zcmsnap->in_gop = false;
+  zcmsnap->keyframe_capture_utime = 0;
+  zcmsnap->key_unit_count = 0;
+
+  zcmsnap->armed = false;
+  zcmsnap->armed_capture_utime = 0;
+  zcmsnap->last_capture_error_us = 0;
+
+  g_queue_init(&zcmsnap->ring);
+  zcmsnap->ring_bytes = 0;
+  zcmsnap->post_remaining = 0;
+
   zcmsnap->url = g_string_new("");
   zcmsnap->channel = g_string_new("GSTREAMER_SNAP");
+  zcmsnap->ack_channel = g_string_new("GSTREAMER_SNAP_ACK");
+  zcmsnap->preroll_frames = 0;
+  zcmsnap->preroll_ms = 0;
+  zcmsnap->preroll_max_bytes = DEFAULT_PREROLL_MAX_BYTES;
+  zcmsnap->postroll_frames = 0;
+  zcmsnap->encoded_capture = GST_ZCM_SNAP_ENCODED_CAPTURE_KEYFRAME;
 
   init_zcm(zcmsnap);
 }
@@ -217,6 +745,24 @@ gst_zcm_snap_set_property (GObject * object, guint property_id,
       g_string_assign (zcmsnap->channel, g_value_get_string (value));
       subscribe(zcmsnap);
       break;
+    case PROP_PREROLL_FRAMES:
+      zcmsnap->preroll_frames = g_value_get_uint (value);
+      break;
+    case PROP_PREROLL_MS:
+      zcmsnap->preroll_ms = g_value_get_uint (value);
+      break;
+    case PROP_PREROLL_MAX_BYTES:
+      zcmsnap->preroll_max_bytes = g_value_get_uint64 (value);
+      break;
+    case PROP_POSTROLL_FRAMES:
+      zcmsnap->postroll_frames = g_value_get_uint (value);
+      break;
+    case PROP_ENCODED_CAPTURE:
+      zcmsnap->encoded_capture = g_value_get_enum (value);
+      break;
+    case PROP_ACK_CHANNEL:
+      g_string_assign (zcmsnap->ack_channel, g_value_get_string (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -238,6 +784,42 @@ gst_zcm_snap_get_property (GObject * object, guint property_id,
     case PROP_CHANNEL:
       g_value_set_string (value, zcmsnap->channel->str);
       break;
+    case PROP_PREROLL_FRAMES:
+      g_value_set_uint (value, zcmsnap->preroll_frames);
+      break;
+    case PROP_PREROLL_MS:
+      g_value_set_uint (value, zcmsnap->preroll_ms);
+      break;
+    case PROP_PREROLL_MAX_BYTES:
+      g_value_set_uint64 (value, zcmsnap->preroll_max_bytes);
+      break;
+    case PROP_POSTROLL_FRAMES:
+      g_value_set_uint (value, zcmsnap->postroll_frames);
+      break;
+    case PROP_LAST_CAPTURE_ERROR_US:
+      g_value_set_int64 (value, zcmsnap->last_capture_error_us);
+      break;
+    case PROP_ENCODED_CAPTURE:
+      g_value_set_enum (value, zcmsnap->encoded_capture);
+      break;
+    case PROP_ACK_CHANNEL:
+      g_value_set_string (value, zcmsnap->ack_channel->str);
+      break;
+    case PROP_LATENCY_COUNT:
+      g_value_set_int64 (value, zcmsnap->latency_count);
+      break;
+    case PROP_LATENCY_MEAN_US:
+      g_value_set_double (value, zcmsnap->latency_mean);
+      break;
+    case PROP_LATENCY_STDDEV_US:
+      g_value_set_double (value, latency_stddev(zcmsnap));
+      break;
+    case PROP_LATENCY_MIN_US:
+      g_value_set_int64 (value, zcmsnap->latency_min);
+      break;
+    case PROP_LATENCY_MAX_US:
+      g_value_set_int64 (value, zcmsnap->latency_max);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -266,6 +848,7 @@ gst_zcm_snap_finalize (GObject * object)
   /* clean up object here */
 
   destroy_zcm(zcmsnap);
+  ring_clear(zcmsnap);
 
   G_OBJECT_CLASS (gst_zcm_snap_parent_class)->finalize (object);
 }
@@ -287,66 +870,89 @@ gst_zcm_snap_stop (GstBaseTransform * trans)
 
   GST_DEBUG_OBJECT (zcmsnap, "stop");
 
+  ring_clear(zcmsnap);
+  zcmsnap->post_remaining = 0;
+  zcmsnap->armed = false;
+  zcmsnap->sample_mode = ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_SINGLE;
+  zcmsnap->want_keyframe = false;
+  zcmsnap->in_gop = false;
+
   return TRUE;
 }
 
 static gboolean
-gst_zcm_snap_set_info (GstVideoFilter * filter, GstCaps * incaps,
-    GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info)
+gst_zcm_snap_set_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
 {
-  GstZcmSnap *zcmsnap = GST_ZCM_SNAP (filter);
+  GstZcmSnap *zcmsnap = GST_ZCM_SNAP (trans);
 
-  GST_DEBUG_OBJECT (zcmsnap, "set_info");
+  GST_DEBUG_OBJECT (zcmsnap, "set_caps");
 
-  if (GST_VIDEO_INFO_FORMAT (in_info) != GST_VIDEO_INFO_FORMAT (out_info)) {
+  if (!gst_caps_is_equal (incaps, outcaps)) {
     return FALSE;
   }
 
+  // Raw video and intra-only formats such as image/jpeg can be cut at any
+  // frame, everything else under video/ is treated as inter-frame compressed
+  const gchar* name = gst_structure_get_name (gst_caps_get_structure (incaps, 0));
+  zcmsnap->encoded = g_str_has_prefix (name, "video/") &&
+                     g_strcmp0 (name, "video/x-raw") != 0;
+  if (zcmsnap->encoded) ring_clear(zcmsnap);
+
   return TRUE;
 }
 
 static GstFlowReturn
-gst_zcm_snap_transform_frame_ip (GstVideoFilter * filter, GstVideoFrame * frame)
+gst_zcm_snap_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
 {
-  GstZcmSnap *zcmsnap = GST_ZCM_SNAP (filter);
+  GstZcmSnap *zcmsnap = GST_ZCM_SNAP (trans);
 
-  GST_DEBUG_OBJECT (zcmsnap, "transform_frame_ip");
+  GST_DEBUG_OBJECT (zcmsnap, "transform_ip");
 
-  bool take_picture;
   pthread_mutex_lock(&zcmsnap->mutex);
-    take_picture = zcmsnap->take_picture;
-    zcmsnap->take_picture = false;
+    if (zcmsnap->take_picture) {
+      if (zcmsnap->mode == ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_SINGLE) {
+        zcmsnap->armed = true;
+        zcmsnap->armed_capture_utime = zcmsnap->capture_utime;
+      } else {
+        start_sampling(zcmsnap, zcmsnap->mode, zcmsnap->count,
+                       zcmsnap->interval_us, zcmsnap->capture_utime);
+      }
+      zcmsnap->take_picture = false;
+      zcmsnap->ack_request_utime = zcmsnap->request_utime;
+      zcmsnap->ack_recv_utime = zcmsnap->request_recv_utime;
+      zcmsnap->ack_capture_utime = zcmsnap->capture_utime;
+      zcmsnap->ack_debounce = zcmsnap->last_debounce;
+      zcmsnap->ack_frame_index = 0;
+    }
   pthread_mutex_unlock(&zcmsnap->mutex);
 
-  if (G_LIKELY(!take_picture)) {
-    return GST_BASE_TRANSFORM_FLOW_DROPPED;
+  if (zcmsnap->encoded) {
+    return transform_encoded(zcmsnap, buf);
   }
 
-  return GST_FLOW_OK;
-}
+  if (zcmsnap->sample_mode != ZCM_GSTREAMER_PLUGINS_SNAP_T_MODE_SINGLE &&
+      sample_frame(zcmsnap, buf)) {
+    acknowledge(zcmsnap, buffer_wall_utime(zcmsnap, buf));
+    return GST_FLOW_OK;
+  }
 
-static gboolean
-plugin_init (GstPlugin * plugin)
-{
-  return gst_element_register (plugin, "zcmsnap", GST_RANK_NONE,
-      GST_TYPE_ZCM_SNAP);
-}
+  guint selected;
+  int64_t selected_utime;
+  if (G_UNLIKELY(zcmsnap->armed) &&
+      select_frame(zcmsnap, buf, &selected, &selected_utime)) {
+    zcmsnap->armed = false;
+    acknowledge(zcmsnap, selected_utime);
+    bool is_current = selected == zcmsnap->ring.length;
+    GstFlowReturn ret = emit_snap(zcmsnap, selected);
+    if (ret != GST_FLOW_OK || is_current) return ret;
+  }
 
-#ifndef VERSION
-#define VERSION "1.0.0"
-#endif
-#ifndef PACKAGE
-#define PACKAGE "ZeroCM"
-#endif
-#ifndef PACKAGE_NAME
-#define PACKAGE_NAME "zcm-gstreamer-plugins"
-#endif
-#ifndef GST_PACKAGE_ORIGIN
-#define GST_PACKAGE_ORIGIN "https://github.com/ZeroCM/zcm-gstreamer-plugins"
-#endif
+  if (zcmsnap->post_remaining > 0) {
+    zcmsnap->post_remaining--;
+    return GST_FLOW_OK;
+  }
 
-GST_PLUGIN_DEFINE (GST_VERSION_MAJOR,
-    GST_VERSION_MINOR,
-    zcmsnap,
-    "Blocks all frames except those requested by snap_t messages received over zcm",
-    plugin_init, VERSION, "LGPL", PACKAGE_NAME, GST_PACKAGE_ORIGIN)
+  ring_push(zcmsnap, buf);
+  return GST_BASE_TRANSFORM_FLOW_DROPPED;
+}
@@ -21,10 +21,11 @@
 #define _GST_ZCM_SNAP_H_
 
 #include <gst/video/video.h>
-#include <gst/video/gstvideofilter.h>
+#include <gst/base/gstbasetransform.h>
 
 #include <zcm/zcm.h>
 #include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_snap_t.h"
+#include "zcmtypes/zcm_gstreamer_plugins/zcm_gstreamer_plugins_snap_ack_t.h"
 
 #include <pthread.h>
 #include <stdbool.h>
@@ -40,25 +41,81 @@ G_BEGIN_DECLS
 typedef struct _GstZcmSnap GstZcmSnap;
 typedef struct _GstZcmSnapClass GstZcmSnapClass;
 
+typedef enum
+{
+  GST_ZCM_SNAP_ENCODED_CAPTURE_KEYFRAME,
+  GST_ZCM_SNAP_ENCODED_CAPTURE_GOP,
+} GstZcmSnapEncodedCapture;
+
 struct _GstZcmSnap
 {
-  GstVideoFilter base_zcmsnap;
+  GstBaseTransform base_zcmsnap;
 
   // Privates
   zcm_t* zcm;
-  int16_t last_debounce;
   zcm_gstreamer_plugins_snap_t_subscription_t* sub;
+  // Guards the request fields below, written on the zcm dispatch thread
   pthread_mutex_t mutex;
+  int16_t last_debounce;
   bool take_picture;
+  int64_t capture_utime;
+  int8_t mode;
+  int32_t count;
+  int64_t interval_us;
+  int64_t request_utime;
+  int64_t request_recv_utime;
+
+  // Streaming thread only
+  bool armed;
+  int64_t armed_capture_utime;
+  int64_t last_capture_error_us;
+
+  // Request the frames being let through answer, for snap_ack_t
+  int64_t ack_request_utime;
+  int64_t ack_recv_utime;
+  int64_t ack_capture_utime;
+  int16_t ack_debounce;
+  int32_t ack_frame_index;
+  int64_t ack_seq;
+
+  // Running latency statistics (Welford)
+  int64_t latency_count;
+  double latency_mean;
+  double latency_m2;
+  int64_t latency_min;
+  int64_t latency_max;
+
+  int8_t sample_mode;
+  guint sample_remaining;
+  guint sample_every;
+  guint64 sample_counter;
+  int64_t sample_interval_us;
+  int64_t sample_next_utime;
+
+  bool encoded;
+  bool want_keyframe;
+  bool in_gop;
+  int64_t keyframe_capture_utime;
+  guint key_unit_count;
+
+  GQueue ring;
+  gsize ring_bytes;
+  guint post_remaining;
 
   // Properties
   GString* url;
   GString* channel;
+  GString* ack_channel;
+  guint preroll_frames;
+  guint preroll_ms;
+  guint64 preroll_max_bytes;
+  guint postroll_frames;
+  GstZcmSnapEncodedCapture encoded_capture;
 };
 
 struct _GstZcmSnapClass
 {
-  GstVideoFilterClass base_zcmsnap_class;
+  GstBaseTransformClass base_zcmsnap_class;
 };
 
 GType gst_zcm_snap_get_type (void);
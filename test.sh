@@ -8,6 +8,8 @@ handler() {
 trap handler SIGINT SIGTERM
 
 WINDOWS=
+# Where make (or waf) put example-pub and zcm-frame-index
+BUILD=${BUILD:-build}
 
 jpeg_test() {
     gst-launch-1.0 videotestsrc pattern=ball ! videoconvert ! jpegenc ! zcmimagesink channel=JPEG_TEST &
@@ -21,8 +23,79 @@ rgb_test() {
     WINDOWS="$WINDOWS $!"
 }
 
+batch_test() {
+    gst-launch-1.0 videotestsrc pattern=ball ! videoconvert ! 'video/x-raw,format=RGB,width=160,height=120,framerate=300/1' ! zcmimagesink channel=BATCH_TEST batch-frames=10 &
+    gst-launch-1.0 zcmimagesrc channel=BATCH_TEST batched=true ! videoconvert ! autovideosink &
+    WINDOWS="$WINDOWS $!"
+}
+
+h264_test() {
+    gst-launch-1.0 videotestsrc pattern=ball ! videoconvert ! x264enc tune=zerolatency key-int-max=300 ! h264parse ! zcmimagesink channel=H264_TEST &
+    gst-launch-1.0 zcmimagesrc channel=H264_TEST encoded=true ! h264parse ! avdec_h264 ! videoconvert ! autovideosink &
+    WINDOWS="$WINDOWS $!"
+}
+
+log_test() {
+    gst-launch-1.0 videotestsrc pattern=ball num-buffers=300 ! videoconvert ! 'video/x-raw,format=RGB' ! zcmlogsink location=/tmp/zcm_log_test.log channel=LOG_TEST
+    gst-launch-1.0 zcmlogsrc location=/tmp/zcm_log_test.log channel=LOG_TEST rate=2 ! videoconvert ! autovideosink &
+    WINDOWS="$WINDOWS $!"
+}
+
+latched_test() {
+    gst-launch-1.0 videotestsrc pattern=ball ! 'video/x-raw,framerate=1/5' ! videoconvert ! 'video/x-raw,format=RGB' ! zcmimagesink channel=LATCHED_TEST latched=true &
+    sleep 1
+    gst-launch-1.0 zcmimagesrc channel=LATCHED_TEST ! videoconvert ! autovideosink &
+    WINDOWS="$WINDOWS $!"
+}
+
+convert_test() {
+    gst-launch-1.0 videotestsrc pattern=smpte ! 'video/x-raw,format=RGB' ! zcmimagesink channel=CONVERT_TEST &
+    gst-launch-1.0 zcmimagesrc channel=CONVERT_TEST output-format=I420 ! autovideosink &
+    WINDOWS="$WINDOWS $!"
+}
+
+hugepages_test() {
+    gst-launch-1.0 videotestsrc pattern=ball ! 'video/x-raw,format=RGB,width=3840,height=2160' ! zcmimagesink channel=HUGEPAGES_TEST hugepages=true &
+    gst-launch-1.0 zcmimagesrc channel=HUGEPAGES_TEST hugepages=true ! videoconvert ! autovideosink &
+    WINDOWS="$WINDOWS $!"
+}
+
+snap_test() {
+    gst-launch-1.0 videotestsrc pattern=ball is-live=true ! zcmsnap preroll-ms=500 postroll-frames=5 ! videoconvert ! autovideosink &
+    WINDOWS="$WINDOWS $!"
+    sleep 1
+    # Ten snaps a second apart, each for the frame 200 ms before it was sent,
+    # printing the snap_ack_t of every frame let through
+    $BUILD/snap/example-pub 0 -200 &
+}
+
+segments_test() {
+    DIR=/tmp/zcm_segments_test
+    rm -rf $DIR && mkdir -p $DIR
+    gst-launch-1.0 videotestsrc pattern=ball num-buffers=300 ! videoconvert ! 'video/x-raw,format=RGB' ! \
+        zcmmultifilesink location=$DIR/%05d.seg output-mode=segments segment-size=16777216 \
+        index-location=$DIR/frames.idx compression=zstd compression-threads=4
+    # Every indexed frame must lie inside the segment it points into
+    FRAMES=$($BUILD/multifilesink/zcm-frame-index $DIR/frames.idx | while read -r path offset size utime; do
+        [ -f "$path" ] && [ $(stat -c %s "$path") -ge $((offset + size)) ] && echo "$path"
+    done | wc -l)
+    if [ "$FRAMES" -eq 300 ]; then
+        echo "segments_test: 300 frames indexed"
+    else
+        echo "segments_test: FAILED, $FRAMES of 300 frames indexed"
+    fi
+}
+
 jpeg_test
 rgb_test
+batch_test
+h264_test
+log_test
+latched_test
+convert_test
+hugepages_test
+snap_test
+segments_test
 
 wait $WINDOWS
 kill $(jobs -rp)